@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atlas.h"
+
+#define SPRITE_NAME_MAX 32
+
+typedef struct {
+	char   name[SPRITE_NAME_MAX];
+	GRRect rect;
+} sprite_t;
+
+struct atlas {
+	char       *name;
+	gr_surface  surface;
+	sprite_t   *sprites;
+	int         count;
+};
+
+/* ------------------------------------------------------------------------ */
+
+/* Path of the sprite table that goes with image name */
+static char *
+table_path(const char *name, const char *dir)
+{
+	size_t len = strlen(name);
+	char *path;
+
+	if (!dir && len > 4 && !strcmp(name + len - 4, ".png"))
+		len -= 4;
+
+	if (!(path = malloc((dir ? strlen(dir) + 1 : 0) + len + 7)))
+		return NULL;
+
+	if (dir)
+		sprintf(path, "%s/%.*s.atlas", dir, (int)len, name);
+	else
+		sprintf(path, "%.*s.atlas", (int)len, name);
+
+	return path;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+parse_sprite(atlas_t *atlas, const char *line)
+{
+	int w = gr_get_width(atlas->surface);
+	int h = gr_get_height(atlas->surface);
+	char name[SPRITE_NAME_MAX];
+	sprite_t *sprites;
+	int x, y, sw, sh, end = 0;
+
+	if (sscanf(line, " %31s %d %d %d %d %n", name, &x, &y, &sw, &sh,
+		   &end) != 5 || line[end])
+		return -1;
+
+	if (x < 0 || y < 0 || sw <= 0 || sh <= 0 || x + sw > w || y + sh > h)
+		return -1;
+
+	if (atlas_find(atlas, name, NULL))
+		return -1;
+
+	sprites = realloc(atlas->sprites, (atlas->count + 1) *
+			  sizeof *sprites);
+	if (!sprites)
+		return -1;
+
+	atlas->sprites = sprites;
+	strcpy(sprites[atlas->count].name, name);
+	sprites[atlas->count].rect = (GRRect){ x, y, x + sw, y + sh };
+	atlas->count++;
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+atlas_t *
+atlas_load(const char *name, const char *dir)
+{
+	atlas_t *atlas;
+	FILE *fp = NULL;
+	char *path, *line = NULL;
+	size_t size = 0;
+	int lineno = 0, ret;
+	bool ok = true;
+
+	if (!(atlas = calloc(1, sizeof *atlas)))
+		return NULL;
+
+	if (!(atlas->name = strdup(name))) {
+		free(atlas);
+		return NULL;
+	}
+
+	if ((ret = res_create_display_surface(name, dir,
+					      &atlas->surface)) < 0) {
+		fprintf(stderr, "Error while trying to load %s, "
+			"retval: %i.\n", name, ret);
+		atlas_free(atlas);
+		return NULL;
+	}
+
+	if ((path = table_path(name, dir)))
+		res_note_file(path);
+	if (!path || !(fp = fopen(path, "r"))) {
+		perror(path ? path : name);
+		free(path);
+		atlas_free(atlas);
+		return NULL;
+	}
+
+	while (ok && getline(&line, &size, fp) != -1) {
+		lineno++;
+		line[strcspn(line, "#\r\n")] = 0;
+
+		if (!line[strspn(line, " \t")])
+			continue;
+
+		if (!(ok = parse_sprite(atlas, line) == 0))
+			fprintf(stderr, "%s:%d: invalid sprite\n", path,
+				lineno);
+	}
+
+	free(line);
+	fclose(fp);
+	free(path);
+
+	if (!ok) {
+		atlas_free(atlas);
+		return NULL;
+	}
+
+	return atlas;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+atlas_free(atlas_t *atlas)
+{
+	if (!atlas)
+		return;
+
+	if (atlas->surface)
+		res_free_surface(atlas->surface);
+	free(atlas->sprites);
+	free(atlas->name);
+	free(atlas);
+}
+
+/* ------------------------------------------------------------------------ */
+
+const char *
+atlas_name(const atlas_t *atlas)
+{
+	return atlas->name;
+}
+
+/* ------------------------------------------------------------------------ */
+
+gr_surface
+atlas_surface(const atlas_t *atlas)
+{
+	return atlas->surface;
+}
+
+/* ------------------------------------------------------------------------ */
+
+bool
+atlas_find(const atlas_t *atlas, const char *sprite, GRRect *rect)
+{
+	int i;
+
+	for (i = 0; i < atlas->count; i++) {
+		if (!strcmp(atlas->sprites[i].name, sprite)) {
+			if (rect)
+				*rect = atlas->sprites[i].rect;
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,50 @@
+#ifndef _ATLAS_H_
+#define _ATLAS_H_
+
+#include <stdbool.h>
+
+#include "minui/minui.h"
+
+/*
+ * Sprite atlases.
+ *
+ * Many small images are packed into one PNG image, so that they are
+ * decoded with one load and held in one allocation. A text file of the
+ * same name with .atlas suffix names the areas of the image, one sprite
+ * per line, '#' starts a comment:
+ *
+ *   SPRITE X Y W H
+ *
+ * The area is given in pixels, in the orientation the image is drawn
+ * in. Sprites are drawn with gr_blit() from the atlas surface, using
+ * the area as source offset and size.
+ */
+
+typedef struct atlas atlas_t;
+
+/*
+ * Load atlas image and its sprite table.
+ * @param name image name as for res_create_display_surface(), the
+ *        table is read from the same place with .atlas suffix
+ * @param dir directory with images, NULL if name is a path
+ * @return atlas, or NULL if either file could not be loaded
+ */
+atlas_t *atlas_load(const char *name, const char *dir);
+
+/* Free atlas and its image. */
+void atlas_free(atlas_t *atlas);
+
+/* Get the name the atlas was loaded with. */
+const char *atlas_name(const atlas_t *atlas);
+
+/* Get the image holding the sprites. */
+gr_surface atlas_surface(const atlas_t *atlas);
+
+/*
+ * Look up sprite by name.
+ * @param rect set to the area of the sprite in atlas_surface()
+ * @return true if the atlas has the sprite
+ */
+bool atlas_find(const atlas_t *atlas, const char *sprite, GRRect *rect);
+
+#endif /* _ATLAS_H_ */
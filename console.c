@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "console.h"
+#include "minui/minui.h"
+
+#define TAB_WIDTH 8
+
+/* Draw buffers the display alternates between */
+#define DISPLAY_BUFFERS 2
+
+struct console {
+	int        x;
+	int        y;
+	int        width;
+	int        height;
+	int        cols;
+	int        rows;
+	int        char_h;
+	gr_surface surface;     /* rendered lines, top row is oldest */
+	char      *lines;       /* ring of rows lines, cols + 1 bytes each */
+	int        head;        /* ring index of oldest line */
+	int        count;       /* lines in ring */
+	int        pending;     /* newest lines not rendered yet */
+	int        shown;       /* rows of surface in use */
+	char      *partial;     /* line being written, cols + 1 bytes */
+	int        partial_len;
+	int        unblitted;   /* draw buffers without the latest content */
+};
+
+/* ------------------------------------------------------------------------ */
+
+console_t *
+console_new(int x, int y, int width, int height)
+{
+	console_t *console;
+	int char_w, char_h;
+
+	gr_font_size(&char_w, &char_h);
+	if (width < char_w || height < char_h)
+		return NULL;
+
+	if (!(console = calloc(1, sizeof(*console))))
+		return NULL;
+
+	console->x = x;
+	console->y = y;
+	console->width = width;
+	console->height = height;
+	console->cols = width / char_w;
+	console->rows = height / char_h;
+	console->char_h = char_h;
+	console->unblitted = DISPLAY_BUFFERS;
+
+	console->surface = gr_new_surface(width, height);
+	console->lines = calloc(console->rows, console->cols + 1);
+	console->partial = calloc(1, console->cols + 1);
+
+	if (!console->surface || !console->lines || !console->partial) {
+		console_free(console);
+		return NULL;
+	}
+
+	return console;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+console_free(console_t *console)
+{
+	if (!console)
+		return;
+
+	if (console->surface)
+		res_free_surface(console->surface);
+	free(console->lines);
+	free(console->partial);
+	free(console);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static char *
+line_at(const console_t *console, int index)
+{
+	index = (console->head + index) % console->rows;
+	return console->lines + index * (console->cols + 1);
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Move the line being written to the ring, dropping the oldest line if
+ * the ring is full */
+static void
+push_line(console_t *console)
+{
+	char *line;
+
+	if (console->count < console->rows) {
+		line = line_at(console, console->count++);
+	} else {
+		line = line_at(console, 0);
+		console->head = (console->head + 1) % console->rows;
+	}
+
+	memcpy(line, console->partial, console->partial_len);
+	line[console->partial_len] = 0;
+	console->partial_len = 0;
+
+	if (console->pending < console->rows)
+		console->pending++;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+put_char(console_t *console, char c)
+{
+	console->partial[console->partial_len++] = c;
+
+	if (console->partial_len == console->cols)
+		push_line(console);
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+console_write(console_t *console, const char *data, size_t size)
+{
+	while (size--) {
+		unsigned char c = *data++;
+
+		if (c == '\n') {
+			push_line(console);
+		} else if (c == '\t') {
+			do
+				put_char(console, ' ');
+			while (console->partial_len % TAB_WIDTH);
+		} else if (c >= 0x80 && c < 0xc0) {
+			/* The font has no glyphs beyond ASCII, show one
+			 * placeholder per UTF-8 sequence */
+		} else if (c >= 0x80 || c < ' ') {
+			if (c != '\r')
+				put_char(console, '?');
+		} else {
+			put_char(console, c);
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Render lines from first on to their rows of the surface */
+static void
+render_rows(const console_t *console, int first)
+{
+	GRTextRun runs[console->rows];
+	int row, n = console->count - first;
+
+	for (row = first; row < console->count; row++) {
+		runs[row - first].x = 0;
+		runs[row - first].y = row * console->char_h;
+		runs[row - first].text = line_at(console, row);
+	}
+
+	gr_color(0, 0, 0, 255);
+	gr_fill(0, first * console->char_h, console->width,
+		console->count * console->char_h);
+	gr_color(200, 200, 200, 255);
+	gr_text_runs(runs, n, 0);
+}
+
+/* ------------------------------------------------------------------------ */
+
+bool
+console_update(console_t *console)
+{
+	int scroll, row;
+
+	if (!console->pending)
+		return false;
+
+	if (gr_set_draw_surface(console->surface))
+		return false;
+
+	/* Rows of old lines that no longer fit */
+	scroll = console->shown + console->pending - console->count;
+
+	if (scroll >= console->count) {
+		gr_color(0, 0, 0, 255);
+		gr_clear();
+		row = 0;
+	} else {
+		if (scroll > 0)
+			gr_scroll(0, 0, console->width,
+				  console->rows * console->char_h,
+				  scroll * console->char_h);
+		row = console->count - console->pending;
+	}
+
+	render_rows(console, row);
+
+	console->shown = console->count;
+	console->pending = 0;
+	console->unblitted = DISPLAY_BUFFERS;
+
+	gr_set_draw_surface(NULL);
+	return true;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+console_draw(console_t *console)
+{
+	/* Draw buffer has it unless drawn over since */
+	if (!console->unblitted &&
+	    !gr_is_drawn(console->x, console->y,
+			 console->x + console->width,
+			 console->y + console->height))
+		return;
+
+	gr_blit(console->surface, 0, 0, console->width, console->height,
+		console->x, console->y);
+	if (console->unblitted)
+		console->unblitted--;
+}
@@ -0,0 +1,50 @@
+#ifndef _CONSOLE_H_
+#define _CONSOLE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Scrolling text console.
+ *
+ * Shows the tail of a text stream, such as an installer log, in an area
+ * of the screen. Written text is split into lines, long lines wrap at
+ * the area width. Only as many lines as fit the area are kept.
+ *
+ * The lines are rendered to a surface of their own. When new lines
+ * arrive, the existing ones are moved up within it and only the new
+ * ones are rendered. The surface is then copied to the screen as is.
+ */
+
+typedef struct console console_t;
+
+/*
+ * Create console covering an area of the screen.
+ * @return console, or NULL if out of memory or the area is too small
+ */
+console_t *console_new(int x, int y, int width, int height);
+
+/* Free console. */
+void console_free(console_t *console);
+
+/*
+ * Add text to the console. Nothing is drawn yet.
+ * @param data text, not necessarily ending with a line feed
+ * @param size number of bytes in data
+ */
+void console_write(console_t *console, const char *data, size_t size);
+
+/*
+ * Render lines added since the previous update.
+ * @return true if the content changed
+ */
+bool console_update(console_t *console);
+
+/*
+ * Copy console content to the screen before a flip. Skipped when the
+ * draw buffer has it already and nothing was drawn over it, so that
+ * flips of unchanged frames can be skipped too.
+ */
+void console_draw(console_t *console);
+
+#endif /* _CONSOLE_H_ */
@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <endian.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "frameseq.h"
+#include "minui/minui.h"
+
+#define FRAMESEQ_MAGIC      "YAMUIFRM"
+#define FRAMESEQ_VERSION    1
+#define FRAMESEQ_HAS_RECTS  (1 << 0)
+#define FRAMESEQ_ALIGN      4096
+
+/* Frames to have in page cache ahead of playback */
+#define READAHEAD_FRAMES    8
+
+/* Draws that cover the whole frame, one for each display buffer */
+#define FULL_DRAWS          2
+
+struct frameseq_header {
+	char     magic[8];
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t count;
+	uint32_t fps;
+	uint32_t flags;
+};
+
+struct frameseq_rect {
+	uint16_t x;
+	uint16_t y;
+	uint16_t w;
+	uint16_t h;
+};
+
+struct frameseq {
+	unsigned char *map;
+	size_t         map_size;
+	size_t         data_offset;  /* first frame */
+	size_t         frame_size;
+	int            count;
+	int            fps;
+	GRRect        *rects;        /* change from previous frame, or NULL */
+	GRSurface      frame;        /* points to the frame being drawn */
+	int            last;         /* frame drawn last, -1 if none */
+	int            draws;
+	GRRect         prev_area;    /* changes drawn to the other buffer */
+	int            readahead;    /* first frame of next readahead window */
+};
+
+/* ------------------------------------------------------------------------ */
+
+static GRRect
+rect_union(GRRect a, GRRect b)
+{
+	if (a.x1 >= a.x2 || a.y1 >= a.y2)
+		return b;
+	if (b.x1 >= b.x2 || b.y1 >= b.y2)
+		return a;
+
+	a.x1 = b.x1 < a.x1 ? b.x1 : a.x1;
+	a.y1 = b.y1 < a.y1 ? b.y1 : a.y1;
+	a.x2 = b.x2 > a.x2 ? b.x2 : a.x2;
+	a.y2 = b.y2 > a.y2 ? b.y2 : a.y2;
+	return a;
+}
+
+frameseq_t *
+frameseq_open(const char *path)
+{
+	frameseq_t *seq = NULL;
+	struct frameseq_header hdr;
+	struct stat st;
+	uint64_t rects_size = 0, data_offset, data_size;
+	int fd, i;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+		printf("%s: open: %m\n", path);
+		return NULL;
+	}
+
+	if (fstat(fd, &st) == -1 || read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+		printf("%s: can't read header\n", path);
+		goto fail;
+	}
+
+	hdr.version = le32toh(hdr.version);
+	hdr.width = le32toh(hdr.width);
+	hdr.height = le32toh(hdr.height);
+	hdr.count = le32toh(hdr.count);
+	hdr.fps = le32toh(hdr.fps);
+	hdr.flags = le32toh(hdr.flags);
+
+	if (memcmp(hdr.magic, FRAMESEQ_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.version != FRAMESEQ_VERSION) {
+		printf("%s: not a frame file\n", path);
+		goto fail;
+	}
+
+	if (!hdr.width || !hdr.height || hdr.width > 0x4000 ||
+	    hdr.height > 0x4000 || !hdr.count || hdr.count > INT_MAX ||
+	    !hdr.fps) {
+		printf("%s: bad geometry\n", path);
+		goto fail;
+	}
+
+	/* Sizes are computed in 64 bits, they overflow a 32-bit size_t
+	 * long before they overflow these */
+	if (hdr.flags & FRAMESEQ_HAS_RECTS)
+		rects_size = (uint64_t)hdr.count * sizeof(struct frameseq_rect);
+
+	data_offset = (sizeof(hdr) + rects_size + FRAMESEQ_ALIGN - 1) /
+		      FRAMESEQ_ALIGN * FRAMESEQ_ALIGN;
+	data_size = data_offset +
+		    (uint64_t)hdr.width * hdr.height * 4 * hdr.count;
+
+	if ((uint64_t)st.st_size < data_size) {
+		printf("%s: file too short\n", path);
+		goto fail;
+	}
+	if (data_size > SIZE_MAX) {
+		printf("%s: file too large to map\n", path);
+		goto fail;
+	}
+
+	if (!(seq = calloc(1, sizeof(*seq))))
+		goto fail;
+
+	seq->data_offset = data_offset;
+	seq->frame_size = (size_t)hdr.width * hdr.height * 4;
+	seq->count = hdr.count;
+	seq->fps = hdr.fps;
+	seq->map_size = data_size;
+	seq->map = mmap(NULL, seq->map_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (seq->map == MAP_FAILED) {
+		printf("%s: mmap: %m\n", path);
+		seq->map = NULL;
+		goto fail;
+	}
+
+	/* No MADV_SEQUENTIAL: playback loops, and frames dropped behind
+	 * it would be read from storage again on every round. Reading
+	 * ahead is done by readahead_frames(). */
+
+	if (rects_size) {
+		const struct frameseq_rect *fr =
+			(const void *)(seq->map + sizeof(hdr));
+
+		if (!(seq->rects = calloc(seq->count, sizeof(GRRect))))
+			goto fail;
+
+		for (i = 0; i < seq->count; i++) {
+			GRRect *r = &seq->rects[i];
+
+			r->x1 = le16toh(fr[i].x);
+			r->y1 = le16toh(fr[i].y);
+			r->x2 = r->x1 + le16toh(fr[i].w);
+			r->y2 = r->y1 + le16toh(fr[i].h);
+
+			if (r->x2 > (int)hdr.width || r->y2 > (int)hdr.height) {
+				printf("%s: bad rect for frame %d\n", path, i);
+				goto fail;
+			}
+		}
+	}
+
+	seq->frame.width = hdr.width;
+	seq->frame.height = hdr.height;
+	seq->frame.row_bytes = hdr.width * 4;
+	seq->frame.pixel_bytes = 4;
+	seq->last = -1;
+
+	close(fd);
+	return seq;
+
+fail:
+	frameseq_close(seq);
+	close(fd);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+frameseq_close(frameseq_t *seq)
+{
+	if (!seq)
+		return;
+
+	if (seq->map)
+		munmap(seq->map, seq->map_size);
+
+	free(seq->rects);
+	free(seq);
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+frameseq_frame_at(const frameseq_t *seq, long long elapsed_ms)
+{
+	if (elapsed_ms < 0)
+		elapsed_ms = 0;
+
+	return elapsed_ms * seq->fps / 1000 % seq->count;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Ask the kernel to start reading the next frames into page cache
+ * before they are needed. */
+static void
+readahead_frames(frameseq_t *seq, int index)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	size_t start, end;
+	int first = index + 1;
+	int count = READAHEAD_FRAMES;
+
+	if (first >= seq->count)
+		first = 0;
+	if (first + count > seq->count)
+		count = seq->count - first;
+
+	start = seq->data_offset + first * seq->frame_size;
+	end = start + count * seq->frame_size;
+	start -= start % page;
+
+	madvise(seq->map + start, end - start, MADV_WILLNEED);
+
+	seq->readahead = (first + count) % seq->count;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+frameseq_draw(frameseq_t *seq, int index, bool full)
+{
+	GRRect frame = { 0, 0, seq->frame.width, seq->frame.height };
+	GRRect area = { 0, 0, 0, 0 }, draw;
+	int dx, dy, i;
+
+	if (index < 0 || index >= seq->count)
+		return;
+
+	/* Keep a window of frames ahead of playback in page cache */
+	if (seq->last == -1 || index >= seq->readahead ||
+	    index < seq->last)
+		readahead_frames(seq, index);
+
+	if (seq->draws < FULL_DRAWS || seq->last == -1 || !seq->rects)
+		full = true;
+
+	/* Changes since the frame drawn last, may wrap around */
+	for (i = seq->last; !full && i != index; ) {
+		i = (i + 1) % seq->count;
+		area = rect_union(area, seq->rects[i]);
+	}
+
+	if (full)
+		area = frame;
+
+	/* Other buffer still lacks the changes drawn last time */
+	draw = rect_union(area, seq->prev_area);
+	seq->prev_area = area;
+	seq->last = index;
+	if (seq->draws < FULL_DRAWS)
+		seq->draws++;
+
+	if (draw.x1 >= draw.x2 || draw.y1 >= draw.y2)
+		return;
+
+	seq->frame.data = seq->map + seq->data_offset +
+			  index * seq->frame_size;
+
+	dx = (gr_fb_width() - seq->frame.width) / 2;
+	dy = (gr_fb_height() - seq->frame.height) / 2;
+
+	gr_blit_upright(&seq->frame, draw.x1, draw.y1, draw.x2 - draw.x1,
+		draw.y2 - draw.y1, dx + draw.x1, dy + draw.y1);
+}
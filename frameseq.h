@@ -0,0 +1,52 @@
+#ifndef _FRAMESEQ_H_
+#define _FRAMESEQ_H_
+
+#include <stdbool.h>
+
+/*
+ * Raw frame sequence playback.
+ *
+ * Frames are copied to the draw buffer directly from a memory mapped
+ * file, so there is no decoding and no allocation per frame. The file
+ * consists of, all values little endian:
+ *
+ *   header       "YAMUIFRM", then u32 values version (1), width, height,
+ *                frame count, frames per second and flags
+ *   rect table   if flags bit 0 is set: for each frame u16 values x, y,
+ *                w and h of the area that changed from the previous
+ *                frame (the last frame for the first one)
+ *   frames       starting at the next 4096 byte boundary, width x height
+ *                pixels each, in draw buffer format (RGBX)
+ *
+ * Frames and rects are upright, as they are seen on screen. With
+ * gr_set_rotation() the display hardware rotates them, or if it can't,
+ * the changed area of each frame is rotated as it is copied.
+ */
+
+typedef struct frameseq frameseq_t;
+
+/*
+ * Map frame file.
+ * @param path frame file
+ * @return sequence, or NULL if the file is not valid
+ */
+frameseq_t *frameseq_open(const char *path);
+
+/* Unmap frame file. */
+void frameseq_close(frameseq_t *seq);
+
+/*
+ * Get frame to show at a point of time, looping the sequence.
+ * @param elapsed_ms time since start of playback
+ */
+int frameseq_frame_at(const frameseq_t *seq, long long elapsed_ms);
+
+/*
+ * Draw frame in the middle of the screen.
+ * @param index frame number
+ * @param full true to draw the whole frame, false to draw only the
+ *        area that changed since the frame drawn before
+ */
+void frameseq_draw(frameseq_t *seq, int index, bool full);
+
+#endif /* _FRAMESEQ_H_ */
@@ -23,6 +23,7 @@
 #include <unistd.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <stdint.h>
 
 #include <sys/mman.h>
 #include <sys/types.h>
@@ -30,10 +31,20 @@
 
 #include <linux/fb.h>
 #include <linux/kd.h>
+#include <linux/dma-buf.h>
 
 #include "font_10x18.h"
 #include "minui.h"
 #include "graphics.h"
+#include "kernels.h"
+
+#define FOURCC(a, b, c, d) \
+	((unsigned)(a) | (unsigned)(b) << 8 | \
+	 (unsigned)(c) << 16 | (unsigned)(d) << 24)
+
+/* DRM_FORMAT_XBGR8888 and ABGR8888 have the byte order of draw buffers */
+#define FORMAT_XBGR8888 FOURCC('X', 'B', '2', '4')
+#define FORMAT_ABGR8888 FOURCC('A', 'B', '2', '4')
 
 typedef struct {
 	GRSurface *texture;
@@ -56,13 +67,252 @@ static unsigned char gr_current_b = 255;
 static unsigned char gr_current_a = 255;
 
 static GRSurface *gr_draw = NULL;
+static bool gr_overlay_shown = false;
+
+/* Display draw buffer while drawing to another surface */
+static GRSurface *gr_screen_draw = NULL;
+static int gr_screen_offset_x = 0;
+static int gr_screen_offset_y = 0;
+
+/* Flips of unchanged content are skipped. In draw buffer coordinates:
+ * area drawn since the last flip, and area where the draw buffer may
+ * differ from gr_front, which is on screen. */
+static GRRect gr_damage;
+static GRRect gr_stale;
+static GRSurface *gr_front = NULL;
+
+/* Darkening in software, see gr_darken(). Drawing goes to gr_fade_copy
+ * meanwhile, and flips copy it darkened to gr_fade_screen, the draw
+ * buffer of the display. */
+static GRSurface *gr_fade_copy = NULL;
+static GRSurface *gr_fade_screen = NULL;
+static unsigned char *gr_fade_zeros = NULL;
+static int gr_fade_level = 255;
+
+/* Rotation done in software, degrees clockwise */
+static int gr_rotation = 0;
+
+GRSettings gr_settings = {
+	.render_scale = 100,
+};
+
+/* ------------------------------------------------------------------------ */
+
+/* Width and height of a surface as seen by the gr_*() callers. */
+static int
+logical_width(const GRSurface *surface, int rotation)
+{
+	return rotation % 180 ? surface->height : surface->width;
+}
+
+static int
+logical_height(const GRSurface *surface, int rotation)
+{
+	return rotation % 180 ? surface->width : surface->height;
+}
+
+#define draw_width()  logical_width(gr_draw, gr_rotation)
+#define draw_height() logical_height(gr_draw, gr_rotation)
 
 /* ------------------------------------------------------------------------ */
 
 static bool
 outside(int x, int y)
 {
-	return x < 0 || x >= gr_draw->width || y < 0 || y >= gr_draw->height;
+	return x < 0 || x >= draw_width() || y < 0 || y >= draw_height();
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Map top left corner of a w x h rectangle on a width x height surface
+ * to data rotated clockwise by rotation degrees. */
+static void
+rotate_rect_by(int rotation, int width, int height, int w, int h,
+	       int *x, int *y)
+{
+	int t;
+
+	switch (rotation) {
+	case 90:
+		t = *x;
+		*x = height - *y - h;
+		*y = t;
+		break;
+	case 180:
+		*x = width - *x - w;
+		*y = height - *y - h;
+		break;
+	case 270:
+		t = *y;
+		*y = width - *x - w;
+		*x = t;
+		break;
+	}
+}
+
+/* Same for the software rotation. The rectangle size in the rotated
+ * data is rotated_w x rotated_h. */
+static void
+rotate_rect(int width, int height, int w, int h, int *x, int *y)
+{
+	rotate_rect_by(gr_rotation, width, height, w, h, x, y);
+}
+
+#define rotated_w(w, h) (gr_rotation % 180 ? (h) : (w))
+#define rotated_h(w, h) (gr_rotation % 180 ? (w) : (h))
+
+/* ------------------------------------------------------------------------ */
+
+static unsigned char *
+pixel_at(const GRSurface *surface, int x, int y)
+{
+	return surface->data + y * surface->row_bytes +
+			       x * surface->pixel_bytes;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+rect_add(GRRect *r, int x1, int y1, int x2, int y2)
+{
+	if (x1 >= x2 || y1 >= y2)
+		return;
+
+	if (r->x1 >= r->x2 || r->y1 >= r->y2) {
+		r->x1 = x1, r->y1 = y1, r->x2 = x2, r->y2 = y2;
+		return;
+	}
+
+	if (r->x1 > x1) r->x1 = x1;
+	if (r->y1 > y1) r->y1 = y1;
+	if (r->x2 < x2) r->x2 = x2;
+	if (r->y2 < y2) r->y2 = y2;
+}
+
+/* Record area of draw buffer that was written to */
+static void
+damage(int x, int y, int w, int h)
+{
+	if (!gr_screen_draw)
+		rect_add(&gr_damage, x, y, x + w, y + h);
+}
+
+/* Forget what is on screen, so that the next flip is not skipped */
+static void
+damage_reset(void)
+{
+	memset(&gr_damage, 0, sizeof(gr_damage));
+	memset(&gr_stale, 0, sizeof(gr_stale));
+	if (gr_draw)
+		rect_add(&gr_stale, 0, 0, gr_draw->width, gr_draw->height);
+	gr_front = NULL;
+}
+
+/* Largest part of the frame compared for changes. Both buffers are
+ * uncached scanout memory, so reading large areas from them costs more
+ * than the flip that could be saved. */
+#define DAMAGE_DIFF_MAX_DIVISOR 16
+
+/* Shrink r to the rows where a and b differ. Returns false if they
+ * are equal inside r. Stops at the first difference from both ends. */
+static bool
+damage_diff(const GRSurface *a, const GRSurface *b, GRRect *r)
+{
+	int bytes = (r->x2 - r->x1) * a->pixel_bytes;
+
+	while (r->y1 < r->y2 &&
+	       !memcmp(pixel_at(a, r->x1, r->y1), pixel_at(b, r->x1, r->y1),
+		       bytes))
+		r->y1++;
+
+	while (r->y2 > r->y1 &&
+	       !memcmp(pixel_at(a, r->x1, r->y2 - 1),
+		       pixel_at(b, r->x1, r->y2 - 1), bytes))
+		r->y2--;
+
+	return r->y1 < r->y2;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Tile size for rotation; a tile of both source and destination stays
+ * in cache while columns are turned into rows. */
+#define ROTATE_TILE 32
+
+static void
+rotate_pixels(const GRSurface *src, unsigned char *dst, int dst_row_bytes,
+	      int rotation)
+{
+	int w = src->width, h = src->height, pb = src->pixel_bytes;
+	int tx, ty, x, y;
+
+	for (ty = 0; ty < h; ty += ROTATE_TILE) {
+		int ty_end = ty + ROTATE_TILE < h ? ty + ROTATE_TILE : h;
+
+		for (tx = 0; tx < w; tx += ROTATE_TILE) {
+			int tx_end = tx + ROTATE_TILE < w ? tx + ROTATE_TILE : w;
+
+			for (y = ty; y < ty_end; y++) {
+				const unsigned char *s = pixel_at(src, tx, y);
+
+				for (x = tx; x < tx_end; x++, s += pb) {
+					int dx, dy;
+					unsigned char *d;
+
+					switch (rotation) {
+					case 90:
+						dx = h - 1 - y, dy = x;
+						break;
+					case 180:
+						dx = w - 1 - x, dy = h - 1 - y;
+						break;
+					default:
+						dx = y, dy = w - 1 - x;
+						break;
+					}
+
+					d = dst + dy * dst_row_bytes + dx * pb;
+					if (pb == 4)
+						*(uint32_t *)d = *(const uint32_t *)s;
+					else
+						memcpy(d, s, pb);
+				}
+			}
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+gr_rotate_surface(GRSurface *surface)
+{
+	int w, h, row_bytes;
+	unsigned char *data;
+
+	if (!surface || surface->rotation == gr_rotation)
+		return 0;
+
+	w = logical_width(surface, gr_rotation);
+	h = logical_height(surface, gr_rotation);
+	row_bytes = w * surface->pixel_bytes;
+
+	if (!(data = malloc(h * row_bytes))) {
+		printf("gr_rotate_surface: out of memory\n");
+		return -1;
+	}
+
+	/* Packed rotated data always fits in the original buffer */
+	rotate_pixels(surface, data, row_bytes, gr_rotation);
+	memcpy(surface->data, data, h * row_bytes);
+	free(data);
+
+	surface->width = w;
+	surface->height = h;
+	surface->row_bytes = row_bytes;
+	surface->rotation = gr_rotation;
+
+	return 0;
 }
 
 /* ------------------------------------------------------------------------ */
@@ -121,19 +371,30 @@ text_blend(unsigned char *src_p, int src_row_bytes, unsigned char *dst_p,
 
 /* ------------------------------------------------------------------------ */
 
-void
-gr_text(int x, int y, const char *s, int bold)
+/* Check that text can be drawn, and get the font ready for it */
+static bool
+text_prepare(void)
 {
-	GRFont *font = gr_font;
-	unsigned chr;
-
-	if (!font->texture)
-		return;
+	if (!gr_font->texture)
+		return false;
 
 	if (gr_current_a == 0)
-		return;
+		return false;
+
+	return gr_rotate_surface(gr_font->texture) == 0;
+}
 
-	int has_bold = font->texture->height != font->cheight;
+/* ------------------------------------------------------------------------ */
+
+static void
+text_draw(int x, int y, const char *s, int bold)
+{
+	GRFont *font = gr_font;
+	unsigned chr;
+
+	int tw = logical_width(font->texture, gr_rotation);
+	int th = logical_height(font->texture, gr_rotation);
+	int has_bold = th != font->cheight;
 	bold = bold && has_bold;
 
 	int fw = font->cwidth;
@@ -176,15 +437,18 @@ gr_text(int x, int y, const char *s, int bold)
 			sy = overscan_offset_y + y + cy;
 			if (!outside(sx, sy) &&
 			    !outside(sx + fw - 1, sy + fh - 1)) {
-				src_p = font->texture->data + chr * fw;
-				if (bold)
-					src_p += fh * font->texture->row_bytes;
-				dst_p = gr_draw->data
-					+ sy * gr_draw->row_bytes
-					+ sx * gr_draw->pixel_bytes;
+				int tx = chr * fw, ty = bold ? fh : 0;
+
+				rotate_rect(tw, th, fw, fh, &tx, &ty);
+				rotate_rect(draw_width(), draw_height(), fw, fh,
+					    &sx, &sy);
+				src_p = pixel_at(font->texture, tx, ty);
+				dst_p = pixel_at(gr_draw, sx, sy);
 				text_blend(src_p, font->texture->row_bytes,
 					   dst_p, gr_draw->row_bytes,
-					   fw, fh);
+					   rotated_w(fw, fh), rotated_h(fw, fh));
+				damage(sx, sy, rotated_w(fw, fh),
+				       rotated_h(fw, fh));
 			}
 			cx += fw;
 			break;
@@ -194,6 +458,29 @@ gr_text(int x, int y, const char *s, int bold)
 
 /* ------------------------------------------------------------------------ */
 
+void
+gr_text(int x, int y, const char *s, int bold)
+{
+	if (text_prepare())
+		text_draw(x, y, s, bold);
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+gr_text_runs(const GRTextRun *runs, int count, int bold)
+{
+	int i;
+
+	if (!text_prepare())
+		return;
+
+	for (i = 0; i < count; i++)
+		text_draw(runs[i].x, runs[i].y, runs[i].text, bold);
+}
+
+/* ------------------------------------------------------------------------ */
+
 void
 gr_texticon(int x, int y, GRSurface *icon)
 {
@@ -207,19 +494,25 @@ gr_texticon(int x, int y, GRSurface *icon)
 		return;
 	}
 
+	if (gr_rotate_surface(icon))
+		return;
+
 	x += overscan_offset_x;
 	y += overscan_offset_y;
 
 	if (outside(x, y) ||
-	    outside(x + icon->width - 1, y + icon->height - 1))
+	    outside(x + gr_get_width(icon) - 1, y + gr_get_height(icon) - 1))
 		return;
 
+	rotate_rect(draw_width(), draw_height(),
+		    gr_get_width(icon), gr_get_height(icon), &x, &y);
+
 	src_p = icon->data;
-	dst_p = gr_draw->data + y * gr_draw->row_bytes +
-				x * gr_draw->pixel_bytes;
+	dst_p = pixel_at(gr_draw, x, y);
 
 	text_blend(src_p, icon->row_bytes, dst_p, gr_draw->row_bytes,
 		   icon->width, icon->height);
+	damage(x, y, icon->width, icon->height);
 }
 
 /* ------------------------------------------------------------------------ */
@@ -238,6 +531,8 @@ gr_color(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
 void
 gr_clear(void)
 {
+	damage(0, 0, gr_draw->width, gr_draw->height);
+
 	if (gr_current_r == gr_current_g && gr_current_r == gr_current_b)
 		memset(gr_draw->data, gr_current_r,
 		       gr_draw->height * gr_draw->row_bytes);
@@ -261,22 +556,14 @@ gr_clear(void)
 
 /* ------------------------------------------------------------------------ */
 
-void
-gr_fill(int x1, int y1, int x2, int y2)
+/* Fill area of the draw buffer, given in rotated data coordinates */
+static void
+fill_rect(int x1, int y1, int x2, int y2)
 {
-	unsigned char *p;
+	unsigned char *p = pixel_at(gr_draw, x1, y1);
 
-	x1 += overscan_offset_x;
-	y1 += overscan_offset_y;
-
-	x2 += overscan_offset_x;
-	y2 += overscan_offset_y;
-
-	if (outside(x1, y1) || outside(x2 - 1, y2 - 1))
-		return;
-
-	p = gr_draw->data + y1 * gr_draw->row_bytes +
-	    x1 * gr_draw->pixel_bytes;
+	if (gr_current_a > 0)
+		damage(x1, y1, x2 - x1, y2 - y1);
 
 	if (gr_current_a == 255) {
 		int x, y;
@@ -319,37 +606,356 @@ gr_fill(int x1, int y1, int x2, int y2)
 
 /* ------------------------------------------------------------------------ */
 
+/* Map area in screen coordinates to rotated data coordinates */
+static void
+rotate_area(GRRect *r)
+{
+	int w = r->x2 - r->x1, h = r->y2 - r->y1;
+
+	rotate_rect(draw_width(), draw_height(), w, h, &r->x1, &r->y1);
+	r->x2 = r->x1 + rotated_w(w, h);
+	r->y2 = r->y1 + rotated_h(w, h);
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+gr_fill(int x1, int y1, int x2, int y2)
+{
+	GRRect r = {
+		x1 + overscan_offset_x, y1 + overscan_offset_y,
+		x2 + overscan_offset_x, y2 + overscan_offset_y
+	};
+
+	if (outside(r.x1, r.y1) || outside(r.x2 - 1, r.y2 - 1))
+		return;
+
+	if (gr_rotation)
+		rotate_area(&r);
+
+	fill_rect(r.x1, r.y1, r.x2, r.y2);
+}
+
+/* ------------------------------------------------------------------------ */
+
+bool
+gr_is_drawn(int x1, int y1, int x2, int y2)
+{
+	GRRect r = {
+		x1 + overscan_offset_x, y1 + overscan_offset_y,
+		x2 + overscan_offset_x, y2 + overscan_offset_y
+	};
+
+	if (gr_rotation)
+		rotate_area(&r);
+
+	return r.x1 < gr_damage.x2 && gr_damage.x1 < r.x2 &&
+	       r.y1 < gr_damage.y2 && gr_damage.y1 < r.y2;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Rectangles sorted at a time by gr_fill_rects() */
+#define FILL_BATCH 64
+
+static int
+compare_rows(const void *a, const void *b)
+{
+	const GRRect *ra = a, *rb = b;
+
+	if (ra->y1 != rb->y1)
+		return ra->y1 - rb->y1;
+	return ra->x1 - rb->x1;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+gr_fill_rects(const GRRect *rects, int count)
+{
+	GRRect batch[FILL_BATCH];
+	int i, n;
+
+	if (gr_current_a == 0)
+		return;
+
+	while (count > 0) {
+		for (n = 0; count > 0 && n < FILL_BATCH; rects++, count--) {
+			GRRect r = {
+				rects->x1 + overscan_offset_x,
+				rects->y1 + overscan_offset_y,
+				rects->x2 + overscan_offset_x,
+				rects->y2 + overscan_offset_y
+			};
+
+			if (r.x1 < 0) r.x1 = 0;
+			if (r.y1 < 0) r.y1 = 0;
+			if (r.x2 > draw_width()) r.x2 = draw_width();
+			if (r.y2 > draw_height()) r.y2 = draw_height();
+			if (r.x1 >= r.x2 || r.y1 >= r.y2)
+				continue;
+
+			if (gr_rotation)
+				rotate_area(&r);
+
+			batch[n++] = r;
+		}
+
+		/* Fills are in one color, so order does not change the
+		 * result. Going down the buffer keeps memory access
+		 * sequential. */
+		qsort(batch, n, sizeof *batch, compare_rows);
+
+		for (i = 0; i < n; i++)
+			fill_rect(batch[i].x1, batch[i].y1, batch[i].x2,
+				  batch[i].y2);
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Clip blit parameters to the drawing surface. Returns false if nothing
+ * is left to draw. */
+static bool
+clip_blit_rect(int *sx, int *sy, int *w, int *h, int *dx, int *dy)
+{
+	*dx += overscan_offset_x;
+	*dy += overscan_offset_y;
+
+	if (*dx < 0) *sx -= *dx, *w += *dx, *dx = 0;
+	if (*dy < 0) *sy -= *dy, *h += *dy, *dy = 0;
+	if (*dx + *w > draw_width()) *w = draw_width() - *dx;
+	if (*dy + *h > draw_height()) *h = draw_height() - *dy;
+
+	return *w > 0 && *h > 0;
+}
+
+/* Clip blit parameters to the drawing surface and map them to the
+ * rotated data. Returns false if nothing is left to draw. */
+static bool
+blit_rect(GRSurface *source, int *sx, int *sy, int *w, int *h,
+	  int *dx, int *dy)
+{
+	int t;
+
+	if (!clip_blit_rect(sx, sy, w, h, dx, dy))
+		return false;
+
+	if (gr_rotation) {
+		rotate_rect(gr_get_width(source), gr_get_height(source),
+			    *w, *h, sx, sy);
+		rotate_rect(draw_width(), draw_height(), *w, *h, dx, dy);
+		t = *w;
+		*w = rotated_w(*w, *h);
+		*h = rotated_h(t, *h);
+	}
+
+	return true;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Blocks copied to the screen of at least this many bytes bypass the
+ * cache; the display reads them, not the CPU. Per row the store fence
+ * costs more than it saves. */
+#define BLIT_STREAM_MIN (256 * 1024)
+
+/* Convert a row of RGBX pixels to little endian RGB565 */
+static void
+pack_rgb565(unsigned char *dst, const unsigned char *src, int w)
+{
+	unsigned v;
+
+	while (w--) {
+		v = (src[0] >> 3) << 11 | (src[1] >> 2) << 5 | src[2] >> 3;
+		*dst++ = v;
+		*dst++ = v >> 8;
+		src += 4;
+	}
+}
+
+/* Convert a row of little endian RGB565 pixels to RGBX, the inverse of
+ * pack_rgb565() with the low bits filled from the high ones */
+static void
+unpack_rgb565(unsigned char *dst, const unsigned char *src, int w)
+{
+	unsigned v;
+
+	while (w--) {
+		v = src[0] | src[1] << 8;
+		dst[0] = (v >> 11) << 3 | v >> 13;
+		dst[1] = (v >> 5 & 0x3f) << 2 | (v >> 9 & 0x03);
+		dst[2] = (v & 0x1f) << 3 | (v >> 2 & 0x07);
+		dst[3] = 0xff;
+		dst += 4;
+		src += 2;
+	}
+}
+
 void
 gr_blit(GRSurface *source, int sx, int sy, int w, int h, int dx, int dy)
 {
 	int i;
 	unsigned char *src_p, *dst_p;
+	size_t row;
+	void (*copy)(unsigned char *, const unsigned char *, size_t);
 
 	if (!source)
 		return;
 
-	if (gr_draw->pixel_bytes != source->pixel_bytes) {
+	if (gr_draw->pixel_bytes != source->pixel_bytes &&
+	    (gr_draw->pixel_bytes != 2 || source->pixel_bytes != 4)) {
 		printf("gr_blit: source has wrong format\n");
 		return;
 	}
 
-	dx += overscan_offset_x;
-	dy += overscan_offset_y;
+	if (gr_rotate_surface(source))
+		return;
+
+	if (!blit_rect(source, &sx, &sy, &w, &h, &dx, &dy))
+		return;
+
+	src_p = pixel_at(source, sx, sy);
+	dst_p = pixel_at(gr_draw, dx, dy);
+	damage(dx, dy, w, h);
+
+	/* 32 bpp surfaces on a 16 bpp display */
+	if (gr_draw->pixel_bytes != source->pixel_bytes) {
+		for (i = 0; i < h; i++) {
+			pack_rgb565(dst_p, src_p, w);
+			src_p += source->row_bytes;
+			dst_p += gr_draw->row_bytes;
+		}
+		return;
+	}
+
+	/* Full width rows without padding are one block */
+	row = (size_t)w * source->pixel_bytes;
+	if (row == (size_t)source->row_bytes &&
+	    row == (size_t)gr_draw->row_bytes) {
+		row *= h;
+		h = 1;
+	}
+
+	if (!gr_screen_draw && row >= BLIT_STREAM_MIN)
+		copy = gr_kernels->stream;
+	else
+		copy = gr_kernels->copy;
+
+	for (i = 0; i < h; i++) {
+		copy(dst_p, src_p, row);
+		src_p += source->row_bytes;
+		dst_p += gr_draw->row_bytes;
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+gr_blit_upright(GRSurface *source, int sx, int sy, int w, int h, int dx,
+		int dy)
+{
+	GRSurface area;
+
+	if (!source)
+		return;
+
+	if (!gr_rotation) {
+		gr_blit(source, sx, sy, w, h, dx, dy);
+		return;
+	}
+
+	if (gr_draw->pixel_bytes != source->pixel_bytes || source->rotation) {
+		printf("gr_blit_upright: source has wrong format\n");
+		return;
+	}
+
+	if (!clip_blit_rect(&sx, &sy, &w, &h, &dx, &dy))
+		return;
+
+	/* Rotate the area straight to the draw buffer */
+	area = *source;
+	area.data = pixel_at(source, sx, sy);
+	area.width = w;
+	area.height = h;
+
+	rotate_rect(draw_width(), draw_height(), w, h, &dx, &dy);
+	damage(dx, dy, rotated_w(w, h), rotated_h(w, h));
+	rotate_pixels(&area, pixel_at(gr_draw, dx, dy), gr_draw->row_bytes,
+		      gr_rotation);
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+gr_blend(GRSurface *a, GRSurface *b, int sx, int sy, int w, int h,
+	 int dx, int dy, unsigned char alpha)
+{
+	int i;
+	unsigned char *a_p, *b_p, *dst_p;
+
+	if (!a || !b)
+		return;
+
+	if (gr_draw->pixel_bytes != a->pixel_bytes ||
+	    a->pixel_bytes != b->pixel_bytes ||
+	    a->width != b->width || a->height != b->height) {
+		printf("gr_blend: sources have wrong format\n");
+		return;
+	}
+
+	if (gr_rotate_surface(a) || gr_rotate_surface(b))
+		return;
+
+	if (!blit_rect(a, &sx, &sy, &w, &h, &dx, &dy))
+		return;
+
+	a_p = pixel_at(a, sx, sy);
+	b_p = pixel_at(b, sx, sy);
+	dst_p = pixel_at(gr_draw, dx, dy);
+	damage(dx, dy, w, h);
+
+	for (i = 0; i < h; i++) {
+		gr_kernels->lerp(dst_p, a_p, b_p, w * a->pixel_bytes, alpha);
+		a_p += a->row_bytes;
+		b_p += b->row_bytes;
+		dst_p += gr_draw->row_bytes;
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+gr_blit_alpha(GRSurface *source, int sx, int sy, int w, int h, int dx,
+	      int dy, unsigned char alpha)
+{
+	int i;
+	unsigned char *src_p, *dst_p;
+
+	if (!source)
+		return;
+
+	/* Blending RGB565 bytewise is wrong, and opaque is closer than
+	 * nothing */
+	if (alpha == 255 || gr_draw->pixel_bytes != source->pixel_bytes) {
+		gr_blit(source, sx, sy, w, h, dx, dy);
+		return;
+	}
+
+	if (gr_rotate_surface(source))
+		return;
 
-	if (dx < 0) sx -= dx, w += dx, dx = 0;
-	if (dy < 0) sy -= dy, h += dy, dy = 0;
-	if (dx + w > gr_draw->width) w = gr_draw->width - dx;
-	if (dy + h > gr_draw->height) h = gr_draw->height - dy;
-	if (w <= 0 || h <= 0)
+	if (!blit_rect(source, &sx, &sy, &w, &h, &dx, &dy))
 		return;
 
-	src_p = source->data + sy * source->row_bytes +
-			       sx * source->pixel_bytes;
-	dst_p = gr_draw->data + dy * gr_draw->row_bytes +
-				dx * gr_draw->pixel_bytes;
+	src_p = pixel_at(source, sx, sy);
+	dst_p = pixel_at(gr_draw, dx, dy);
+	damage(dx, dy, w, h);
 
+	/* Each byte is read before it is written, dst can be a */
 	for (i = 0; i < h; i++) {
-		memcpy(dst_p, src_p, w * source->pixel_bytes);
+		gr_kernels->lerp(dst_p, dst_p, src_p, w * source->pixel_bytes,
+				 alpha);
 		src_p += source->row_bytes;
 		dst_p += gr_draw->row_bytes;
 	}
@@ -357,13 +963,125 @@ gr_blit(GRSurface *source, int sx, int sy, int w, int h, int dx, int dy)
 
 /* ------------------------------------------------------------------------ */
 
+void
+gr_scroll(int x1, int y1, int x2, int y2, int dy)
+{
+	int w = x2 - x1, h = y2 - y1 - dy;
+	int sx = x1, sy = y1 + dy, dx = x1, ty = y1;
+	int i, step, bytes;
+	unsigned char *src_p, *dst_p;
+
+	x1 += overscan_offset_x;
+	y1 += overscan_offset_y;
+	x2 += overscan_offset_x;
+	y2 += overscan_offset_y;
+
+	if (dy <= 0 || h <= 0 || outside(x1, y1) || outside(x2 - 1, y2 - 1))
+		return;
+
+	sx += overscan_offset_x, sy += overscan_offset_y;
+	dx += overscan_offset_x, ty += overscan_offset_y;
+
+	/* Up on screen is any direction in rotated data */
+	rotate_rect(draw_width(), draw_height(), w, h, &sx, &sy);
+	rotate_rect(draw_width(), draw_height(), w, h, &dx, &ty);
+	i = w;
+	w = rotated_w(w, h);
+	h = rotated_h(i, h);
+
+	bytes = w * gr_draw->pixel_bytes;
+	src_p = pixel_at(gr_draw, sx, sy);
+	dst_p = pixel_at(gr_draw, dx, ty);
+	step = gr_draw->row_bytes;
+
+	/* Copy rows in the order that does not overwrite unread ones */
+	if (ty > sy) {
+		src_p += (h - 1) * step;
+		dst_p += (h - 1) * step;
+		step = -step;
+	}
+
+	for (i = 0; i < h; i++) {
+		memmove(dst_p, src_p, bytes);
+		src_p += step;
+		dst_p += step;
+	}
+
+	damage(dx < sx ? dx : sx, ty < sy ? ty : sy,
+	       w + abs(dx - sx), h + abs(ty - sy));
+}
+
+/* ------------------------------------------------------------------------ */
+
+bool
+gr_diff_rect(GRSurface *a, GRSurface *b, GRRect *rect)
+{
+	int x, y, w, h, x1, y1, x2, y2, bytes;
+
+	if (gr_rotate_surface(a) || gr_rotate_surface(b))
+		return false;
+
+	if (a->pixel_bytes != b->pixel_bytes ||
+	    a->width != b->width || a->height != b->height)
+		return false;
+
+	bytes = a->width * a->pixel_bytes;
+	x1 = a->width, y1 = a->height, x2 = 0, y2 = 0;
+
+	for (y = 0; y < a->height; y++) {
+		const unsigned char *pa = pixel_at(a, 0, y);
+		const unsigned char *pb = pixel_at(b, 0, y);
+
+		/* Most rows of animation frames are usually equal */
+		if (!memcmp(pa, pb, bytes))
+			continue;
+
+		for (x = 0; x < x1; x++)
+			if (memcmp(pa + x * a->pixel_bytes,
+				   pb + x * a->pixel_bytes, a->pixel_bytes))
+				break;
+		x1 = x;
+
+		for (x = a->width; x > x2; x--)
+			if (memcmp(pa + (x - 1) * a->pixel_bytes,
+				   pb + (x - 1) * a->pixel_bytes, a->pixel_bytes))
+				break;
+		x2 = x;
+
+		if (y1 > y)
+			y1 = y;
+		y2 = y + 1;
+	}
+
+	if (x1 >= x2) {
+		rect->x1 = rect->y1 = rect->x2 = rect->y2 = 0;
+		return true;
+	}
+
+	/* Back from data orientation to the caller's */
+	w = x2 - x1, h = y2 - y1;
+	rotate_rect_by((360 - a->rotation) % 360, a->width, a->height,
+		       w, h, &x1, &y1);
+	if (a->rotation % 180)
+		x = w, w = h, h = x;
+
+	rect->x1 = x1;
+	rect->y1 = y1;
+	rect->x2 = x1 + w;
+	rect->y2 = y1 + h;
+
+	return true;
+}
+
+/* ------------------------------------------------------------------------ */
+
 unsigned int
 gr_get_width(GRSurface *surface)
 {
 	if (!surface)
 		return 0;
 
-	return surface->width;
+	return logical_width(surface, surface->rotation);
 }
 
 /* ------------------------------------------------------------------------ */
@@ -374,7 +1092,7 @@ gr_get_height(GRSurface *surface)
 	if (!surface)
 		return 0;
 
-	return surface->height;
+	return logical_height(surface, surface->rotation);
 }
 
 /* ------------------------------------------------------------------------ */
@@ -417,6 +1135,7 @@ gr_init_font(void)
 		gr_font->texture->height = font.height;
 		gr_font->texture->row_bytes = font.width;
 		gr_font->texture->pixel_bytes = 1;
+		gr_font->texture->rotation = 0;
 
 		/* TODO: Check for error */
 		bits = malloc(font.width * font.height);
@@ -434,10 +1153,215 @@ gr_init_font(void)
 
 /* ------------------------------------------------------------------------ */
 
+/* Copy all of src to the screen buffer dst of the same size, as one
+ * block if neither has padding at the ends of rows */
+static void
+copy_frame(GRSurface *dst, const GRSurface *src)
+{
+	size_t bytes = (size_t)src->width * src->pixel_bytes;
+	size_t size = bytes * src->height;
+	int y;
+
+	if (bytes == (size_t)src->row_bytes &&
+	    bytes == (size_t)dst->row_bytes) {
+		if (size >= BLIT_STREAM_MIN)
+			gr_kernels->stream(dst->data, src->data, size);
+		else
+			gr_kernels->copy(dst->data, src->data, size);
+		return;
+	}
+
+	for (y = 0; y < src->height; y++)
+		gr_kernels->copy(pixel_at(dst, 0, y), pixel_at(src, 0, y),
+				 bytes);
+}
+
+/* Show the undarkened copy darkened to the fade level */
+static void
+fade_flip(void)
+{
+	GRSurface *src = gr_fade_copy, *dst = gr_fade_screen;
+	size_t bytes = (size_t)src->width * src->pixel_bytes;
+	int y;
+
+	if (gr_fade_level == 255)
+		copy_frame(dst, src);
+	else
+		for (y = 0; y < src->height; y++)
+			gr_kernels->lerp(pixel_at(dst, 0, y), gr_fade_zeros,
+					 pixel_at(src, 0, y), (int)bytes,
+					 gr_fade_level);
+
+	gr_fade_screen = gr_backend->flip(gr_backend);
+	damage_reset();
+
+	/* Back at full level, the screen shows the copy as is. The new
+	 * draw buffer gets it too, so drawing can go on without it. */
+	if (gr_fade_level == 255) {
+		copy_frame(gr_fade_screen, src);
+		gr_draw = gr_fade_screen;
+		gr_fade_screen = NULL;
+		free(gr_fade_copy);
+		gr_fade_copy = NULL;
+		free(gr_fade_zeros);
+		gr_fade_zeros = NULL;
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
 void
 gr_flip(void)
 {
+	GRRect d = gr_damage, r = gr_stale;
+
+	/* Nothing drawn, nothing new to show */
+	if (gr_damage.x1 >= gr_damage.x2 || gr_damage.y1 >= gr_damage.y2)
+		return;
+
+	if (gr_fade_copy) {
+		fade_flip();
+		return;
+	}
+
+	rect_add(&r, d.x1, d.y1, d.x2, d.y2);
+	memset(&gr_damage, 0, sizeof(gr_damage));
+
+	/* Redraws of small areas often leave them as they were, like
+	 * progress steps that round to the same width. The screen then
+	 * shows the frame already, wherever else the draw buffer may be
+	 * stale. Large areas are flipped without comparing. */
+	if (gr_front && gr_front != gr_draw &&
+	    gr_front->width == gr_draw->width &&
+	    gr_front->height == gr_draw->height &&
+	    gr_front->row_bytes == gr_draw->row_bytes &&
+	    (long)(d.x2 - d.x1) * (d.y2 - d.y1) * DAMAGE_DIFF_MAX_DIVISOR <=
+	    (long)gr_draw->width * gr_draw->height &&
+	    !damage_diff(gr_draw, gr_front, &d))
+		return;
+
+	gr_front = gr_draw;
 	gr_draw = gr_backend->flip(gr_backend);
+
+	/* Buffers may differ where either was drawn to. A single buffer
+	 * is copied to screen and is then equal to it. */
+	memset(&gr_stale, 0, sizeof(gr_stale));
+	if (gr_draw != gr_front)
+		gr_stale = r;
+}
+
+gr_surface
+gr_draw_surface(void)
+{
+	/* Caller may write anything to it */
+	damage(0, 0, gr_draw->width, gr_draw->height);
+	if (gr_backend->access)
+		gr_backend->access(gr_backend, gr_draw);
+	return gr_draw;
+}
+
+/* ------------------------------------------------------------------------ */
+
+gr_surface
+gr_front_surface(void)
+{
+	/* While darkening, the undarkened frame is in the copy */
+	GRSurface *front = gr_fade_copy ? gr_fade_copy : gr_front;
+
+	if (front && gr_backend->access)
+		gr_backend->access(gr_backend, front);
+	return front;
+}
+
+/* ------------------------------------------------------------------------ */
+
+gr_surface
+gr_new_surface(int width, int height)
+{
+	GRSurface *surface;
+
+	if (width <= 0 || height <= 0)
+		return NULL;
+
+	surface = calloc(1, sizeof(*surface) + (size_t)width * height * 4);
+	if (!surface)
+		return NULL;
+
+	/* Data in the orientation of draw buffers, ready for blitting */
+	surface->width = rotated_w(width, height);
+	surface->height = rotated_h(width, height);
+	surface->row_bytes = surface->width * 4;
+	surface->pixel_bytes = 4;
+	surface->rotation = gr_rotation;
+	surface->data = (unsigned char *)(surface + 1);
+
+	return surface;
+}
+
+/* ------------------------------------------------------------------------ */
+
+gr_surface
+gr_copy_screen(void)
+{
+	GRSurface *front, *copy;
+	int y;
+
+	if (!gr_backend || !gr_backend->front)
+		return NULL;
+
+	if (!(front = gr_backend->front(gr_backend)))
+		return NULL;
+
+	if (front->pixel_bytes != 4 && front->pixel_bytes != 2)
+		return NULL;
+
+	copy = gr_new_surface(logical_width(front, gr_rotation),
+			      logical_height(front, gr_rotation));
+	if (!copy)
+		return NULL;
+
+	/* 16 bpp framebuffers are expanded to the 32 bpp of the copy */
+	for (y = 0; y < front->height; y++) {
+		if (front->pixel_bytes == 2)
+			unpack_rgb565(pixel_at(copy, 0, y),
+				      pixel_at(front, 0, y), copy->width);
+		else
+			memcpy(pixel_at(copy, 0, y), pixel_at(front, 0, y),
+			       copy->row_bytes);
+	}
+
+	return copy;
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+gr_set_draw_surface(gr_surface surface)
+{
+	if (!surface) {
+		if (gr_screen_draw) {
+			gr_draw = gr_screen_draw;
+			gr_screen_draw = NULL;
+			overscan_offset_x = gr_screen_offset_x;
+			overscan_offset_y = gr_screen_offset_y;
+		}
+		return 0;
+	}
+
+	if (surface->pixel_bytes != 4 || surface->rotation != gr_rotation) {
+		printf("gr_set_draw_surface: surface has wrong format\n");
+		return -1;
+	}
+
+	if (!gr_screen_draw) {
+		gr_screen_draw = gr_draw;
+		gr_screen_offset_x = overscan_offset_x;
+		gr_screen_offset_y = overscan_offset_y;
+		overscan_offset_x = overscan_offset_y = 0;
+	}
+	gr_draw = surface;
+
+	return 0;
 }
 
 /* ------------------------------------------------------------------------ */
@@ -447,9 +1371,18 @@ static int gr_init_fbdev(bool blank)
 	gr_backend = open_fbdev();
 	gr_draw = gr_backend->init(gr_backend, blank);
 	if (gr_draw)
-		gr_flip();
+		gr_draw = gr_backend->flip(gr_backend);
 	if (gr_draw)
-		gr_flip();
+		gr_draw = gr_backend->flip(gr_backend);
+	if (!gr_draw)
+		gr_backend->exit(gr_backend);
+	return gr_draw ? 0 : -1;
+}
+
+static int gr_init_virtual(bool blank)
+{
+	gr_backend = open_virtual();
+	gr_draw = gr_backend->init(gr_backend, blank);
 	if (!gr_draw)
 		gr_backend->exit(gr_backend);
 	return gr_draw ? 0 : -1;
@@ -473,9 +1406,9 @@ static int gr_init_drm(bool blank)
 	for (int failures = 0;;) {
 		gr_draw = gr_backend->init(gr_backend, blank);
 		if (gr_draw)
-			gr_flip();
+			gr_draw = gr_backend->flip(gr_backend);
 		if (gr_draw)
-			gr_flip();
+			gr_draw = gr_backend->flip(gr_backend);
 		if (gr_draw)
 			break;
 		gr_backend->exit(gr_backend);
@@ -486,11 +1419,65 @@ static int gr_init_drm(bool blank)
 	}
 	return gr_draw ? 0 : -1;
 }
+
+/* ------------------------------------------------------------------------ */
+
+void
+gr_set_render_scale(int percent)
+{
+	if (percent < 10)
+		percent = 10;
+	else if (percent > 100)
+		percent = 100;
+
+	gr_settings.render_scale = percent;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+gr_set_rotation(int degrees)
+{
+	degrees = (degrees % 360 + 360) % 360;
+
+	if (degrees % 90) {
+		printf("gr_set_rotation: unsupported rotation %d\n", degrees);
+		return;
+	}
+
+	gr_settings.rotation = degrees;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+gr_set_max_fps(int fps)
+{
+	gr_settings.max_fps = fps > 0 ? fps : 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+gr_set_mirror(bool mirror)
+{
+	gr_settings.mirror = mirror;
+}
+
+/* ------------------------------------------------------------------------ */
+
 int
 gr_init(bool blank)
 {
 	gr_init_font();
 
+	/* Simulated display leaves the real one alone */
+	if (getenv("YAMUI_VIRTUAL")) {
+		if (gr_init_virtual(blank) != 0)
+			return -1;
+		goto initialized;
+	}
+
 	if ((gr_vt_fd = open("/dev/tty0", O_RDWR | O_SYNC)) < 0) {
 		/* This is non-fatal; post-Cupcake kernels don't have tty0. */
 		perror("can't open /dev/tty0");
@@ -505,8 +1492,15 @@ gr_init(bool blank)
 	if (gr_init_fbdev(blank) != 0 && gr_init_drm(blank) != 0)
 		return -1;
 
-	overscan_offset_x = gr_draw->width  * overscan_percent / 100;
-	overscan_offset_y = gr_draw->height * overscan_percent / 100;
+initialized:
+
+	damage_reset();
+
+	gr_rotation = gr_settings.hw_rotation ? 0 : gr_settings.rotation;
+	gr_rotate_surface(gr_font->texture);
+
+	overscan_offset_x = draw_width()  * overscan_percent / 100;
+	overscan_offset_y = draw_height() * overscan_percent / 100;
 
 	return 0;
 }
@@ -520,6 +1514,14 @@ gr_exit(void)
 		gr_backend->exit(gr_backend);
 		gr_backend = NULL;
 	}
+	gr_overlay_shown = false;
+
+	free(gr_fade_copy);
+	gr_fade_copy = NULL;
+	free(gr_fade_zeros);
+	gr_fade_zeros = NULL;
+	gr_fade_screen = NULL;
+	gr_fade_level = 255;
 
 	if (gr_vt_fd != -1) {
 		ioctl(gr_vt_fd, KDSETMODE, (void *)KD_TEXT);
@@ -530,10 +1532,20 @@ gr_exit(void)
 
 /* ------------------------------------------------------------------------ */
 
+int
+gr_handover(void)
+{
+	if (!gr_backend || !gr_backend->handover)
+		return 0;
+	return gr_backend->handover(gr_backend);
+}
+
+/* ------------------------------------------------------------------------ */
+
 int
 gr_fb_width(void)
 {
-	return gr_draw->width - 2 * overscan_offset_x;
+	return draw_width() - 2 * overscan_offset_x;
 }
 
 /* ------------------------------------------------------------------------ */
@@ -541,7 +1553,7 @@ gr_fb_width(void)
 int
 gr_fb_height(void)
 {
-	return gr_draw->height - 2 * overscan_offset_y;
+	return draw_height() - 2 * overscan_offset_y;
 }
 
 /* ------------------------------------------------------------------------ */
@@ -554,6 +1566,182 @@ gr_fb_blank(bool blank)
 
 /* ------------------------------------------------------------------------ */
 
+int
+gr_overlay(GRSurface *source, int dx, int dy)
+{
+	if (!gr_backend || !gr_backend->overlay)
+		return -1;
+
+	if (source && gr_draw->pixel_bytes != source->pixel_bytes)
+		return -1;
+
+	if (source && gr_rotate_surface(source))
+		return -1;
+
+	dx += overscan_offset_x;
+	dy += overscan_offset_y;
+
+	if (source)
+		rotate_rect(draw_width(), draw_height(),
+			    gr_get_width(source), gr_get_height(source),
+			    &dx, &dy);
+
+	if (gr_backend->overlay(gr_backend, source, dx, dy))
+		return -1;
+
+	gr_overlay_shown = source != NULL;
+	return 0;
+}
+
+bool
+gr_has_overlay(void)
+{
+	return gr_overlay_shown;
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+gr_fade(int level)
+{
+	if (!gr_backend || !gr_backend->fade)
+		return -1;
+
+	if (level < 0)
+		level = 0;
+	else if (level > 255)
+		level = 255;
+
+	return gr_backend->fade(gr_backend, level);
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+gr_darken(int level)
+{
+	GRSurface *copy, *from;
+	int y;
+
+	if (!gr_backend || gr_screen_draw)
+		return -1;
+
+	if (level < 0)
+		level = 0;
+	else if (level > 255)
+		level = 255;
+
+	if (level < 255 && !gr_fade_copy) {
+		if (gr_draw->pixel_bytes != 4)
+			return -1;
+
+		copy = gr_new_surface(draw_width(), draw_height());
+		gr_fade_zeros = calloc(1, copy ? copy->row_bytes : 1);
+		if (!copy || !gr_fade_zeros) {
+			free(copy);
+			free(gr_fade_zeros);
+			gr_fade_zeros = NULL;
+			return -1;
+		}
+
+		/* Start from what is on screen, the draw buffer may be a
+		 * frame behind */
+		from = gr_backend->front ? gr_backend->front(gr_backend) : NULL;
+		if (!from || from->width != gr_draw->width ||
+		    from->height != gr_draw->height ||
+		    from->pixel_bytes != gr_draw->pixel_bytes)
+			from = gr_draw;
+		for (y = 0; y < copy->height; y++)
+			memcpy(pixel_at(copy, 0, y), pixel_at(from, 0, y),
+			       copy->row_bytes);
+
+		gr_fade_screen = gr_draw;
+		gr_fade_copy = gr_draw = copy;
+	}
+
+	/* Shown by the next flip, also when going back to full level */
+	if (gr_fade_copy && level != gr_fade_level)
+		damage(0, 0, gr_draw->width, gr_draw->height);
+	gr_fade_level = level;
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+gr_show_buffer(int fd, int width, int height, int stride, unsigned int format)
+{
+	struct dma_buf_sync sync = { 0 };
+	GRSurface buffer;
+	size_t size;
+	off_t fd_size;
+	void *map;
+
+	if (width != gr_fb_width() || height != gr_fb_height() ||
+	    stride < width * 4)
+		return -1;
+
+	if (format != FORMAT_XBGR8888 && format != FORMAT_ABGR8888)
+		return -1;
+
+	/* Reading past the end of a short memfd would raise SIGBUS.
+	 * Seeking tells the size of dma-bufs too, fstat() does not. */
+	size = (size_t)stride * height;
+	fd_size = lseek(fd, 0, SEEK_END);
+	if (fd_size < 0 || (size_t)fd_size < size)
+		return -1;
+
+	if (gr_backend->scanout &&
+	    !gr_backend->scanout(gr_backend, fd, width, height, stride, format)) {
+		damage_reset();
+		return 0;
+	}
+
+	/* Copied as is, the draw buffer has to be of the same format */
+	if (gr_draw->pixel_bytes != 4)
+		return -1;
+
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("gr_show_buffer: mmap");
+		return -1;
+	}
+
+	/* Needed for dma-bufs only, fails harmlessly for memfds */
+	sync.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ;
+	ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+
+	buffer.width = width;
+	buffer.height = height;
+	buffer.row_bytes = stride;
+	buffer.pixel_bytes = 4;
+	buffer.rotation = 0;
+	buffer.data = map;
+
+	/* The only copy, rotated on the way if needed */
+	if (gr_rotation) {
+		int x = overscan_offset_x, y = overscan_offset_y;
+
+		rotate_rect(draw_width(), draw_height(), width, height, &x, &y);
+		rotate_pixels(&buffer, pixel_at(gr_draw, x, y),
+			      gr_draw->row_bytes, gr_rotation);
+		damage(x, y, rotated_w(width, height),
+		       rotated_h(width, height));
+	} else {
+		gr_blit(&buffer, 0, 0, width, height, 0, 0);
+	}
+
+	sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ;
+	ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+	munmap(map, size);
+
+	gr_flip();
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
 /* Save screen content to internal buffer. */
 void
 gr_save(void)
@@ -570,4 +1758,5 @@ gr_restore(void)
 {
 	if (gr_backend->restore)
 		gr_backend->restore(gr_backend);
+	damage_reset();
 }
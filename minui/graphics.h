@@ -45,11 +45,57 @@ typedef struct minui_backend {
 
 	/* Restore screen content from internal buffer. */
 	void (*restore)(struct minui_backend *backend);
+
+	/* Show a copy of source at (dx, dy) on a hardware plane above the
+	 * drawing surface, or remove it if source is NULL. Returns 0 on
+	 * success, -1 if there is no suitable plane. */
+	int (*overlay)(struct minui_backend *backend, gr_surface source,
+		       int dx, int dy);
+
+	/* Scale display brightness to level (0 - 255) with the color
+	 * lookup table. Returns 0 on success, -1 if not supported. */
+	int (*fade)(struct minui_backend *backend, int level);
+
+	/* Display buffer fd of another process directly, without copying.
+	 * Stays on screen until the next flip(). Returns 0 on success, -1
+	 * if the buffer can't be scanned out. */
+	int (*scanout)(struct minui_backend *backend, int fd, int width,
+		       int height, int stride, unsigned int format);
+
+	/* Returns the surface being displayed, or NULL if its content is
+	 * not in drawing surface format or not accessible. */
+	gr_surface (*front)(struct minui_backend *backend);
+
+	/* Leave the display ready to be taken over by another program
+	 * without exit(), in the mode it would set up by default. Returns
+	 * 0 on success, -1 if the mode couldn't be restored. */
+	int (*handover)(struct minui_backend *backend);
+
+	/* Make all of surface accessible to system calls, before it is
+	 * given to the caller of gr_draw_surface() or gr_front_surface(). */
+	void (*access)(struct minui_backend *backend, gr_surface surface);
 } minui_backend;
 
+/* Display settings made with gr_set_*() functions before gr_init(),
+ * applied by the backends in init(). */
+typedef struct {
+	int render_scale; /* drawing surface size, percent of display mode */
+	int rotation;     /* degrees clockwise */
+	bool hw_rotation; /* set by init() if the display does the rotation */
+	int max_fps;      /* highest frame rate drawn, 0 if not known */
+	bool mirror;      /* show the same content on all connected displays */
+} GRSettings;
+
+extern GRSettings gr_settings;
+
+/* Rotate surface data in place to match the display, if rotation is
+ * done in software. Returns 0 on success, -1 on allocation failure. */
+int gr_rotate_surface(gr_surface surface);
+
 minui_backend *open_fbdev(void);
 minui_backend *open_adf(void);
 minui_backend *open_drm(void);
+minui_backend *open_virtual(void);
 
 #ifdef __cplusplus
 }
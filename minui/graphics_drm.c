@@ -35,7 +35,22 @@
 #ifndef DRM_MODE_CONNECTOR_DSI
 #define DRM_MODE_CONNECTOR_DSI 16
 #endif
+#ifndef DRM_MODE_ROTATE_0
+#define DRM_MODE_ROTATE_0   (1<<0)
+#define DRM_MODE_ROTATE_90  (1<<1)
+#define DRM_MODE_ROTATE_180 (1<<2)
+#define DRM_MODE_ROTATE_270 (1<<3)
+#endif
 #define RECOVERY_RGBX 1
+#if defined(RECOVERY_ABGR)
+#define DRM_SURFACE_FORMAT DRM_FORMAT_RGBA8888
+#elif defined(RECOVERY_BGRA)
+#define DRM_SURFACE_FORMAT DRM_FORMAT_ARGB8888
+#elif defined(RECOVERY_RGBX)
+#define DRM_SURFACE_FORMAT DRM_FORMAT_XBGR8888
+#else
+#define DRM_SURFACE_FORMAT DRM_FORMAT_RGB565
+#endif
 
 struct drm_surface {
     GRSurface base;
@@ -45,8 +60,37 @@ struct drm_surface {
 static struct drm_surface *drm_surfaces[2];
 static int current_buffer;
 static drmModeCrtc *main_monitor_crtc;
+static int main_monitor_crtc_index;
 static drmModeConnector *main_monitor_connector;
+/* Connector's preferred mode, if a slower one is used instead */
+static drmModeModeInfo *preferred_mode;
 static int drm_fd = -1;
+/* Primary plane used for scaling up reduced resolution rendering
+ * and for rotating the drawing buffer */
+static uint32_t primary_plane_id;
+static uint32_t rotation_prop_id;
+/* Connector DPMS property, for blanking without losing the modeset */
+static uint32_t dpms_prop_id;
+static bool dpms_blanked;
+/* Static content shown on an overlay plane, see drm_overlay() */
+static struct drm_surface *overlay_surface;
+static uint32_t overlay_plane_id;
+static int overlay_x, overlay_y;
+/* Buffer of another process being scanned out, see drm_scanout() */
+static struct drm_surface *external_surface;
+
+/* Other connected displays showing the same buffers */
+#define MIRRORS_MAX 3
+struct drm_mirror {
+    drmModeConnector *connector;
+    drmModeCrtc *crtc;
+    int crtc_index;
+    uint32_t plane_id; /* primary plane scaling buffers to the mode, or 0 */
+};
+static struct drm_mirror mirrors[MIRRORS_MAX];
+static int mirror_count;
+/* Original gamma ramps followed by the faded ones, see drm_fade() */
+static uint16_t *gamma_lut;
 static void drm_disable_crtc(int drm_fd, drmModeCrtc *crtc) {
     if (crtc) {
         drmModeSetCrtc(drm_fd, crtc->crtc_id,
@@ -57,26 +101,149 @@ static void drm_disable_crtc(int drm_fd, drmModeCrtc *crtc) {
                        NULL);
     }
 }
-static void drm_enable_crtc(int drm_fd, drmModeCrtc *crtc,
-                            struct drm_surface *surface) {
-    int32_t ret;
-    ret = drmModeSetCrtc(drm_fd, crtc->crtc_id,
-                         surface->fb_id,
-                         0, 0,
-                         &main_monitor_connector->connector_id,
-                         1,
-                         &main_monitor_crtc->mode);
+static struct drm_surface *drm_create_surface(int width, int height);
+static void drm_destroy_surface(struct drm_surface *surface);
+static void show_mirrors(struct drm_surface *surface, bool modeset);
+static void disable_mirrors(void);
+/* Plane rotation is counter-clockwise, gr_settings.rotation clockwise */
+static uint64_t drm_rotation(void) {
+    switch (gr_settings.rotation) {
+    case 90:
+        return DRM_MODE_ROTATE_270;
+    case 180:
+        return DRM_MODE_ROTATE_180;
+    case 270:
+        return DRM_MODE_ROTATE_90;
+    default:
+        return DRM_MODE_ROTATE_0;
+    }
+}
+static int drm_set_rotation(uint64_t rotation) {
+    int ret;
+    ret = drmModeObjectSetProperty(drm_fd, primary_plane_id,
+                                   DRM_MODE_OBJECT_PLANE,
+                                   rotation_prop_id, rotation);
     if (ret)
-        printf("drmModeSetCrtc failed ret=%d\n", ret);
+        printf("setting plane rotation failed ret=%d\n", ret);
+    return ret;
+}
+/* True if crtc is already scanning out in its mode, so that the primary
+ * plane can take another buffer without a modeset */
+static bool drm_crtc_is_set(int drm_fd, drmModeCrtc *crtc) {
+    drmModeCrtc *current = drmModeGetCrtc(drm_fd, crtc->crtc_id);
+    bool set = current && current->buffer_id && current->mode_valid &&
+            current->mode.clock == crtc->mode.clock &&
+            current->mode.hdisplay == crtc->mode.hdisplay &&
+            current->mode.vdisplay == crtc->mode.vdisplay &&
+            current->mode.vrefresh == crtc->mode.vrefresh &&
+            current->mode.flags == crtc->mode.flags;
+    if (current)
+        drmModeFreeCrtc(current);
+    return set;
+}
+static int drm_enable_crtc(int drm_fd, drmModeCrtc *crtc,
+                           struct drm_surface *surface) {
+    struct drm_surface *modeset_surface = surface;
+    int32_t ret = 0;
+    /* A mode can be set only with an unrotated buffer that covers all
+     * of it. With reduced resolution rendering or rotation, use a
+     * temporary one for that and then let the primary plane scale up
+     * and rotate the real buffer. Not needed if the mode is set
+     * already. */
+    if (primary_plane_id && drm_crtc_is_set(drm_fd, crtc))
+        modeset_surface = NULL;
+    else if (primary_plane_id) {
+        modeset_surface = drm_create_surface(crtc->mode.hdisplay,
+                                             crtc->mode.vdisplay);
+        if (!modeset_surface)
+            return -1;
+    }
+    if (modeset_surface) {
+        if (rotation_prop_id && drm_set_rotation(DRM_MODE_ROTATE_0)) {
+            if (modeset_surface != surface)
+                drm_destroy_surface(modeset_surface);
+            return -1;
+        }
+        ret = drmModeSetCrtc(drm_fd, crtc->crtc_id,
+                             modeset_surface->fb_id,
+                             0, 0,
+                             &main_monitor_connector->connector_id,
+                             1,
+                             &main_monitor_crtc->mode);
+        if (ret)
+            printf("drmModeSetCrtc failed ret=%d\n", ret);
+    }
+    if (primary_plane_id) {
+        if (!ret && rotation_prop_id)
+            ret = drm_set_rotation(drm_rotation());
+        if (!ret) {
+            ret = drmModeSetPlane(drm_fd, primary_plane_id, crtc->crtc_id,
+                                  surface->fb_id, 0,
+                                  0, 0,
+                                  crtc->mode.hdisplay, crtc->mode.vdisplay,
+                                  0, 0,
+                                  surface->base.width << 16,
+                                  surface->base.height << 16);
+            if (ret)
+                printf("drmModeSetPlane on primary failed ret=%d\n", ret);
+        }
+        drm_destroy_surface(modeset_surface);
+    }
+    return ret;
+}
+/* Turn the panel off and on keeping crtc, planes and buffers as they
+ * are, so that unblanking needs no modeset */
+static int drm_set_dpms(bool on) {
+    int ret;
+    if (!dpms_prop_id)
+        return -1;
+    ret = drmModeObjectSetProperty(drm_fd,
+                                   main_monitor_connector->connector_id,
+                                   DRM_MODE_OBJECT_CONNECTOR, dpms_prop_id,
+                                   on ? DRM_MODE_DPMS_ON : DRM_MODE_DPMS_OFF);
+    if (ret)
+        printf("setting DPMS failed ret=%d\n", ret);
+    return ret;
+}
+static int drm_show_overlay(void) {
+    int w = overlay_surface->base.width;
+    int h = overlay_surface->base.height;
+    /* Overlay position is in drawing surface coordinates */
+    int mode_w = main_monitor_crtc->mode.hdisplay;
+    int mode_h = main_monitor_crtc->mode.vdisplay;
+    int fb_w = drm_surfaces[0]->base.width;
+    int fb_h = drm_surfaces[0]->base.height;
+    int ret;
+    ret = drmModeSetPlane(drm_fd, overlay_plane_id,
+                          main_monitor_crtc->crtc_id,
+                          overlay_surface->fb_id, 0,
+                          overlay_x * mode_w / fb_w,
+                          overlay_y * mode_h / fb_h,
+                          w * mode_w / fb_w, h * mode_h / fb_h,
+                          0, 0, w << 16, h << 16);
+    if (ret)
+        printf("drmModeSetPlane failed ret=%d\n", ret);
+    return ret;
 }
 static void drm_blank(minui_backend* backend __unused, bool blank) {
     (void)backend;
 
-    if (blank)
-        drm_disable_crtc(drm_fd, main_monitor_crtc);
-    else
-        drm_enable_crtc(drm_fd, main_monitor_crtc,
-                        drm_surfaces[current_buffer]);
+    if (blank) {
+        dpms_blanked = !drm_set_dpms(false);
+        if (!dpms_blanked)
+            drm_disable_crtc(drm_fd, main_monitor_crtc);
+        disable_mirrors();
+    } else {
+        /* Show what was on screen, current_buffer is drawn to */
+        if (!dpms_blanked || drm_set_dpms(true))
+            drm_enable_crtc(drm_fd, main_monitor_crtc,
+                            drm_surfaces[1 - current_buffer]);
+        dpms_blanked = false;
+        /* Planes are detached when the crtc gets disabled */
+        if (overlay_surface)
+            drm_show_overlay();
+        show_mirrors(drm_surfaces[1 - current_buffer], true);
+    }
 }
 static void drm_destroy_surface(struct drm_surface *surface) {
     struct drm_gem_close gem_close;
@@ -119,22 +286,13 @@ static int drm_format_to_bpp(uint32_t format) {
 static struct drm_surface *drm_create_surface(int width, int height) {
     struct drm_surface *surface;
     struct drm_mode_create_dumb create_dumb;
-    uint32_t format;
+    uint32_t format = DRM_SURFACE_FORMAT;
     int ret;
     surface = (struct drm_surface*)calloc(1, sizeof(*surface));
     if (!surface) {
         printf("Can't allocate memory\n");
         return NULL;
     }
-#if defined(RECOVERY_ABGR)
-    format = DRM_FORMAT_RGBA8888;
-#elif defined(RECOVERY_BGRA)
-    format = DRM_FORMAT_ARGB8888;
-#elif defined(RECOVERY_RGBX)
-    format = DRM_FORMAT_XBGR8888;
-#else
-    format = DRM_FORMAT_RGB565;
-#endif
     memset(&create_dumb, 0, sizeof(create_dumb));
     create_dumb.height = height;
     create_dumb.width = width;
@@ -188,6 +346,65 @@ static struct drm_surface *drm_create_surface(int width, int height) {
     }
     return surface;
 }
+static int drm_get_property(int fd, uint32_t object_id, uint32_t object_type,
+                            const char *name, uint32_t *prop_id,
+                            uint64_t *value) {
+    drmModeObjectProperties *props;
+    uint32_t i;
+    int ret = -1;
+    props = drmModeObjectGetProperties(fd, object_id, object_type);
+    if (!props)
+        return -1;
+    for (i = 0; i < props->count_props && ret; i++) {
+        drmModePropertyRes *prop = drmModeGetProperty(fd, props->props[i]);
+        if (!prop)
+            continue;
+        if (!strcmp(prop->name, name)) {
+            if (prop_id)
+                *prop_id = prop->prop_id;
+            if (value)
+                *value = props->prop_values[i];
+            ret = 0;
+        }
+        drmModeFreeProperty(prop);
+    }
+    drmModeFreeObjectProperties(props);
+    return ret;
+}
+/*
+ * Find an unused plane of given type that can show the given format
+ * on the crtc with index crtc_index.
+ */
+static uint32_t drm_find_plane(int fd, int crtc_index, uint32_t crtc_id,
+                               uint64_t type, uint32_t format) {
+    drmModePlaneRes *planes;
+    uint32_t i, j, plane_id = 0;
+    planes = drmModeGetPlaneResources(fd);
+    if (!planes)
+        return 0;
+    for (i = 0; i < planes->count_planes && !plane_id; i++) {
+        drmModePlane *plane = drmModeGetPlane(fd, planes->planes[i]);
+        uint64_t plane_type = DRM_PLANE_TYPE_OVERLAY;
+        if (!plane)
+            continue;
+        drm_get_property(fd, plane->plane_id, DRM_MODE_OBJECT_PLANE,
+                         "type", NULL, &plane_type);
+        if (plane_type == type &&
+                (plane->possible_crtcs & (1u << crtc_index)) &&
+                (!plane->crtc_id ||
+                 plane->crtc_id == crtc_id)) {
+            for (j = 0; j < plane->count_formats; j++) {
+                if (plane->formats[j] == format) {
+                    plane_id = plane->plane_id;
+                    break;
+                }
+            }
+        }
+        drmModeFreePlane(plane);
+    }
+    drmModeFreePlaneResources(planes);
+    return plane_id;
+}
 static drmModeCrtc *find_crtc_for_connector(int fd,
                             drmModeRes *resources,
                             drmModeConnector *connector) {
@@ -293,26 +510,243 @@ static drmModeConnector *find_main_monitor(int fd, drmModeRes *resources,
     }
     return main_monitor_connector;
 }
+/* Find the lowest refresh rate mode of the same size as the preferred
+ * one that can still show gr_settings.max_fps frames per second. */
+static uint32_t find_slow_mode(drmModeConnector *connector,
+                               uint32_t mode_index) {
+    drmModeModeInfo *preferred = &connector->modes[mode_index];
+    uint32_t selected = mode_index;
+    int i;
+    if (!gr_settings.max_fps)
+        return mode_index;
+    for (i = 0; i < connector->count_modes; i++) {
+        drmModeModeInfo *mode = &connector->modes[i];
+        if (mode->hdisplay != preferred->hdisplay ||
+                mode->vdisplay != preferred->vdisplay ||
+                (mode->flags & (DRM_MODE_FLAG_INTERLACE |
+                                DRM_MODE_FLAG_DBLSCAN)))
+            continue;
+        if (mode->vrefresh >= (uint32_t)gr_settings.max_fps &&
+                mode->vrefresh < connector->modes[selected].vrefresh)
+            selected = i;
+    }
+    if (selected != mode_index)
+        printf("using %uHz mode instead of %uHz for %d fps\n",
+               connector->modes[selected].vrefresh, preferred->vrefresh,
+               gr_settings.max_fps);
+    return selected;
+}
+static int find_crtc_index(drmModeRes *resources, uint32_t crtc_id) {
+    int i;
+    for (i = 0; i < resources->count_crtcs; i++)
+        if (resources->crtcs[i] == crtc_id)
+            return i;
+    return -1;
+}
+/*
+ * Find a crtc for a mirror that is not in used_crtcs, preferring the
+ * one already driving the connector.
+ */
+static drmModeCrtc *find_mirror_crtc(int fd, drmModeRes *resources,
+                                     drmModeConnector *connector,
+                                     uint32_t used_crtcs) {
+    drmModeEncoder *encoder;
+    int i, j;
+    if (connector->encoder_id) {
+        encoder = drmModeGetEncoder(fd, connector->encoder_id);
+        if (encoder) {
+            j = encoder->crtc_id ?
+                find_crtc_index(resources, encoder->crtc_id) : -1;
+            drmModeFreeEncoder(encoder);
+            if (j >= 0 && !(used_crtcs & (1u << j)))
+                return drmModeGetCrtc(fd, resources->crtcs[j]);
+        }
+    }
+    for (i = 0; i < connector->count_encoders; i++) {
+        encoder = drmModeGetEncoder(fd, connector->encoders[i]);
+        if (!encoder)
+            continue;
+        for (j = 0; j < resources->count_crtcs; j++) {
+            if ((encoder->possible_crtcs & (1u << j)) &&
+                    !(used_crtcs & (1u << j))) {
+                drmModeFreeEncoder(encoder);
+                return drmModeGetCrtc(fd, resources->crtcs[j]);
+            }
+        }
+        drmModeFreeEncoder(encoder);
+    }
+    return NULL;
+}
+/*
+ * Keep other connected displays as mirrors if gr_settings.mirror is
+ * set, and turn off the rest.
+ */
 static void disable_non_main_crtcs(int fd,
                     drmModeRes *resources,
                     drmModeCrtc* main_crtc) {
+    uint32_t used_crtcs = 1u << main_monitor_crtc_index;
     int i;
     drmModeCrtc* crtc;
+    mirror_count = 0;
     for (i = 0; i < resources->count_connectors; i++) {
         drmModeConnector *connector;
         connector = drmModeGetConnector(fd, resources->connectors[i]);
+        if (!connector)
+            continue;
+        if (gr_settings.mirror && mirror_count < MIRRORS_MAX &&
+                connector->connector_id !=
+                    main_monitor_connector->connector_id &&
+                connector->connection == DRM_MODE_CONNECTED &&
+                connector->count_modes > 0) {
+            crtc = find_mirror_crtc(fd, resources, connector, used_crtcs);
+            if (crtc) {
+                struct drm_mirror *mirror = &mirrors[mirror_count++];
+                mirror->connector = connector;
+                mirror->crtc = crtc;
+                mirror->crtc_index = find_crtc_index(resources,
+                                                     crtc->crtc_id);
+                mirror->plane_id = 0;
+                used_crtcs |= 1u << mirror->crtc_index;
+                continue;
+            }
+        }
         crtc = find_crtc_for_connector(fd, resources, connector);
-        if (crtc->crtc_id != main_crtc->crtc_id)
+        if (crtc && crtc->crtc_id != main_crtc->crtc_id &&
+                !(used_crtcs & (1u << find_crtc_index(resources,
+                                                      crtc->crtc_id))))
             drm_disable_crtc(fd, crtc);
         drmModeFreeCrtc(crtc);
+        drmModeFreeConnector(connector);
     }
 }
+/*
+ * Show surface on a mirror. Buffers of the mode size are scanned out
+ * directly, others are scaled to fit by the primary plane. With
+ * modeset the crtc is (re)enabled, otherwise the buffer is flipped.
+ */
+static int drm_show_mirror(struct drm_mirror *mirror,
+                           struct drm_surface *surface, bool modeset) {
+    struct drm_surface *modeset_surface = surface;
+    int mode_w = mirror->crtc->mode.hdisplay;
+    int mode_h = mirror->crtc->mode.vdisplay;
+    int w = surface->base.width;
+    int h = surface->base.height;
+    int dw = mode_w, dh = mode_h;
+    int ret = 0;
+    if (!mirror->plane_id && !modeset) {
+        ret = drmModePageFlip(drm_fd, mirror->crtc->crtc_id,
+                              surface->fb_id, 0, NULL);
+        if (ret)
+            printf("drmModePageFlip on mirror failed ret=%d\n", ret);
+        return ret;
+    }
+    if (modeset) {
+        if (mirror->plane_id) {
+            modeset_surface = drm_create_surface(mode_w, mode_h);
+            if (!modeset_surface)
+                return -1;
+        }
+        ret = drmModeSetCrtc(drm_fd, mirror->crtc->crtc_id,
+                             modeset_surface->fb_id, 0, 0,
+                             &mirror->connector->connector_id, 1,
+                             &mirror->crtc->mode);
+        if (ret)
+            printf("drmModeSetCrtc on mirror failed ret=%d\n", ret);
+    }
+    if (!ret && mirror->plane_id) {
+        /* Keep aspect ratio, the rest of the mode stays black */
+        if ((int64_t)w * mode_h > (int64_t)h * mode_w)
+            dh = (int64_t)h * mode_w / w;
+        else
+            dw = (int64_t)w * mode_h / h;
+        ret = drmModeSetPlane(drm_fd, mirror->plane_id,
+                              mirror->crtc->crtc_id, surface->fb_id, 0,
+                              (mode_w - dw) / 2, (mode_h - dh) / 2, dw, dh,
+                              0, 0, w << 16, h << 16);
+        if (ret)
+            printf("drmModeSetPlane on mirror failed ret=%d\n", ret);
+    }
+    if (modeset_surface != surface)
+        drm_destroy_surface(modeset_surface);
+    return ret;
+}
+static void drm_free_mirror(struct drm_mirror *mirror) {
+    drmModeFreeCrtc(mirror->crtc);
+    drmModeFreeConnector(mirror->connector);
+    *mirror = mirrors[--mirror_count];
+}
+/*
+ * Pick modes for the mirrors and start showing surface on them. A
+ * mode of the surface size lets the buffers be shared as they are.
+ */
+static void enable_mirrors(struct drm_surface *surface) {
+    int i, m;
+    for (m = 0; m < mirror_count; m++) {
+        struct drm_mirror *mirror = &mirrors[m];
+        drmModeConnector *connector = mirror->connector;
+        int selected = -1, preferred = 0;
+        for (i = 0; i < connector->count_modes; i++) {
+            drmModeModeInfo *mode = &connector->modes[i];
+            if (mode->type & DRM_MODE_TYPE_PREFERRED)
+                preferred = i;
+            if (selected < 0 && mode->hdisplay == surface->base.width &&
+                    mode->vdisplay == surface->base.height &&
+                    !(mode->flags & (DRM_MODE_FLAG_INTERLACE |
+                                     DRM_MODE_FLAG_DBLSCAN)))
+                selected = i;
+        }
+        mirror->plane_id = 0;
+        if (selected < 0) {
+            drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+            mirror->plane_id = drm_find_plane(drm_fd, mirror->crtc_index,
+                                              mirror->crtc->crtc_id,
+                                              DRM_PLANE_TYPE_PRIMARY,
+                                              DRM_SURFACE_FORMAT);
+            if (mirror->plane_id)
+                selected = preferred;
+        }
+        if (selected >= 0)
+            mirror->crtc->mode = connector->modes[selected];
+        if (selected < 0 || drm_show_mirror(mirror, surface, true)) {
+            printf("can't mirror to connector %u\n",
+                   connector->connector_id);
+            drm_disable_crtc(drm_fd, mirror->crtc);
+            drm_free_mirror(mirror);
+            m--;
+        }
+    }
+}
+/*
+ * Show surface on every mirror. A mirror that can't take the buffer
+ * would keep scanning out the one drawn to next and tear, so it is set
+ * up again, and turned off if even that fails.
+ */
+static void show_mirrors(struct drm_surface *surface, bool modeset) {
+    int m;
+    for (m = 0; m < mirror_count; m++) {
+        struct drm_mirror *mirror = &mirrors[m];
+        if (!drm_show_mirror(mirror, surface, modeset))
+            continue;
+        if (!modeset && !drm_show_mirror(mirror, surface, true))
+            continue;
+        printf("stopped mirroring to connector %u\n",
+               mirror->connector->connector_id);
+        drm_disable_crtc(drm_fd, mirror->crtc);
+        drm_free_mirror(mirror);
+        m--;
+    }
+}
+static void disable_mirrors(void) {
+    int m;
+    for (m = 0; m < mirror_count; m++)
+        drm_disable_crtc(drm_fd, mirrors[m].crtc);
+}
 static GRSurface* drm_init(minui_backend* backend __unused, bool blank) {
     (void)backend;
     (void)blank;
 
     drmModeRes *res = NULL;
-    uint32_t selected_mode;
+    uint32_t selected_mode, default_mode;
     char *dev_name;
     int width, height;
     int ret, i;
@@ -365,23 +799,85 @@ static GRSurface* drm_init(minui_backend* backend __unused, bool blank) {
         close(drm_fd);
         return NULL;
     }
+    for (i = 0; i < res->count_crtcs; i++)
+        if (res->crtcs[i] == main_monitor_crtc->crtc_id)
+            main_monitor_crtc_index = i;
     disable_non_main_crtcs(drm_fd,
                            res, main_monitor_crtc);
+    default_mode = selected_mode;
+    selected_mode = find_slow_mode(main_monitor_connector, default_mode);
+    preferred_mode = NULL;
+    if (selected_mode != default_mode)
+        preferred_mode = &main_monitor_connector->modes[default_mode];
     main_monitor_crtc->mode = main_monitor_connector->modes[selected_mode];
     width = main_monitor_crtc->mode.hdisplay;
     height = main_monitor_crtc->mode.vdisplay;
     drmModeFreeResources(res);
-    drm_surfaces[0] = drm_create_surface(width, height);
-    drm_surfaces[1] = drm_create_surface(width, height);
-    if (!drm_surfaces[0] || !drm_surfaces[1]) {
-        drm_destroy_surface(drm_surfaces[0]);
-        drm_destroy_surface(drm_surfaces[1]);
-        drmModeFreeResources(res);
-        close(drm_fd);
-        return NULL;
+    primary_plane_id = 0;
+    rotation_prop_id = 0;
+    if (gr_settings.render_scale < 100 || gr_settings.rotation) {
+        drmSetClientCap(drm_fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+        primary_plane_id = drm_find_plane(drm_fd, main_monitor_crtc_index,
+                                          main_monitor_crtc->crtc_id,
+                                          DRM_PLANE_TYPE_PRIMARY,
+                                          DRM_SURFACE_FORMAT);
+        if (!primary_plane_id)
+            printf("no primary plane, can't scale or rotate\n");
+    }
+    if (primary_plane_id && gr_settings.rotation)
+        drm_get_property(drm_fd, primary_plane_id, DRM_MODE_OBJECT_PLANE,
+                         "rotation", &rotation_prop_id, NULL);
+    dpms_prop_id = 0;
+    dpms_blanked = false;
+    drm_get_property(drm_fd, main_monitor_connector->connector_id,
+                     DRM_MODE_OBJECT_CONNECTOR, "DPMS", &dpms_prop_id, NULL);
+    if (!rotation_prop_id && gr_settings.render_scale == 100)
+        primary_plane_id = 0;
+    for (;;) {
+        int fb_width = width, fb_height = height;
+        if (primary_plane_id) {
+            fb_width = width * gr_settings.render_scale / 100;
+            fb_height = height * gr_settings.render_scale / 100;
+        }
+        if (rotation_prop_id && gr_settings.rotation % 180) {
+            int tmp = fb_width;
+            fb_width = fb_height;
+            fb_height = tmp;
+        }
+        drm_surfaces[0] = drm_create_surface(fb_width, fb_height);
+        drm_surfaces[1] = drm_create_surface(fb_width, fb_height);
+        if (!drm_surfaces[0] || !drm_surfaces[1]) {
+            drm_destroy_surface(drm_surfaces[0]);
+            drm_destroy_surface(drm_surfaces[1]);
+            close(drm_fd);
+            return NULL;
+        }
+        current_buffer = 0;
+        if (drm_enable_crtc(drm_fd, main_monitor_crtc, drm_surfaces[1]) &&
+                primary_plane_id) {
+            /* Display can't rotate, leave that to software. If it can't
+             * scale either, fall back to full resolution. */
+            drm_destroy_surface(drm_surfaces[0]);
+            drm_destroy_surface(drm_surfaces[1]);
+            if (rotation_prop_id)
+                rotation_prop_id = 0;
+            else
+                primary_plane_id = 0;
+            if (gr_settings.render_scale == 100)
+                primary_plane_id = 0;
+            continue;
+        }
+        break;
+    }
+    gr_settings.hw_rotation = rotation_prop_id != 0;
+    /* Buffers rotated in software would be sideways on the mirrors */
+    if (gr_settings.rotation && !gr_settings.hw_rotation && mirror_count) {
+        printf("can't mirror, rotating in software\n");
+        disable_mirrors();
+        while (mirror_count)
+            drm_free_mirror(&mirrors[0]);
     }
-    current_buffer = 0;
-    drm_enable_crtc(drm_fd, main_monitor_crtc, drm_surfaces[1]);
+    enable_mirrors(drm_surfaces[1]);
     return &(drm_surfaces[0]->base);
 }
 static GRSurface* drm_flip(minui_backend* backend __unused) {
@@ -394,20 +890,242 @@ static GRSurface* drm_flip(minui_backend* backend __unused) {
         printf("drmModePageFlip failed ret=%d\n", ret);
         return NULL;
     }
+    show_mirrors(drm_surfaces[current_buffer], false);
     current_buffer = 1 - current_buffer;
+    /* External buffer is not on screen anymore */
+    drm_destroy_surface(external_surface);
+    external_surface = NULL;
     return &(drm_surfaces[current_buffer]->base);
 }
+static void drm_remove_overlay(void) {
+    if (!overlay_surface)
+        return;
+    drmModeSetPlane(drm_fd, overlay_plane_id, 0, 0, 0,
+                    0, 0, 0, 0, 0, 0, 0, 0);
+    drm_destroy_surface(overlay_surface);
+    overlay_surface = NULL;
+}
+/*
+ * Put a copy of source on an overlay plane. The copy is made only
+ * once, after that the plane is composited by the display hardware
+ * on every refresh without touching the drawing buffers.
+ */
+static int drm_overlay(minui_backend* backend __unused, gr_surface source,
+                       int dx, int dy) {
+    (void)backend;
+
+    int y;
+    drm_remove_overlay();
+    if (!source)
+        return 0;
+    /* Overlay plane would need to be rotated as well, and mirrors
+     * would not show it */
+    if (rotation_prop_id || mirror_count)
+        return -1;
+    if (dx < 0 || dy < 0 ||
+            dx + source->width > drm_surfaces[0]->base.width ||
+            dy + source->height > drm_surfaces[0]->base.height)
+        return -1;
+    if (!overlay_plane_id)
+        overlay_plane_id = drm_find_plane(drm_fd, main_monitor_crtc_index,
+                                          main_monitor_crtc->crtc_id,
+                                          DRM_PLANE_TYPE_OVERLAY,
+                                          DRM_SURFACE_FORMAT);
+    if (!overlay_plane_id)
+        return -1;
+    overlay_surface = drm_create_surface(source->width, source->height);
+    if (!overlay_surface)
+        return -1;
+    if (overlay_surface->base.pixel_bytes != source->pixel_bytes) {
+        drm_remove_overlay();
+        return -1;
+    }
+    for (y = 0; y < source->height; y++)
+        memcpy(overlay_surface->base.data +
+               y * overlay_surface->base.row_bytes,
+               source->data + y * source->row_bytes,
+               source->width * source->pixel_bytes);
+    overlay_x = dx;
+    overlay_y = dy;
+    if (drm_show_overlay()) {
+        drm_remove_overlay();
+        return -1;
+    }
+    return 0;
+}
+/*
+ * Fade by scaling the CRTC gamma ramps. Only a few hundred bytes are
+ * written per step, the buffers are not touched.
+ */
+static int drm_fade(minui_backend* backend __unused, int level) {
+    (void)backend;
+
+    int size = main_monitor_crtc->gamma_size;
+    int i, ret;
+    /* Mirrors have gamma tables of their own, fade them in software */
+    if (size <= 0 || mirror_count)
+        return -1;
+    if (!gamma_lut) {
+        gamma_lut = calloc(6 * size, sizeof(*gamma_lut));
+        if (!gamma_lut)
+            return -1;
+        ret = drmModeCrtcGetGamma(drm_fd, main_monitor_crtc->crtc_id, size,
+                                  gamma_lut, gamma_lut + size,
+                                  gamma_lut + 2 * size);
+        if (ret) {
+            printf("drmModeCrtcGetGamma failed ret=%d\n", ret);
+            free(gamma_lut);
+            gamma_lut = NULL;
+            return -1;
+        }
+    }
+    for (i = 0; i < 3 * size; i++)
+        gamma_lut[3 * size + i] = gamma_lut[i] * level / 255;
+    ret = drmModeCrtcSetGamma(drm_fd, main_monitor_crtc->crtc_id, size,
+                              gamma_lut + 3 * size, gamma_lut + 4 * size,
+                              gamma_lut + 5 * size);
+    if (ret) {
+        printf("drmModeCrtcSetGamma failed ret=%d\n", ret);
+        return -1;
+    }
+    return 0;
+}
+/*
+ * Scan out a dma-buf of another process as is. Possible only if it
+ * covers the mode exactly, the primary plane is not used for scaling
+ * or rotation, and no rotation is left to software either.
+ */
+static int drm_scanout(minui_backend* backend __unused, int fd,
+                       int width, int height, int stride,
+                       unsigned int format) {
+    (void)backend;
+
+    struct drm_surface *surface;
+    uint32_t handles[4] = { 0 }, pitches[4] = { 0 }, offsets[4] = { 0 };
+    bool shared;
+    int ret, i;
+    if (primary_plane_id ||
+            (gr_settings.rotation && !gr_settings.hw_rotation) ||
+            width != main_monitor_crtc->mode.hdisplay ||
+            height != main_monitor_crtc->mode.vdisplay)
+        return -1;
+    surface = (struct drm_surface*)calloc(1, sizeof(*surface));
+    if (!surface)
+        return -1;
+    /* Fails for anything but dma-bufs, e.g. memfds */
+    ret = drmPrimeFDToHandle(drm_fd, fd, &surface->handle);
+    if (ret) {
+        free(surface);
+        return -1;
+    }
+    /* Importing the shown buffer again gives its handle, which must be
+     * closed only once */
+    shared = external_surface && external_surface->handle == surface->handle;
+    surface->base.width = width;
+    surface->base.height = height;
+    handles[0] = surface->handle;
+    pitches[0] = stride;
+    ret = drmModeAddFB2(drm_fd, width, height, format, handles, pitches,
+                        offsets, &surface->fb_id, 0);
+    if (ret) {
+        printf("drmModeAddFB2 failed ret=%d\n", ret);
+        surface->fb_id = 0;
+        if (shared)
+            surface->handle = 0;
+        drm_destroy_surface(surface);
+        return -1;
+    }
+    ret = drmModePageFlip(drm_fd, main_monitor_crtc->crtc_id,
+                          surface->fb_id, 0, NULL);
+    if (ret) {
+        printf("drmModePageFlip failed ret=%d\n", ret);
+        if (shared)
+            surface->handle = 0;
+        drm_destroy_surface(surface);
+        return -1;
+    }
+    for (i = 0; i < mirror_count; i++)
+        drm_show_mirror(&mirrors[i], surface, false);
+    /* Previous one was replaced by the flip */
+    if (shared)
+        external_surface->handle = 0;
+    drm_destroy_surface(external_surface);
+    external_surface = surface;
+    return 0;
+}
 static void drm_exit(minui_backend* backend __unused) {
     (void)backend;
 
+    if (gamma_lut) {
+        int size = main_monitor_crtc->gamma_size;
+        drmModeCrtcSetGamma(drm_fd, main_monitor_crtc->crtc_id, size,
+                            gamma_lut, gamma_lut + size,
+                            gamma_lut + 2 * size);
+        free(gamma_lut);
+        gamma_lut = NULL;
+    }
+
+    drm_remove_overlay();
+    overlay_plane_id = 0;
+    /* Next user may expect the panel on */
+    if (dpms_blanked)
+        drm_set_dpms(true);
+    dpms_blanked = false;
     drm_disable_crtc(drm_fd, main_monitor_crtc);
+    disable_mirrors();
+    while (mirror_count)
+        drm_free_mirror(&mirrors[0]);
+    /* Leave the plane unrotated for whoever takes over the display */
+    if (rotation_prop_id)
+        drm_set_rotation(DRM_MODE_ROTATE_0);
     drm_destroy_surface(drm_surfaces[0]);
     drm_destroy_surface(drm_surfaces[1]);
+    drm_destroy_surface(external_surface);
+    external_surface = NULL;
     drmModeFreeCrtc(main_monitor_crtc);
     drmModeFreeConnector(main_monitor_connector);
+    preferred_mode = NULL;
     close(drm_fd);
     drm_fd = -1;
 }
+static int drm_handover(minui_backend* backend __unused) {
+    (void)backend;
+
+    struct drm_surface *front = drm_surfaces[1 - current_buffer];
+    drmModeModeInfo *mode = preferred_mode;
+    int ret;
+    if (!mode)
+        return 0;
+    preferred_mode = NULL;
+    /* A scaled or rotated buffer on the primary plane can't be used for
+     * a modeset, and a temporary buffer would show black. Keep the mode,
+     * the next user sets its own. */
+    if (primary_plane_id) {
+        printf("keeping %uHz mode, primary plane in use\n",
+               main_monitor_crtc->mode.vrefresh);
+        return 0;
+    }
+    /* Same size, so what is on screen stays as it is. Only the refresh
+     * rate changes, and the next user needs no modeset. */
+    if (external_surface)
+        front = external_surface;
+    ret = drmModeSetCrtc(drm_fd, main_monitor_crtc->crtc_id, front->fb_id,
+                         0, 0, &main_monitor_connector->connector_id, 1,
+                         mode);
+    if (ret) {
+        printf("restoring %uHz mode failed ret=%d\n", mode->vrefresh, ret);
+        return -1;
+    }
+    main_monitor_crtc->mode = *mode;
+    return 0;
+}
+static GRSurface* drm_front(minui_backend* backend __unused) {
+    (void)backend;
+
+    if (external_surface)
+        return NULL;
+    return &(drm_surfaces[1 - current_buffer]->base);
+}
 static minui_backend drm_backend = {
     .init = drm_init,
     .flip = drm_flip,
@@ -415,6 +1133,11 @@ static minui_backend drm_backend = {
     .exit = drm_exit,
     .save = NULL,
     .restore = NULL,
+    .overlay = drm_overlay,
+    .fade = drm_fade,
+    .scanout = drm_scanout,
+    .front = drm_front,
+    .handover = drm_handover,
 };
 minui_backend* open_drm() {
     return &drm_backend;
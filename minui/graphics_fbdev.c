@@ -33,6 +33,7 @@
 
 #include "minui.h"
 #include "graphics.h"
+#include "kernels.h"
 #include "../yamui-tools.h"
 
 static gr_surface fbdev_init(minui_backend *, bool);
@@ -41,6 +42,8 @@ static void fbdev_blank(minui_backend *, bool);
 static void fbdev_exit(minui_backend *);
 static void fbdev_save(minui_backend *);
 static void fbdev_restore(minui_backend *);
+static int fbdev_fade(minui_backend *, int);
+static gr_surface fbdev_front(minui_backend *);
 
 static GRSurface gr_framebuffer[2];
 static bool double_buffered;
@@ -50,6 +53,10 @@ static int displayed_buffer;
 static struct fb_var_screeninfo vi;
 static int fb_fd = -1;
 
+/* Color map of a directcolor visual, saved for fades */
+static bool direct_color;
+static struct fb_cmap saved_cmap;
+
 static minui_backend my_backend = {
 	.init    = fbdev_init,
 	.flip    = fbdev_flip,
@@ -57,6 +64,8 @@ static minui_backend my_backend = {
 	.exit    = fbdev_exit,
 	.save    = fbdev_save,
 	.restore = fbdev_restore,
+	.fade    = fbdev_fade,
+	.front   = fbdev_front,
 };
 
 /* ------------------------------------------------------------------------ */
@@ -226,6 +235,7 @@ fbdev_init(minui_backend *backend, bool blank)
 		       gr_draw->height * gr_draw->row_bytes);
 
 	fb_fd = fd;
+	direct_color = fi.visual == FB_VISUAL_DIRECTCOLOR;
 	set_displayed_framebuffer(0);
 
 	printf("framebuffer: %d (%d x %d)\n", fb_fd, gr_draw->width,
@@ -291,9 +301,10 @@ fbdev_flip(minui_backend *backend UNUSED)
 		gr_draw = gr_framebuffer + displayed_buffer;
 		set_displayed_framebuffer(1 - displayed_buffer);
 	} else {
-		/* Copy from the in-memory surface to the framebuffer. */
-		memcpy(gr_framebuffer[0].data, gr_draw->data,
-		       gr_draw->height * gr_draw->row_bytes);
+		/* Copy from the in-memory surface to the framebuffer,
+		 * which is not read back by the CPU. */
+		gr_kernels->stream(gr_framebuffer[0].data, gr_draw->data,
+				   gr_draw->height * gr_draw->row_bytes);
 	}
 
 	return gr_draw;
@@ -304,6 +315,13 @@ fbdev_flip(minui_backend *backend UNUSED)
 static void
 fbdev_exit(minui_backend *backend UNUSED)
 {
+	if (saved_cmap.len) {
+		if (ioctl(fb_fd, FBIOPUTCMAP, &saved_cmap) < 0)
+			perror("ioctl(): restore cmap");
+		free(saved_cmap.red);
+		memset(&saved_cmap, 0, sizeof(saved_cmap));
+	}
+
 	close(fb_fd);
 	fb_fd = -1;
 
@@ -374,3 +392,75 @@ fbdev_restore(minui_backend *backend)
 	if (double_buffered)
 		fbdev_flip(backend);
 }
+
+/* ------------------------------------------------------------------------ */
+
+static int
+fbdev_fade(minui_backend *backend UNUSED, int level)
+{
+	struct fb_cmap cmap;
+	__u16 *data;
+	__u32 i, len;
+
+	/* With truecolor visuals the color map does not affect pixels */
+	if (!direct_color)
+		return -1;
+
+	if (!saved_cmap.len) {
+		len = 1 << vi.red.length;
+		if (len < 1u << vi.green.length)
+			len = 1 << vi.green.length;
+		if (len < 1u << vi.blue.length)
+			len = 1 << vi.blue.length;
+
+		/* Saved and scaled color maps in one allocation */
+		if (!(data = calloc(6 * len, sizeof(*data))))
+			return -1;
+
+		saved_cmap.start = 0;
+		saved_cmap.len = len;
+		saved_cmap.red = data;
+		saved_cmap.green = data + len;
+		saved_cmap.blue = data + 2 * len;
+
+		if (ioctl(fb_fd, FBIOGETCMAP, &saved_cmap) < 0) {
+			perror("ioctl(): get cmap");
+			free(data);
+			memset(&saved_cmap, 0, sizeof(saved_cmap));
+			direct_color = false;
+			return -1;
+		}
+	}
+
+	len = saved_cmap.len;
+	data = saved_cmap.red;
+
+	for (i = 0; i < 3 * len; i++)
+		data[3 * len + i] = data[i] * level / 255;
+
+	memset(&cmap, 0, sizeof(cmap));
+	cmap.len = len;
+	cmap.red = data + 3 * len;
+	cmap.green = data + 4 * len;
+	cmap.blue = data + 5 * len;
+
+	if (ioctl(fb_fd, FBIOPUTCMAP, &cmap) < 0) {
+		perror("ioctl(): put cmap");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static gr_surface
+fbdev_front(minui_backend *backend UNUSED)
+{
+#if defined(RECOVERY_BGRA) || defined(RECOVERY_ARGB)
+	/* Byte order was swapped for the display */
+	return NULL;
+#else
+	return gr_framebuffer + (double_buffered ? displayed_buffer : 0);
+#endif
+}
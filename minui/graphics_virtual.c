@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Display simulated in memory, for developing and measuring drawing and
+ * frame timing without a device. Enabled and configured with
+ *
+ *   YAMUI_VIRTUAL=WIDTHxHEIGHT[,hz=RATE][,latency=MS][,uncached=NS]
+ *
+ * Buffers are double buffered like with DRM. A flip is queued for the
+ * first vblank at least latency ms after it, at RATE vblanks per
+ * second. Flipping again before the queued flip is done fails like
+ * DRM does with EBUSY, and the frame is dropped.
+ *
+ * With uncached, the first access to each page of the buffers after a
+ * flip costs NS nanoseconds, like reads from uncached display memory
+ * would. Pages are protected and unprotected one by one from a SIGSEGV
+ * handler, so writes pay too. The buffer from gr_draw_surface() has all
+ * its pages accessed before it is returned, as system calls given
+ * protected pages would fail with EFAULT.
+ *
+ * Statistics are printed when the display is closed, with the time
+ * spent taking the faults on top of the simulated uncached cost.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+
+#include "minui.h"
+#include "graphics.h"
+#include "../yamui-tools.h"
+
+#define VIRTUAL_ENV        "YAMUI_VIRTUAL"
+#define VIRTUAL_WIDTH      1080
+#define VIRTUAL_HEIGHT     2400
+#define VIRTUAL_HZ         60
+#define VIRTUAL_PIXEL_SIZE 4
+
+static gr_surface virtual_init(minui_backend *, bool);
+static gr_surface virtual_flip(minui_backend *);
+static void virtual_blank(minui_backend *, bool);
+static void virtual_exit(minui_backend *);
+static gr_surface virtual_front(minui_backend *);
+static void virtual_access(minui_backend *, gr_surface);
+
+static minui_backend my_backend = {
+	.init  = virtual_init,
+	.flip  = virtual_flip,
+	.blank = virtual_blank,
+	.exit  = virtual_exit,
+	.front = virtual_front,
+	.access = virtual_access,
+};
+
+static GRSurface buffers[2];
+static size_t buffer_size;
+static int draw_buffer;
+static int shown_buffer;
+static int queued_buffer = -1;
+
+/* Timing, nanoseconds */
+static long long start_ns;
+static long long period_ns;
+static long long latency_ns;
+static long long uncached_ns;
+static long long flip_ns;      /* when the queued flip was made */
+static long long queued_ns;    /* vblank that shows the queued buffer */
+
+static size_t page_size;
+static struct sigaction saved_segv;
+static long long fault_overhead_ns;  /* per fault, besides uncached_ns */
+
+static struct {
+	long flips;
+	long shown;
+	long busy;
+	long long latency_ns;  /* from flips to vblanks showing them */
+	long faults;
+	long long fault_ns;
+} stats;
+
+/* ------------------------------------------------------------------------ */
+
+minui_backend *
+open_virtual(void)
+{
+	return &my_backend;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static long long
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* First vblank at or after t */
+static long long
+next_vblank(long long t)
+{
+	long long n = (t - start_ns + period_ns - 1) / period_ns;
+
+	return start_ns + n * period_ns;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Complete the queued flip if its vblank has passed */
+static void
+update_flips(void)
+{
+	if (queued_buffer < 0 || now_ns() < queued_ns)
+		return;
+
+	stats.latency_ns += queued_ns - flip_ns;
+	stats.shown++;
+	shown_buffer = queued_buffer;
+	queued_buffer = -1;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+protect_buffers(void)
+{
+	int i;
+
+	if (!uncached_ns)
+		return;
+
+	for (i = 0; i < 2; i++)
+		mprotect(buffers[i].data, buffer_size, PROT_NONE);
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Charge for the first access to a buffer page and let it through */
+static void
+fault_handler(int sig, siginfo_t *info, void *context UNUSED)
+{
+	uintptr_t addr = (uintptr_t)info->si_addr;
+	long long start;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		uintptr_t data = (uintptr_t)buffers[i].data;
+
+		if (addr < data || addr >= data + buffer_size)
+			continue;
+
+		start = now_ns();
+		while (now_ns() - start < uncached_ns)
+			;
+		stats.faults++;
+		stats.fault_ns += now_ns() - start;
+
+		mprotect((void *)(addr & ~(page_size - 1)), page_size,
+			 PROT_READ | PROT_WRITE);
+		return;
+	}
+
+	/* Not ours, fault again without the handler */
+	sigaction(sig, &saved_segv, NULL);
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Read each page of buffer once, taking a fault for each protected one */
+static void
+access_pages(const GRSurface *buffer)
+{
+	const volatile unsigned char *data = buffer->data;
+	size_t offset;
+
+	for (offset = 0; offset < buffer_size; offset += page_size)
+		(void)data[offset];
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Time what taking a fault costs besides the simulated uncached access */
+static void
+measure_faults(void)
+{
+	long long start;
+	int i;
+
+	start = now_ns();
+	for (i = 0; i < 8; i++) {
+		protect_buffers();
+		access_pages(&buffers[0]);
+	}
+	if (stats.faults)
+		fault_overhead_ns = (now_ns() - start - stats.fault_ns) /
+				    stats.faults;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+parse_config(const char *config, int *width, int *height)
+{
+	char *copy, *option, *save = NULL;
+	int hz = VIRTUAL_HZ;
+	int result = 0;
+
+	*width = VIRTUAL_WIDTH;
+	*height = VIRTUAL_HEIGHT;
+	latency_ns = 0;
+	uncached_ns = 0;
+
+	if (!(copy = strdup(config)))
+		return -1;
+
+	for (option = strtok_r(copy, ",", &save); option;
+	     option = strtok_r(NULL, ",", &save)) {
+		if (sscanf(option, "%dx%d", width, height) == 2)
+			continue;
+		if (sscanf(option, "hz=%d", &hz) == 1)
+			continue;
+		if (sscanf(option, "latency=%lld", &latency_ns) == 1) {
+			latency_ns *= 1000000;
+			continue;
+		}
+		if (sscanf(option, "uncached=%lld", &uncached_ns) == 1)
+			continue;
+
+		printf("%s: unknown option '%s'\n", VIRTUAL_ENV, option);
+		result = -1;
+	}
+
+	if (*width <= 0 || *height <= 0 || hz <= 0 || latency_ns < 0 ||
+	    uncached_ns < 0) {
+		printf("%s: invalid configuration '%s'\n", VIRTUAL_ENV,
+		       config);
+		result = -1;
+	}
+
+	period_ns = 1000000000LL / hz;
+	free(copy);
+
+	return result;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static gr_surface
+virtual_init(minui_backend *backend UNUSED, bool blank UNUSED)
+{
+	const char *config = getenv(VIRTUAL_ENV);
+	struct sigaction sa;
+	int width, height, i;
+
+	if (!config || parse_config(config, &width, &height))
+		return NULL;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	buffer_size = (size_t)width * height * VIRTUAL_PIXEL_SIZE;
+	buffer_size = (buffer_size + page_size - 1) & ~(page_size - 1);
+
+	for (i = 0; i < 2; i++) {
+		void *data = mmap(NULL, buffer_size, PROT_READ | PROT_WRITE,
+				  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (data == MAP_FAILED) {
+			perror("mmap() failed");
+			virtual_exit(backend);
+			return NULL;
+		}
+
+		buffers[i].width = width;
+		buffers[i].height = height;
+		buffers[i].row_bytes = width * VIRTUAL_PIXEL_SIZE;
+		buffers[i].pixel_bytes = VIRTUAL_PIXEL_SIZE;
+		buffers[i].data = data;
+	}
+
+	if (uncached_ns) {
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = fault_handler;
+		sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+		sigemptyset(&sa.sa_mask);
+		if (sigaction(SIGSEGV, &sa, &saved_segv) < 0) {
+			perror("sigaction() failed");
+			uncached_ns = 0;
+		}
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	fault_overhead_ns = 0;
+	if (uncached_ns) {
+		measure_faults();
+		memset(&stats, 0, sizeof(stats));
+	}
+	start_ns = now_ns();
+	draw_buffer = 0;
+	shown_buffer = 1;
+	queued_buffer = -1;
+	protect_buffers();
+
+	printf("virtual display %dx%d at %lld Hz, latency %lld ms, "
+	       "uncached %lld ns\n", width, height,
+	       1000000000LL / period_ns, latency_ns / 1000000, uncached_ns);
+
+	return &buffers[draw_buffer];
+}
+
+/* ------------------------------------------------------------------------ */
+
+static gr_surface
+virtual_flip(minui_backend *backend UNUSED)
+{
+	update_flips();
+
+	/* Like EBUSY from drmModePageFlip(), the frame is lost */
+	if (queued_buffer >= 0) {
+		stats.busy++;
+		return &buffers[draw_buffer];
+	}
+
+	flip_ns = now_ns();
+	queued_ns = next_vblank(flip_ns + latency_ns);
+	queued_buffer = draw_buffer;
+	draw_buffer = 1 - draw_buffer;
+	stats.flips++;
+
+	protect_buffers();
+
+	return &buffers[draw_buffer];
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+virtual_blank(minui_backend *backend UNUSED, bool blank)
+{
+	printf("virtual display %s\n", blank ? "blanked" : "unblanked");
+}
+
+/* ------------------------------------------------------------------------ */
+
+static gr_surface
+virtual_front(minui_backend *backend UNUSED)
+{
+	update_flips();
+	return &buffers[shown_buffer];
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+virtual_access(minui_backend *backend UNUSED, gr_surface surface)
+{
+	int i;
+
+	if (!uncached_ns)
+		return;
+
+	for (i = 0; i < 2; i++) {
+		if (surface == &buffers[i])
+			access_pages(&buffers[i]);
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+virtual_exit(minui_backend *backend UNUSED)
+{
+	long long elapsed = now_ns() - start_ns;
+	int i;
+
+	if (buffers[0].data) {
+		printf("virtual display: %ld flips in %lld vblanks, %ld busy, "
+		       "%.2f ms average latency\n", stats.flips,
+		       elapsed / period_ns, stats.busy,
+		       stats.shown ? stats.latency_ns / 1e6 / stats.shown : 0);
+		if (uncached_ns)
+			printf("virtual display: %ld uncached page accesses, "
+			       "%.2f ms, %.2f ms more taking the faults\n",
+			       stats.faults, stats.fault_ns / 1e6,
+			       stats.faults * fault_overhead_ns / 1e6);
+	}
+
+	if (uncached_ns)
+		sigaction(SIGSEGV, &saved_segv, NULL);
+
+	for (i = 0; i < 2; i++) {
+		if (buffers[i].data)
+			munmap(buffers[i].data, buffer_size);
+		memset(&buffers[i], 0, sizeof(buffers[i]));
+	}
+}
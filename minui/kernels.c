@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "kernels.h"
+
+/* Blend weights are scaled from 0 - 255 to 0 - 256 so that division
+ * becomes a shift, and alpha 255 still gives b exactly. Intermediate
+ * values stay below 65536 and fit 16 bit lanes. */
+#define LERP_WEIGHT(alpha) ((alpha) + ((alpha) >> 7))
+
+/* ------------------------------------------------------------------------ */
+
+static void
+lerp_scalar(unsigned char *dst, const unsigned char *a,
+	    const unsigned char *b, int n, int alpha)
+{
+	unsigned t = LERP_WEIGHT(alpha);
+	int i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = (a[i] * (256 - t) + b[i] * t + 128) >> 8;
+}
+
+static void
+copy_scalar(unsigned char *dst, const unsigned char *src, size_t n)
+{
+	memcpy(dst, src, n);
+}
+
+const GRKernels gr_kernels_scalar = {
+	.name   = "scalar",
+	.lerp   = lerp_scalar,
+	.copy   = copy_scalar,
+	.stream = copy_scalar,
+};
+
+/* Rows up to this many bytes are copied inline, longer ones with
+ * memcpy(), which has the better loops for them */
+#define COPY_INLINE_MAX 64
+
+/* ------------------------------------------------------------------------ */
+
+#if defined(__SSE2__)
+
+static void
+lerp_sse2(unsigned char *dst, const unsigned char *a,
+	  const unsigned char *b, int n, int alpha)
+{
+	unsigned t = LERP_WEIGHT(alpha);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i wa = _mm_set1_epi16(256 - t);
+	const __m128i wb = _mm_set1_epi16(t);
+	const __m128i round = _mm_set1_epi16(128);
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+		__m128i lo, hi;
+
+		lo = _mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+			_mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+		hi = _mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+			_mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+
+	lerp_scalar(dst + i, a + i, b + i, n - i, alpha);
+}
+
+static void
+copy_sse2(unsigned char *dst, const unsigned char *src, size_t n)
+{
+	size_t i;
+
+	if (n < 16 || n > COPY_INLINE_MAX) {
+		memcpy(dst, src, n);
+		return;
+	}
+
+	/* The last block overlaps the previous one instead of a tail */
+	for (i = 0; i + 16 < n; i += 16)
+		_mm_storeu_si128((__m128i *)(dst + i),
+				 _mm_loadu_si128((const __m128i *)(src + i)));
+	_mm_storeu_si128((__m128i *)(dst + n - 16),
+			 _mm_loadu_si128((const __m128i *)(src + n - 16)));
+}
+
+static void
+stream_sse2(unsigned char *dst, const unsigned char *src, size_t n)
+{
+	size_t head = -(uintptr_t)dst & 15;
+	size_t i;
+
+	if (n < head + 64) {
+		memcpy(dst, src, n);
+		return;
+	}
+
+	/* Non-temporal stores need aligned destination */
+	memcpy(dst, src, head);
+	dst += head, src += head, n -= head;
+
+	for (i = 0; i + 64 <= n; i += 64) {
+		__m128i v0 = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i v1 = _mm_loadu_si128((const __m128i *)(src + i + 16));
+		__m128i v2 = _mm_loadu_si128((const __m128i *)(src + i + 32));
+		__m128i v3 = _mm_loadu_si128((const __m128i *)(src + i + 48));
+
+		_mm_stream_si128((__m128i *)(dst + i), v0);
+		_mm_stream_si128((__m128i *)(dst + i + 16), v1);
+		_mm_stream_si128((__m128i *)(dst + i + 32), v2);
+		_mm_stream_si128((__m128i *)(dst + i + 48), v3);
+	}
+
+	memcpy(dst + i, src + i, n - i);
+
+	/* Make the stores visible before anything that follows */
+	_mm_sfence();
+}
+
+static const GRKernels gr_kernels_sse2 = {
+	.name   = "sse2",
+	.lerp   = lerp_sse2,
+	.copy   = copy_sse2,
+	.stream = stream_sse2,
+};
+
+const GRKernels *gr_kernels = &gr_kernels_sse2;
+
+/* ------------------------------------------------------------------------ */
+
+#elif defined(__ARM_NEON)
+
+static void
+lerp_neon(unsigned char *dst, const unsigned char *a,
+	  const unsigned char *b, int n, int alpha)
+{
+	unsigned t = LERP_WEIGHT(alpha);
+	const uint16x8_t round = vdupq_n_u16(128);
+	int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		uint8x16_t va = vld1q_u8(a + i);
+		uint8x16_t vb = vld1q_u8(b + i);
+		uint16x8_t lo, hi;
+
+		lo = vmulq_n_u16(vmovl_u8(vget_low_u8(va)), 256 - t);
+		lo = vmlaq_n_u16(lo, vmovl_u8(vget_low_u8(vb)), t);
+		hi = vmulq_n_u16(vmovl_u8(vget_high_u8(va)), 256 - t);
+		hi = vmlaq_n_u16(hi, vmovl_u8(vget_high_u8(vb)), t);
+
+		vst1q_u8(dst + i,
+			 vcombine_u8(vshrn_n_u16(vaddq_u16(lo, round), 8),
+				     vshrn_n_u16(vaddq_u16(hi, round), 8)));
+	}
+
+	lerp_scalar(dst + i, a + i, b + i, n - i, alpha);
+}
+
+static void
+copy_neon(unsigned char *dst, const unsigned char *src, size_t n)
+{
+	size_t i;
+
+	if (n < 16 || n > COPY_INLINE_MAX) {
+		memcpy(dst, src, n);
+		return;
+	}
+
+	/* The last block overlaps the previous one instead of a tail */
+	for (i = 0; i + 16 < n; i += 16)
+		vst1q_u8(dst + i, vld1q_u8(src + i));
+	vst1q_u8(dst + n - 16, vld1q_u8(src + n - 16));
+}
+
+/* NEON intrinsics have no non-temporal store; memcpy() of the C
+ * library already uses them for large copies where it pays off. */
+static const GRKernels gr_kernels_neon = {
+	.name   = "neon",
+	.lerp   = lerp_neon,
+	.copy   = copy_neon,
+	.stream = copy_scalar,
+};
+
+const GRKernels *gr_kernels = &gr_kernels_neon;
+
+/* ------------------------------------------------------------------------ */
+
+#else
+
+const GRKernels *gr_kernels = &gr_kernels_scalar;
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _KERNELS_H_
+#define _KERNELS_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* Pixel loops used by graphics.c. Every implementation must give
+ * exactly the same results as the scalar one. */
+typedef struct {
+	const char *name;
+
+	/* dst = a + (b - a) * alpha / 255 for n bytes, rounded */
+	void (*lerp)(unsigned char *dst, const unsigned char *a,
+		     const unsigned char *b, int n, int alpha);
+
+	/* dst = src for n bytes, without call overhead for short rows */
+	void (*copy)(unsigned char *dst, const unsigned char *src, size_t n);
+
+	/* dst = src for n bytes, bypassing the cache for dst. For large
+	 * copies to memory that is not read soon, like scanout buffers. */
+	void (*stream)(unsigned char *dst, const unsigned char *src, size_t n);
+} GRKernels;
+
+/* Plain C implementation */
+extern const GRKernels gr_kernels_scalar;
+
+/* Fastest implementation available for the target CPU */
+extern const GRKernels *gr_kernels;
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* _KERNELS_H_ */
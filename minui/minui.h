@@ -30,15 +30,73 @@ typedef struct {
 	int height;
 	int row_bytes;
 	int pixel_bytes;
+	int rotation; /* data rotated clockwise for the display, degrees */
 	unsigned char *data;
 } GRSurface;
 
 typedef GRSurface *gr_surface;
 
+/* Where an image cut from a larger one with yamui-trimpng goes. The
+ * rest of the larger image is filled with one color. */
+typedef struct {
+	int width;           /* size of the image before trimming */
+	int height;
+	int x;               /* position of the trimmed image in it */
+	int y;
+	unsigned char bg[3]; /* color of the trimmed border, RGB */
+} GRTrim;
+
+/* Rectangle in screen coordinates. Like with gr_fill(), x2 and y2 are
+ * exclusive. */
+typedef struct {
+	int x1;
+	int y1;
+	int x2;
+	int y2;
+} GRRect;
+
+/* String to draw with gr_text_runs() */
+typedef struct {
+	int x;
+	int y;
+	const char *text;
+} GRTextRun;
+
+/* Render at percent of the display resolution and let the display
+ * hardware scale the result up to full screen. gr_fb_width() and
+ * gr_fb_height() report the reduced size. Ignored if the display can't
+ * scale. Must be called before gr_init(). */
+void gr_set_render_scale(int percent);
+
+/* Rotate everything drawn clockwise by 0, 90, 180 or 270 degrees. The
+ * display hardware does it if possible, otherwise images are rotated
+ * once when they are loaded. Must be called before gr_init(). */
+void gr_set_rotation(int degrees);
+
+/* Declare that no more than fps frames per second are drawn. The
+ * display may then be run at the lowest refresh rate of at least fps
+ * that it supports at its default resolution, to save power. Must be
+ * called before gr_init(). */
+void gr_set_max_fps(int fps);
+
+/* Show what is drawn also on other connected displays, e.g. HDMI. The
+ * same buffers are scanned out by all of them, scaled by the display
+ * hardware if the sizes differ. Displays that can show neither are left
+ * off, and so are all of them if gr_set_rotation() is done in software.
+ * Must be called before gr_init(). */
+void gr_set_mirror(bool mirror);
+
 /* To clear FB content during initialization set blank to true. */
 int  gr_init(bool blank);
 void gr_exit(void);
 
+/* Leave the display on for another program to take over after exit,
+ * without gr_exit(). Restores the default display mode if a slower one
+ * was used for gr_set_max_fps(), unless the frame on screen is scaled or
+ * rotated by the display and would be lost. Returns 0 on success, -1 if
+ * restoring the mode failed. */
+int  gr_handover(void);
+
 int  gr_fb_width(void);
 int  gr_fb_height(void);
 
@@ -49,15 +107,104 @@ void gr_clear(void); /* clear entire surface to current color */
 void gr_color(unsigned char r, unsigned char g, unsigned char b,
 	      unsigned char a);
 void gr_fill(int x1, int y1, int x2, int y2);
+/* Fill many rectangles in the current color. Unlike with gr_fill(),
+ * rectangles that are partly off screen are clipped. */
+void gr_fill_rects(const GRRect *rects, int count);
 void gr_text(int x, int y, const char *s, int bold);
+/* Draw many strings in the current color, like gr_text() */
+void gr_text_runs(const GRTextRun *runs, int count, int bold);
 void gr_texticon(int x, int y, gr_surface icon);
 int  gr_measure(const char *s);
 void gr_font_size(int *x, int *y);
 
 void gr_blit(gr_surface source, int sx, int sy, int w, int h, int dx, int dy);
+/* Like gr_blit(), for read-only source data that is upright. If the
+ * display is rotated in software, the area is rotated while it is
+ * copied, and the source is left as it is. */
+void gr_blit_upright(gr_surface source, int sx, int sy, int w, int h,
+		     int dx, int dy);
+/* Draw the w x h area at (sx, sy) of a and b blended together: alpha 0
+ * shows a, 255 shows b. The surfaces must have the same size. */
+void gr_blend(gr_surface a, gr_surface b, int sx, int sy, int w, int h,
+	      int dx, int dy, unsigned char alpha);
+/* Like gr_blit(), blended over what is drawn: alpha 0 leaves it as it
+ * is, 255 is gr_blit(). Copied as with gr_blit() on a 16 bpp display. */
+void gr_blit_alpha(gr_surface source, int sx, int sy, int w, int h,
+		   int dx, int dy, unsigned char alpha);
+
+/* Move content of the rectangle x1, y1 - x2, y2 up by dy pixels. The
+ * bottom dy rows are left as they were. */
+void gr_scroll(int x1, int y1, int x2, int y2, int dy);
+
+/* Find the smallest rectangle outside of which a and b are equal. The
+ * rectangle is empty if they are equal. Returns false if the surfaces
+ * can't be compared. */
+bool gr_diff_rect(gr_surface a, gr_surface b, GRRect *rect);
+
+/* True if anything was drawn in the rectangle x1, y1 - x2, y2 of the
+ * display since the last gr_flip(). */
+bool gr_is_drawn(int x1, int y1, int x2, int y2);
+
 unsigned int gr_get_width(gr_surface surface);
 unsigned int gr_get_height(gr_surface surface);
 
+/* Show static content on a hardware overlay plane instead of drawing it
+ * on every frame. The surface is copied once, and stays visible on top of
+ * everything drawn until gr_overlay(NULL, 0, 0) is called. Returns -1 if
+ * the display has no free plane; then the caller should gr_blit(). */
+int gr_overlay(gr_surface source, int dx, int dy);
+
+/* Scale brightness of everything shown to level, from 0 (black) to 255
+ * (as drawn), using the display color lookup table. Nothing is redrawn.
+ * Returns -1 if the display can't do it; then gr_darken() can be used. */
+int gr_fade(int level);
+
+/* Scale brightness of everything drawn to level in software. Below 255,
+ * drawing goes to an undarkened copy of the screen, which each flip
+ * shows darkened, so that partial redraws are not darkened again. The
+ * next flip shows the new level. Returns -1 if the copy can't be made. */
+int gr_darken(int level);
+
+/* Show a buffer shared by another process as a memfd or dma-buf,
+ * replacing anything drawn. The buffer must be gr_fb_width() x
+ * gr_fb_height() pixels. format is a DRM fourcc code. The buffer is
+ * scanned out directly if possible, otherwise it is copied to the draw
+ * buffer, which then needs to be in the same format, and flipped.
+ * Returns 0 on success, -1 on failure. */
+int gr_show_buffer(int fd, int width, int height, int stride,
+		   unsigned int format);
+
+/* Buffer that is drawn to and shown by the next gr_flip(), in the size
+ * and orientation of the display panel. For saving and restoring whole
+ * frames. Content shown with gr_overlay() is not in it. */
+gr_surface gr_draw_surface(void);
+
+/* Buffer shown by the last gr_flip(), like gr_draw_surface(), for saving
+ * a frame once it is on its way to the screen. Stays as it is until the
+ * next gr_flip(). NULL if the frame is not available. */
+gr_surface gr_front_surface(void);
+
+/* True while gr_overlay() content is shown. */
+bool gr_has_overlay(void);
+
+/* Allocate a black width x height surface to draw to with
+ * gr_set_draw_surface() and to gr_blit() from. Its data is 32 bpp in the
+ * orientation of the display panel, gr_blit() converts it for 16 bpp
+ * displays. Free it with res_free_surface(). */
+gr_surface gr_new_surface(int width, int height);
+
+/* Copy what is on screen to a new surface, like from gr_new_surface().
+ * 16 bpp content is expanded to 32 bpp. Content shown with gr_overlay()
+ * is not in it. Returns NULL if the screen content is not available. */
+gr_surface gr_copy_screen(void);
+
+/* Direct drawing to a surface from gr_new_surface() instead of the
+ * display, NULL to go back to the display. gr_fb_width() and
+ * gr_fb_height() then report the size of the surface. Do not
+ * gr_flip() before going back. Returns -1 if the surface can't be
+ * drawn to. */
+int gr_set_draw_surface(gr_surface surface);
+
 void gr_save(void);    /* Save screen content to internal buffer. */
 void gr_restore(void); /* Restore screen content from internal buffer. */
 
@@ -97,6 +244,12 @@ void ev_dispatch(void);
 /* Load a single display surface from a PNG image. */
 int res_create_display_surface(const char *name, const char *dir, gr_surface *pSurface);
 
+/* Load a single display surface from a PNG image, and where it goes
+ * within the image it was trimmed from. Untrimmed images get a trim
+ * covering just the image itself. */
+int res_create_trimmed_display_surface(const char *name, const char *dir,
+                                       GRTrim *trim, gr_surface *pSurface);
+
 /* Load an array of display surfaces from a single PNG image. The PNG
  * should have a 'Frames' text chunk whose value is the number of
  * frames this image represents. The pixel data itself is interlaced
@@ -119,6 +272,20 @@ int res_create_localized_alpha_surface(const char* name, const char *dir, const
 /* Free a surface allocated by any of the res_create_*_surface() functions. */
 void res_free_surface(gr_surface surface);
 
+/* Have hook called with the path of every file the res_create_*_surface()
+ * functions try to open, and of those passed to res_note_file(). NULL
+ * removes the hook. */
+void res_set_file_hook(void (*hook)(const char *path));
+
+/* Pass path of a file that other resource loading reads to the hook. */
+void res_note_file(const char *path);
+
+/* Save a display surface as RGB PNG image at path, in the orientation
+ * it is drawn in. Compression is fast rather than small. Uses no global
+ * state, so it can be called from another thread. Returns 0 if no
+ * error, else negative. */
+int res_write_png(const char *path, gr_surface surface);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -32,11 +32,31 @@
 #include <sys/types.h>
 
 #include "minui.h"
+#include "graphics.h"
 
 extern char *locale;
 
 #define SURFACE_DATA_ALIGNMENT 8
 
+static void (*file_hook)(const char *path);
+
+/* ------------------------------------------------------------------------ */
+
+void
+res_set_file_hook(void (*hook)(const char *path))
+{
+	file_hook = hook;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+res_note_file(const char *path)
+{
+	if (file_hook)
+		file_hook(path);
+}
+
 /* ------------------------------------------------------------------------ */
 
 static gr_surface
@@ -50,6 +70,7 @@ malloc_surface(size_t data_size)
 		return NULL;
 
 	surface = (gr_surface)temp;
+	surface->rotation = 0;
 	surface->data = temp + sizeof(GRSurface) +
 			(SURFACE_DATA_ALIGNMENT -
 			 (sizeof(GRSurface) % SURFACE_DATA_ALIGNMENT));
@@ -73,6 +94,7 @@ open_png(const char *name, const char *dir, png_structp *png_ptr, png_infop *inf
 		snprintf(resPath, sizeof resPath, "%s/%s.png", dir, name);
 	else
 		snprintf(resPath, sizeof resPath, "%s", name);
+	res_note_file(resPath);
 
 	*fp = fopen(resPath, "rb");
 	if (*fp == NULL) {
@@ -242,8 +264,60 @@ transform_rgb_to_draw(unsigned char *input_row, unsigned char *output_row,
 
 /* ------------------------------------------------------------------------ */
 
+/* Read placement written by yamui-trimpng from 'Trim' text chunk:
+ * "WIDTH HEIGHT X Y RRGGBB". Without one the image is untrimmed. */
+static void
+read_trim(png_structp png_ptr, png_infop info_ptr, png_uint_32 width,
+	  png_uint_32 height, GRTrim *trim)
+{
+	png_textp text;
+	int i, num_text, end = 0;
+	unsigned int bg;
+
+	memset(trim, 0, sizeof *trim);
+	trim->width = width;
+	trim->height = height;
+
+	if (!png_get_text(png_ptr, info_ptr, &text, &num_text))
+		return;
+
+	for (i = 0; i < num_text; i++) {
+		if (!text[i].key || strcmp(text[i].key, "Trim") ||
+		    !text[i].text)
+			continue;
+
+		if (sscanf(text[i].text, "%d %d %d %d %6x%n", &trim->width,
+			   &trim->height, &trim->x, &trim->y, &bg, &end) != 5 ||
+		    text[i].text[end] || trim->x < 0 || trim->y < 0 ||
+		    trim->x + width > (png_uint_32)trim->width ||
+		    trim->y + height > (png_uint_32)trim->height) {
+			printf("ignoring bad trim \"%s\"\n", text[i].text);
+			memset(trim, 0, sizeof *trim);
+			trim->width = width;
+			trim->height = height;
+			return;
+		}
+
+		trim->bg[0] = bg >> 16;
+		trim->bg[1] = bg >> 8;
+		trim->bg[2] = bg;
+		return;
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
 int
 res_create_display_surface(const char *name, const char *dir, gr_surface *pSurface)
+{
+	return res_create_trimmed_display_surface(name, dir, NULL, pSurface);
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+res_create_trimmed_display_surface(const char *name, const char *dir,
+				   GRTrim *trim, gr_surface *pSurface)
 {
 	int result = 0;
 	unsigned int y;
@@ -262,6 +336,9 @@ res_create_display_surface(const char *name, const char *dir, gr_surface *pSurfa
 	if (result < 0)
 		return result;
 
+	if (trim)
+		read_trim(png_ptr, info_ptr, width, height, trim);
+
 	if (!(surface = init_display_surface(width, height))) {
 		result = -8;
 		goto exit;
@@ -278,6 +355,7 @@ res_create_display_surface(const char *name, const char *dir, gr_surface *pSurfa
 
 	free(p_row);
 
+	gr_rotate_surface(surface);
 	*pSurface = surface;
 
 exit:
@@ -359,6 +437,9 @@ res_create_multi_display_surface(const char *name, const char *dir, int *frames,
 
 	free(p_row);
 
+	for (i = 0; i < *frames; i++)
+		gr_rotate_surface(surface[i]);
+
 	*pSurface = (gr_surface *)surface;
 
 exit:
@@ -418,6 +499,7 @@ res_create_alpha_surface(const char *name, const char *dir, gr_surface *pSurface
 		png_read_row(png_ptr, p_row, NULL);
 	}
 
+	gr_rotate_surface(surface);
 	*pSurface = surface;
 exit:
 	close_png(&png_ptr, &info_ptr, fp);
@@ -521,6 +603,7 @@ res_create_localized_alpha_surface(const char *name, const char *dir, const char
 				memcpy(surface->data + i * w, row, w);
 			}
 
+			gr_rotate_surface(surface);
 			*pSurface = (gr_surface)surface;
 			break;
 		} else {
@@ -546,3 +629,111 @@ res_free_surface(gr_surface surface)
 {
 	free(surface);
 }
+
+/* ------------------------------------------------------------------------ */
+
+/* Pixel at x, y of a w x h image stored rotated clockwise in surface */
+static const unsigned char *
+rotated_pixel(gr_surface surface, int w, int h, int x, int y)
+{
+	int dx = x, dy = y;
+
+	switch (surface->rotation) {
+	case 90:
+		dx = h - 1 - y;
+		dy = x;
+		break;
+	case 180:
+		dx = w - 1 - x;
+		dy = h - 1 - y;
+		break;
+	case 270:
+		dx = y;
+		dy = w - 1 - x;
+		break;
+	}
+
+	return surface->data + dy * surface->row_bytes + dx * 4;
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+res_write_png(const char *path, gr_surface surface)
+{
+	int result = 0;
+	FILE *fp = NULL;
+	png_structp png_ptr = NULL;
+	png_infop info_ptr = NULL;
+	unsigned char *row = NULL;
+	int w, h, x, y;
+
+	if (!surface || surface->pixel_bytes != 4)
+		return -1;
+
+	w = surface->rotation % 180 ? surface->height : surface->width;
+	h = surface->rotation % 180 ? surface->width : surface->height;
+
+	if (!(fp = fopen(path, "wb")))
+		return -2;
+
+	if (!(row = malloc(w * 4))) {
+		result = -3;
+		goto exit;
+	}
+
+	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL,
+					  NULL);
+	if (!png_ptr) {
+		result = -4;
+		goto exit;
+	}
+
+	info_ptr = png_create_info_struct(png_ptr);
+	if (!info_ptr) {
+		result = -5;
+		goto exit;
+	}
+
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		result = -6;
+		goto exit;
+	}
+
+	png_init_io(png_ptr, fp);
+
+	/* Favor speed, screenshots are taken while animating */
+	png_set_compression_level(png_ptr, 1);
+	png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+
+	png_set_IHDR(png_ptr, info_ptr, w, h, 8, PNG_COLOR_TYPE_RGB,
+		     PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+		     PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png_ptr, info_ptr);
+
+	/* Rows are R, G, B, X like draw buffers, drop the X byte */
+	png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
+
+	for (y = 0; y < h; y++) {
+		if (!surface->rotation) {
+			png_write_row(png_ptr, surface->data +
+				      y * surface->row_bytes);
+			continue;
+		}
+		for (x = 0; x < w; x++)
+			memcpy(row + x * 4,
+			       rotated_pixel(surface, w, h, x, y), 4);
+		png_write_row(png_ptr, row);
+	}
+
+	png_write_end(png_ptr, NULL);
+
+exit:
+	if (png_ptr)
+		png_destroy_write_struct(&png_ptr, info_ptr ? &info_ptr : NULL);
+	free(row);
+	if (fclose(fp) && !result)
+		result = -7;
+
+	return result;
+}
@@ -19,6 +19,7 @@
 #include <stdbool.h>
 
 #include "os-update.h"
+#include "transition.h"
 #include "minui/minui.h"
 
 #define MARGIN 10
@@ -27,6 +28,58 @@ const char logo_filename[] = "test";
 
 gr_surface logo;
 
+/* Where logo goes within the image it was trimmed from */
+static GRTrim logo_trim;
+
+/* Logo is shown on a hardware plane and needs no redrawing */
+static bool logo_on_overlay;
+
+/* Previous logo while crossfading from it to the current one */
+static gr_surface logo_prev;
+static GRTrim logo_prev_trim;
+static transition_t *logo_transition;
+
+/* ------------------------------------------------------------------------ */
+
+static void
+freeCrossfade(void)
+{
+	transition_free(logo_transition), logo_transition = NULL;
+
+	if (logo_prev)
+		res_free_surface(logo_prev), logo_prev = 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Fill the border trimmed off the logo image at x, y and move x, y to
+ * where the logo itself goes. */
+static void
+drawLogoTrim(int *x, int *y)
+{
+	int x1 = *x > 0 ? *x : 0;
+	int y1 = *y > 0 ? *y : 0;
+	int x2 = *x + logo_trim.width;
+	int y2 = *y + logo_trim.height;
+
+	/* gr_fill() draws nothing if the area is not all on screen */
+	if (x2 > gr_fb_width())
+		x2 = gr_fb_width();
+	if (y2 > gr_fb_height())
+		y2 = gr_fb_height();
+
+	if ((logo_trim.width != (int)gr_get_width(logo) ||
+	     logo_trim.height != (int)gr_get_height(logo)) &&
+	    x1 < x2 && y1 < y2) {
+		gr_color(logo_trim.bg[0], logo_trim.bg[1], logo_trim.bg[2],
+			 255);
+		gr_fill(x1, y1, x2, y2);
+	}
+
+	*x += logo_trim.x;
+	*y += logo_trim.y;
+}
+
 /* ------------------------------------------------------------------------ */
 
 int
@@ -36,7 +89,9 @@ loadLogo(const char *filename, const char *dir)
 
 	freeLogo();
 
-	if ((ret = res_create_display_surface(filename, dir, &logo)) < 0) {
+	if ((ret = res_create_trimmed_display_surface(filename, dir,
+						      &logo_trim,
+						      &logo)) < 0) {
 		printf("Error while trying to load %s, retval: %i.\n",
 		       filename, ret);
 		return -1;
@@ -47,6 +102,67 @@ loadLogo(const char *filename, const char *dir)
 
 /* ------------------------------------------------------------------------ */
 
+int
+crossfadeLogo(const char *filename, const char *dir, int duration_ms,
+	      int period_ms)
+{
+	gr_surface next;
+	GRTrim next_trim;
+	int ret;
+
+	if ((ret = res_create_trimmed_display_surface(filename, dir,
+						      &next_trim,
+						      &next)) < 0) {
+		printf("Error while trying to load %s, retval: %i.\n",
+		       filename, ret);
+		return -1;
+	}
+
+	freeCrossfade();
+
+	if (logo_on_overlay)
+		gr_overlay(NULL, 0, 0), logo_on_overlay = false;
+
+	logo_prev = logo;
+	logo_prev_trim = logo_trim;
+	logo = next;
+	logo_trim = next_trim;
+
+	/* Trimmed logos can only be blended where they overlap */
+	if (logo_prev && logo_prev_trim.x == logo_trim.x &&
+	    logo_prev_trim.y == logo_trim.y &&
+	    logo_prev_trim.width == logo_trim.width &&
+	    logo_prev_trim.height == logo_trim.height)
+		logo_transition = transition_new(logo_prev, logo,
+						 duration_ms, period_ms);
+	if (!logo_transition)
+		freeCrossfade();
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+bool
+showLogoCrossfade(long long now_ms)
+{
+	int dx, dy;
+
+	if (!logo_transition)
+		return false;
+
+	dx = (gr_fb_width() - logo_trim.width) / 2 + logo_trim.x;
+	dy = (gr_fb_height() - logo_trim.height) / 2 + logo_trim.y;
+
+	if (transition_draw(logo_transition, dx, dy, now_ms))
+		return true;
+
+	freeCrossfade();
+	return false;
+}
+
+/* ------------------------------------------------------------------------ */
+
 int
 showLogo(void)
 {
@@ -57,10 +173,15 @@ showLogo(void)
 	if (logo) {
 		int logow = gr_get_width(logo);
 		int logoh = gr_get_height(logo);
-		int dx = (fbw - logow) / 2;
-		int dy = (fbh - logoh) / 2;
+		int dx = (fbw - logo_trim.width) / 2;
+		int dy = (fbh - logo_trim.height) / 2;
+
+		drawLogoTrim(&dx, &dy);
 
-		gr_blit(logo, 0, 0, logow, logoh, dx, dy);
+		if (logo_transition)
+			transition_redraw(logo_transition, dx, dy);
+		else
+			gr_blit(logo, 0, 0, logow, logoh, dx, dy);
 	} else {
 		printf("No logo loaded\n");
 		return -1;
@@ -71,36 +192,77 @@ showLogo(void)
 
 /* ------------------------------------------------------------------------ */
 
-void
-osUpdateScreenShowProgress(int percentage)
+/* Column where the done part of the progress bar ends */
+static int
+progressSplit(int progress)
 {
-	int fbw, fbh, splitpoint, x1, x2, y1, y2;
+	int splitpoint = (gr_fb_width() - 2 * MARGIN) * progress /
+			 PROGRESS_FINE_MAX;
 
-	fbw = gr_fb_width();
-	fbh = gr_fb_height();
+	assert(splitpoint >= 0);
+	assert(splitpoint <= gr_fb_width());
 
-	splitpoint = (fbw - 2 * MARGIN) * percentage / 100;
+	return MARGIN + splitpoint;
+}
 
-	assert(splitpoint >= 0);
-	assert(splitpoint <= fbw);
+/* ------------------------------------------------------------------------ */
 
-	x1 = MARGIN;
-	y1 = fbh / 2 + MARGIN;
-	x2 = MARGIN + splitpoint;
-	y2 = fbh / 2 + 20;
+/* Draw columns x1 to x2 of the progress bar */
+static void
+drawProgress(int x1, int x2, int split)
+{
+	int y1 = gr_fb_height() / 2 + MARGIN;
+	int y2 = gr_fb_height() / 2 + 20;
 
 	/* white color for the beginning of the progressbar */
-	gr_color(255, 255, 255, 255);
-
-	gr_fill(x1, y1, x2, y2);
+	if (x1 < split) {
+		gr_color(255, 255, 255, 255);
+		gr_fill(x1, y1, split < x2 ? split : x2, y2);
+	}
 
 	/* Grey color for the end part of the progressbar */
-	gr_color(84, 84, 84, 255);
+	if (x2 > split) {
+		gr_color(84, 84, 84, 255);
+		gr_fill(split > x1 ? split : x1, y1, x2, y2);
+	}
+}
 
-	x1 = MARGIN + splitpoint;
-	x2 = fbw - MARGIN;
+/* ------------------------------------------------------------------------ */
+
+void
+osUpdateScreenShowProgress(int percentage)
+{
+	osUpdateScreenShowProgressFine(percentage * (PROGRESS_FINE_MAX / 100));
+}
 
-	gr_fill(x1, y1, x2, y2);
+/* ------------------------------------------------------------------------ */
+
+void
+osUpdateScreenShowProgressFine(int progress)
+{
+	drawProgress(MARGIN, gr_fb_width() - MARGIN, progressSplit(progress));
+	showProgressLogo();
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+osUpdateScreenMoveProgress(int from, int to)
+{
+	int x1 = progressSplit(from);
+	int x2 = progressSplit(to);
+
+	if (x1 != x2)
+		drawProgress(x1 < x2 ? x1 : x2, x1 < x2 ? x2 : x1, x2);
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+showProgressLogo(void)
+{
+	int fbw = gr_fb_width();
+	int fbh = gr_fb_height();
 
 	/* draw logo on the top of the progress bar if it is loaded */
 	if (logo) {
@@ -108,8 +270,10 @@ osUpdateScreenShowProgress(int percentage)
 
 		logow = gr_get_width(logo);
 		logoh = gr_get_height(logo);
-		dx = (fbw - logow) / 2;
-		dy = (fbh / 2 - logoh - 2 * MARGIN);
+		dx = (fbw - logo_trim.width) / 2;
+		dy = (fbh / 2 - logo_trim.height - 2 * MARGIN);
+
+		drawLogoTrim(&dx, &dy);
 #ifdef DEBUG
 		printf("width: %i, height: %i, row_bytes: %i, pixel_bytes: "
 		       "%i\n",
@@ -117,7 +281,10 @@ osUpdateScreenShowProgress(int percentage)
 		       logo->pixel_bytes);
 #endif /* DEBUG */
 
-		gr_blit(logo, 0, 0, logow, logoh, dx, dy);
+		if (!logo_on_overlay)
+			logo_on_overlay = (gr_overlay(logo, dx, dy) == 0);
+		if (!logo_on_overlay)
+			gr_blit(logo, 0, 0, logow, logoh, dx, dy);
 	}
 }
 
@@ -126,6 +293,11 @@ osUpdateScreenShowProgress(int percentage)
 void
 freeLogo(void)
 {
+	if (logo_on_overlay)
+		gr_overlay(NULL, 0, 0), logo_on_overlay = false;
+
+	freeCrossfade();
+
 	if (logo)
 		res_free_surface(logo), logo = 0;
 
@@ -1,6 +1,8 @@
 #ifndef _OS_UPDATE_H_
 #define _OS_UPDATE_H_
 
+#include <stdbool.h>
+
 /*
  * Loads logo and overrides the old logo if already loaded.
  * @param filename of the file located in dir without extension or
@@ -11,6 +13,26 @@
  */
 int loadLogo(const char *filename, const char *dir);
 
+/*
+ * Loads next logo and starts crossfading to it from the current one.
+ * Without a current logo of the same size and placement, the logo just
+ * changes.
+ * @param filename, dir as with loadLogo
+ * @param duration_ms length of the crossfade
+ * @param period_ms interval of showLogoCrossfade() calls
+ * @return 0 when loading successful
+ * @return -1 when loading fails
+ */
+int crossfadeLogo(const char *filename, const char *dir, int duration_ms,
+		  int period_ms);
+
+/*
+ * Draw next crossfade step. Only the changed area is drawn.
+ * @param now_ms frame clock time in milliseconds
+ * @return true while crossfade is in progress
+ */
+bool showLogoCrossfade(long long now_ms);
+
 /*
  * Draw logo if one has been loaded with loadLogo.
  * @return 0 when logo drawn successfully
@@ -25,6 +47,28 @@ int showLogo(void);
  */
 void osUpdateScreenShowProgress(int percentage);
 
+/* Progress as hundredths of a percent, for smooth movement */
+#define PROGRESS_FINE_MAX 10000
+
+/*
+ *  As osUpdateScreenShowProgress(), with progress between 0 and
+ *  PROGRESS_FINE_MAX.
+ */
+void osUpdateScreenShowProgressFine(int progress);
+
+/*
+ *  Draw only the columns of the progress bar that change when it
+ *  moves from one position to another.
+ *  @param from, to progress between 0 and PROGRESS_FINE_MAX
+ */
+void osUpdateScreenMoveProgress(int from, int to);
+
+/*
+ *  Draw logo if defined where osUpdateScreenShowProgress() puts it,
+ *  above the progress bar.
+ */
+void showProgressLogo(void);
+
 /* Should be called before ending application, to free memory etc. */
 void freeLogo(void);
 
@@ -0,0 +1,923 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "scene.h"
+#include "atlas.h"
+#include "minui/minui.h"
+
+#define MARGIN          10
+#define PROGRESS_HEIGHT 10
+#define TOKENS_MAX      32
+
+typedef enum {
+	LAYER_IMAGE,
+	LAYER_TEXT,
+	LAYER_PROGRESS,
+	LAYER_RECT,
+} layer_type_t;
+
+typedef enum {
+	PROP_X,
+	PROP_Y,
+	PROP_ALPHA,
+	PROP_FRAME,
+	PROP_COUNT
+} prop_t;
+
+/* Length given either in pixels or as percentage of the screen size */
+typedef struct {
+	int  value;
+	bool percent;
+} length_t;
+
+typedef struct {
+	int       period_ms;
+	int       count;
+	length_t *keys;
+	int      *resolved; /* keys converted for the current display mode */
+} track_t;
+
+/* Image, or sprite of an atlas */
+typedef struct {
+	gr_surface      surface;
+	GRRect          src;      /* area of surface to draw */
+	bool            owned;    /* surface is not from an atlas */
+} frame_t;
+
+typedef struct {
+	char           *name;
+	layer_type_t    type;
+	int             anchor_x; /* 0: left, 1: center, 2: right */
+	int             anchor_y; /* 0: top,  1: center, 2: bottom */
+	length_t        x, y, w, h;
+	unsigned char   color[4];
+	unsigned char   bg[4];
+	char           *text;
+	frame_t        *frames;
+	int             frame_count;
+	track_t        *tracks[PROP_COUNT];
+
+	/* Layout resolved for the current display mode */
+	GRRect          base;
+
+	/* Animated state */
+	int             dx, dy, alpha, frame;
+	GRRect          drawn;
+	bool            dirty;
+} layer_t;
+
+struct scene {
+	unsigned char  bg[3];
+	layer_t       *layers;
+	int            layer_count;
+	atlas_t      **atlases;
+	int            atlas_count;
+	bool           animated;
+	const char    *text;
+	int            progress;
+	long long      now_ms;
+
+	/* Display mode the layout has been resolved for */
+	int            mode_w;
+	int            mode_h;
+
+	/* Area repainted for the previous frame; with double buffering
+	 * the draw buffer still lacks those changes. */
+	GRRect         prev_damage;
+};
+
+static const char * const prop_names[PROP_COUNT] = {
+	[PROP_X]     = "x",
+	[PROP_Y]     = "y",
+	[PROP_ALPHA] = "alpha",
+	[PROP_FRAME] = "frame",
+};
+
+/* ------------------------------------------------------------------------ */
+
+static bool
+rect_is_empty(const GRRect *r)
+{
+	return r->x1 >= r->x2 || r->y1 >= r->y2;
+}
+
+static GRRect
+rect_union(GRRect a, GRRect b)
+{
+	if (rect_is_empty(&a))
+		return b;
+	if (rect_is_empty(&b))
+		return a;
+
+	a.x1 = b.x1 < a.x1 ? b.x1 : a.x1;
+	a.y1 = b.y1 < a.y1 ? b.y1 : a.y1;
+	a.x2 = b.x2 > a.x2 ? b.x2 : a.x2;
+	a.y2 = b.y2 > a.y2 ? b.y2 : a.y2;
+	return a;
+}
+
+static GRRect
+rect_intersect(GRRect a, GRRect b)
+{
+	a.x1 = b.x1 > a.x1 ? b.x1 : a.x1;
+	a.y1 = b.y1 > a.y1 ? b.y1 : a.y1;
+	a.x2 = b.x2 < a.x2 ? b.x2 : a.x2;
+	a.y2 = b.y2 < a.y2 ? b.y2 : a.y2;
+	return a;
+}
+
+static GRRect
+rect_move(GRRect r, int dx, int dy)
+{
+	r.x1 += dx, r.x2 += dx;
+	r.y1 += dy, r.y2 += dy;
+	return r;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Split next whitespace separated token from *pos. Double quotes group
+ * words together and are removed from the token. */
+static char *
+next_token(char **pos)
+{
+	char *src = *pos, *dst, *token;
+	bool quoted = false;
+
+	while (*src == ' ' || *src == '\t')
+		src++;
+
+	if (!*src || *src == '#')
+		return NULL;
+
+	token = dst = src;
+	for (; *src; src++) {
+		if (*src == '"')
+			quoted = !quoted;
+		else if (!quoted && (*src == ' ' || *src == '\t'))
+			break;
+		else
+			*dst++ = *src;
+	}
+
+	if (*src)
+		src++;
+	*dst = 0;
+	*pos = src;
+	return token;
+}
+
+static bool
+parse_length(const char *str, length_t *len)
+{
+	char *end;
+
+	len->value = strtol(str, &end, 10);
+	len->percent = (*end == '%');
+	if (len->percent)
+		end++;
+	return end != str && !*end;
+}
+
+static bool
+parse_color(const char *str, unsigned char *rgba, bool with_alpha)
+{
+	size_t len = strlen(str);
+	char *end;
+	unsigned long v;
+
+	if (len != 6 && !(with_alpha && len == 8))
+		return false;
+
+	v = strtoul(str, &end, 16);
+	if (*end)
+		return false;
+
+	if (len == 6)
+		v = (v << 8) | 0xff;
+
+	rgba[0] = v >> 24;
+	rgba[1] = v >> 16;
+	rgba[2] = v >> 8;
+	if (with_alpha)
+		rgba[3] = v;
+	return true;
+}
+
+static bool
+parse_anchor(const char *str, layer_t *layer)
+{
+	static const struct {
+		const char *name;
+		int x, y;
+	} anchors[] = {
+		{ "top-left",     0, 0 },
+		{ "top",          1, 0 },
+		{ "top-right",    2, 0 },
+		{ "left",         0, 1 },
+		{ "center",       1, 1 },
+		{ "right",        2, 1 },
+		{ "bottom-left",  0, 2 },
+		{ "bottom",       1, 2 },
+		{ "bottom-right", 2, 2 },
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof anchors / sizeof *anchors; i++) {
+		if (!strcmp(str, anchors[i].name)) {
+			layer->anchor_x = anchors[i].x;
+			layer->anchor_y = anchors[i].y;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Get atlas by name, loading it on first use */
+static atlas_t *
+get_atlas(scene_t *scene, const char *name, const char *dir)
+{
+	bool is_path = strchr(name, '/') || strstr(name, ".png");
+	atlas_t **atlases, *atlas;
+	int i;
+
+	for (i = 0; i < scene->atlas_count; i++)
+		if (!strcmp(atlas_name(scene->atlases[i]), name))
+			return scene->atlases[i];
+
+	if (!(atlas = atlas_load(name, is_path ? NULL : dir)))
+		return NULL;
+
+	atlases = realloc(scene->atlases, (scene->atlas_count + 1) *
+			  sizeof *atlases);
+	if (!atlases) {
+		atlas_free(atlas);
+		return NULL;
+	}
+
+	scene->atlases = atlases;
+	scene->atlases[scene->atlas_count++] = atlas;
+	return atlas;
+}
+
+static int
+load_frame(scene_t *scene, frame_t *frame, char *name, const char *dir)
+{
+	char *sprite = strchr(name, ':');
+	bool is_path = strchr(name, '/') || strstr(name, ".png");
+	atlas_t *atlas;
+	int ret;
+
+	if (sprite) {
+		*sprite++ = 0;
+		if (!(atlas = get_atlas(scene, name, dir)))
+			return -1;
+		if (!atlas_find(atlas, sprite, &frame->src)) {
+			fprintf(stderr, "no sprite %s in %s\n", sprite, name);
+			return -1;
+		}
+		frame->surface = atlas_surface(atlas);
+		frame->owned = false;
+		return 0;
+	}
+
+	if ((ret = res_create_display_surface(name, is_path ? NULL : dir,
+					      &frame->surface)) < 0) {
+		fprintf(stderr, "Error while trying to load %s, "
+			"retval: %i.\n", name, ret);
+		return -1;
+	}
+
+	frame->src = (GRRect){ 0, 0, gr_get_width(frame->surface),
+			       gr_get_height(frame->surface) };
+	frame->owned = true;
+	return 0;
+}
+
+static int
+load_frames(scene_t *scene, layer_t *layer, char *list, const char *dir)
+{
+	char *name, *save = NULL;
+
+	for (name = strtok_r(list, ",", &save); name;
+	     name = strtok_r(NULL, ",", &save)) {
+		frame_t *frames;
+
+		frames = realloc(layer->frames, (layer->frame_count + 1) *
+				 sizeof *frames);
+		if (!frames)
+			return -1;
+
+		layer->frames = frames;
+		if (load_frame(scene, &frames[layer->frame_count], name,
+			       dir) < 0)
+			return -1;
+		layer->frame_count++;
+	}
+
+	return layer->frame_count > 0 ? 0 : -1;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static layer_t *
+find_layer(scene_t *scene, const char *name)
+{
+	int i;
+
+	for (i = 0; i < scene->layer_count; i++)
+		if (!strcmp(scene->layers[i].name, name))
+			return &scene->layers[i];
+
+	return NULL;
+}
+
+static int
+parse_layer(scene_t *scene, char **tokens, int count, const char *dir)
+{
+	static const char * const types[] = {
+		[LAYER_IMAGE]    = "image",
+		[LAYER_TEXT]     = "text",
+		[LAYER_PROGRESS] = "progress",
+		[LAYER_RECT]     = "rect",
+	};
+	layer_t *layers, *layer;
+	int i, type;
+
+	if (count < 3)
+		return -1;
+
+	if (find_layer(scene, tokens[1])) {
+		fprintf(stderr, "duplicate layer %s\n", tokens[1]);
+		return -1;
+	}
+
+	for (type = 0; type < (int)(sizeof types / sizeof *types); type++)
+		if (!strcmp(tokens[2], types[type]))
+			break;
+
+	if (type == (int)(sizeof types / sizeof *types)) {
+		fprintf(stderr, "unknown layer type %s\n", tokens[2]);
+		return -1;
+	}
+
+	layers = realloc(scene->layers, (scene->layer_count + 1) *
+			 sizeof *layers);
+	if (!layers)
+		return -1;
+
+	scene->layers = layers;
+	layer = memset(&layers[scene->layer_count++], 0, sizeof *layer);
+	layer->type = type;
+	layer->anchor_x = layer->anchor_y = 1;
+	layer->alpha = 255;
+	memset(layer->color, 255, sizeof layer->color);
+	layer->bg[0] = layer->bg[1] = layer->bg[2] = 84;
+	layer->bg[3] = 255;
+
+	if (!(layer->name = strdup(tokens[1])))
+		return -1;
+
+	/* Progress bar defaults mimic osUpdateScreenShowProgress() */
+	if (type == LAYER_PROGRESS) {
+		layer->w.value = -2 * MARGIN;
+		layer->h.value = PROGRESS_HEIGHT;
+		layer->y.value = MARGIN + PROGRESS_HEIGHT / 2;
+	}
+
+	for (i = 3; i < count; i++) {
+		char *key = tokens[i], *val = strchr(key, '=');
+		bool ok = false;
+
+		if (!val) {
+			fprintf(stderr, "expected KEY=VALUE, got %s\n", key);
+			return -1;
+		}
+		*val++ = 0;
+
+		if (!strcmp(key, "anchor"))
+			ok = parse_anchor(val, layer);
+		else if (!strcmp(key, "x"))
+			ok = parse_length(val, &layer->x);
+		else if (!strcmp(key, "y"))
+			ok = parse_length(val, &layer->y);
+		else if (!strcmp(key, "w"))
+			ok = parse_length(val, &layer->w);
+		else if (!strcmp(key, "h"))
+			ok = parse_length(val, &layer->h);
+		else if (!strcmp(key, "color"))
+			ok = parse_color(val, layer->color, true);
+		else if (!strcmp(key, "bg"))
+			ok = parse_color(val, layer->bg, true);
+		else if (!strcmp(key, "text"))
+			ok = (layer->text = strdup(val)) != NULL;
+		else if (!strcmp(key, "image"))
+			ok = load_frames(scene, layer, val, dir) == 0;
+
+		if (!ok) {
+			fprintf(stderr, "invalid %s=%s\n", key, val);
+			return -1;
+		}
+	}
+
+	if (type == LAYER_IMAGE && !layer->frame_count) {
+		fprintf(stderr, "image layer %s without image\n", layer->name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+parse_track(scene_t *scene, char **tokens, int count)
+{
+	layer_t *layer;
+	track_t *track;
+	int prop, i;
+
+	if (count < 5)
+		return -1;
+
+	if (!(layer = find_layer(scene, tokens[1]))) {
+		fprintf(stderr, "unknown layer %s\n", tokens[1]);
+		return -1;
+	}
+
+	for (prop = 0; prop < PROP_COUNT; prop++)
+		if (!strcmp(tokens[2], prop_names[prop]))
+			break;
+
+	if (prop == PROP_COUNT || layer->tracks[prop]) {
+		fprintf(stderr, "invalid track %s for layer %s\n",
+			tokens[2], tokens[1]);
+		return -1;
+	}
+
+	if (!(track = calloc(1, sizeof *track)))
+		return -1;
+	layer->tracks[prop] = track;
+
+	track->period_ms = atoi(tokens[3]);
+	track->count = count - 4;
+	track->keys = calloc(track->count, sizeof *track->keys);
+	track->resolved = calloc(track->count, sizeof *track->resolved);
+	if (!track->keys || !track->resolved || track->period_ms <= 0)
+		return -1;
+
+	for (i = 0; i < track->count; i++) {
+		if (!parse_length(tokens[4 + i], &track->keys[i])) {
+			fprintf(stderr, "invalid keyframe %s\n", tokens[4 + i]);
+			return -1;
+		}
+	}
+
+	scene->animated = true;
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+scene_t *
+scene_load(const char *path, const char *dir)
+{
+	scene_t *scene;
+	FILE *fp;
+	char *line = NULL;
+	size_t size = 0;
+	int lineno = 0;
+	bool ok = true;
+
+	if (!(fp = fopen(path, "r"))) {
+		perror(path);
+		return NULL;
+	}
+
+	if (!(scene = calloc(1, sizeof *scene))) {
+		fclose(fp);
+		return NULL;
+	}
+
+	while (ok && getline(&line, &size, fp) != -1) {
+		char *tokens[TOKENS_MAX], *pos = line;
+		int count = 0;
+
+		lineno++;
+		line[strcspn(line, "\r\n")] = 0;
+
+		while (count < TOKENS_MAX && (tokens[count] = next_token(&pos)))
+			count++;
+
+		if (!count)
+			continue;
+
+		if (!strcmp(tokens[0], "background"))
+			ok = count == 2 && parse_color(tokens[1], scene->bg,
+						       false);
+		else if (!strcmp(tokens[0], "layer"))
+			ok = parse_layer(scene, tokens, count, dir) == 0;
+		else if (!strcmp(tokens[0], "track"))
+			ok = parse_track(scene, tokens, count) == 0;
+		else
+			ok = false;
+
+		if (!ok)
+			fprintf(stderr, "%s:%d: invalid statement\n", path,
+				lineno);
+	}
+
+	free(line);
+	fclose(fp);
+
+	if (!ok) {
+		scene_free(scene);
+		return NULL;
+	}
+
+	return scene;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+scene_free(scene_t *scene)
+{
+	int i, j;
+
+	if (!scene)
+		return;
+
+	for (i = 0; i < scene->layer_count; i++) {
+		layer_t *layer = &scene->layers[i];
+
+		for (j = 0; j < layer->frame_count; j++)
+			if (layer->frames[j].owned)
+				res_free_surface(layer->frames[j].surface);
+
+		for (j = 0; j < PROP_COUNT; j++) {
+			if (layer->tracks[j]) {
+				free(layer->tracks[j]->keys);
+				free(layer->tracks[j]->resolved);
+				free(layer->tracks[j]);
+			}
+		}
+
+		free(layer->frames);
+		free(layer->text);
+		free(layer->name);
+	}
+
+	for (i = 0; i < scene->atlas_count; i++)
+		atlas_free(scene->atlases[i]);
+
+	free(scene->atlases);
+	free(scene->layers);
+	free(scene);
+}
+
+/* ------------------------------------------------------------------------ */
+
+bool
+scene_is_animated(const scene_t *scene)
+{
+	return scene->animated;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+scene_set_text(scene_t *scene, const char *text)
+{
+	scene->text = text;
+
+	/* Text size affects layout */
+	scene->mode_w = scene->mode_h = 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+scene_set_progress(scene_t *scene, int percentage)
+{
+	int i;
+
+	if (scene->progress == percentage)
+		return;
+
+	scene->progress = percentage;
+
+	for (i = 0; i < scene->layer_count; i++)
+		if (scene->layers[i].type == LAYER_PROGRESS)
+			scene->layers[i].dirty = true;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+eval_track(const track_t *track, long long now_ms, bool interpolate)
+{
+	long long pos = (now_ms % track->period_ms) * track->count;
+	int i = pos / track->period_ms;
+	int frac = pos % track->period_ms;
+	int a = track->resolved[i];
+	int b = track->resolved[(i + 1) % track->count];
+
+	if (!interpolate)
+		return a;
+
+	return a + (int)((long long)(b - a) * frac / track->period_ms);
+}
+
+/* Evaluate tracks at the latest frame clock time */
+static bool
+update_layers(scene_t *scene)
+{
+	long long now_ms = scene->now_ms;
+	bool changed = false;
+	int i;
+
+	for (i = 0; i < scene->layer_count; i++) {
+		layer_t *layer = &scene->layers[i];
+		int dx = layer->dx, dy = layer->dy;
+		int alpha = layer->alpha, frame = layer->frame;
+
+		if (layer->tracks[PROP_X])
+			dx = eval_track(layer->tracks[PROP_X], now_ms, true);
+		if (layer->tracks[PROP_Y])
+			dy = eval_track(layer->tracks[PROP_Y], now_ms, true);
+		if (layer->tracks[PROP_ALPHA])
+			alpha = eval_track(layer->tracks[PROP_ALPHA], now_ms,
+					   true);
+		if (layer->tracks[PROP_FRAME])
+			frame = eval_track(layer->tracks[PROP_FRAME], now_ms,
+					   false);
+
+		if (alpha < 0)
+			alpha = 0;
+		else if (alpha > 255)
+			alpha = 255;
+
+		if (frame < 0 || frame >= layer->frame_count)
+			frame = 0;
+
+		if (dx != layer->dx || dy != layer->dy ||
+		    alpha != layer->alpha || frame != layer->frame) {
+			layer->dx = dx, layer->dy = dy;
+			layer->alpha = alpha, layer->frame = frame;
+			layer->dirty = true;
+		}
+
+		changed |= layer->dirty;
+	}
+
+	return changed;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+resolve_length(const length_t *len, int screen)
+{
+	return len->percent ? screen * len->value / 100 : len->value;
+}
+
+/* Sizes that are not positive are relative to the screen size */
+static int
+resolve_size(const length_t *len, int screen)
+{
+	int size = resolve_length(len, screen);
+
+	return size > 0 ? size : screen + size;
+}
+
+/* Convert everything that depends on the display size to pixels, so
+ * that drawing frames does not need to redo it. */
+static void
+resolve_layout(scene_t *scene, int fbw, int fbh)
+{
+	int i, j, fw, fh;
+
+	gr_font_size(&fw, &fh);
+
+	for (i = 0; i < scene->layer_count; i++) {
+		layer_t *layer = &scene->layers[i];
+		const char *text = layer->text ? layer->text : scene->text;
+		int w, h, x, y;
+
+		switch (layer->type) {
+		case LAYER_IMAGE:
+			w = layer->frames[0].src.x2 - layer->frames[0].src.x1;
+			h = layer->frames[0].src.y2 - layer->frames[0].src.y1;
+			break;
+		case LAYER_TEXT:
+			w = text ? gr_measure(text) : 0;
+			h = fh;
+			break;
+		default:
+			w = resolve_size(&layer->w, fbw);
+			h = resolve_size(&layer->h, fbh);
+			break;
+		}
+
+		x = layer->anchor_x * (fbw - w) / 2 +
+		    resolve_length(&layer->x, fbw);
+		y = layer->anchor_y * (fbh - h) / 2 +
+		    resolve_length(&layer->y, fbh);
+
+		layer->base = (GRRect){ x, y, x + w, y + h };
+
+		for (j = 0; j < PROP_COUNT; j++) {
+			track_t *track = layer->tracks[j];
+			int k, screen = (j == PROP_Y) ? fbh :
+					(j == PROP_X) ? fbw : 255;
+
+			for (k = 0; track && k < track->count; k++)
+				track->resolved[k] =
+					resolve_length(&track->keys[k], screen);
+		}
+
+		layer->dirty = true;
+	}
+
+	scene->mode_w = fbw;
+	scene->mode_h = fbh;
+
+	update_layers(scene);
+}
+
+/* ------------------------------------------------------------------------ */
+
+bool
+scene_tick(scene_t *scene, long long now_ms)
+{
+	scene->now_ms = now_ms;
+
+	/* Tracks can't be evaluated before layout is resolved */
+	if (!scene->mode_w)
+		return true;
+
+	return update_layers(scene);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+fill_clipped(GRRect r, const GRRect *clip, const unsigned char *rgba,
+	     int alpha)
+{
+	r = rect_intersect(r, *clip);
+	if (rect_is_empty(&r))
+		return;
+
+	gr_color(rgba[0], rgba[1], rgba[2], rgba[3] * alpha / 255);
+	gr_fill(r.x1, r.y1, r.x2, r.y2);
+}
+
+static void
+draw_layer(scene_t *scene, layer_t *layer, const GRRect *clip)
+{
+	GRRect r = rect_move(layer->base, layer->dx, layer->dy);
+	GRRect visible = rect_intersect(r, *clip);
+	const frame_t *frame;
+	const char *text;
+	GRRect src;
+	int split;
+
+	if (rect_is_empty(&visible))
+		return;
+
+	switch (layer->type) {
+	case LAYER_IMAGE:
+		/* Frames can differ in size, stay within the sprite */
+		frame = &layer->frames[layer->frame];
+		src = rect_intersect(rect_move(visible, frame->src.x1 - r.x1,
+					       frame->src.y1 - r.y1),
+				     frame->src);
+		if (!rect_is_empty(&src))
+			gr_blit_alpha(frame->surface, src.x1, src.y1,
+				      src.x2 - src.x1, src.y2 - src.y1,
+				      visible.x1, visible.y1, layer->alpha);
+		break;
+	case LAYER_TEXT:
+		/* Glyphs are drawn only when they fit entirely, the whole
+		 * layer is within clip (see grow_to_text()) */
+		text = layer->text ? layer->text : scene->text;
+		gr_color(layer->color[0], layer->color[1], layer->color[2],
+			 layer->color[3] * layer->alpha / 255);
+		gr_text(r.x1, r.y1, text, 1);
+		break;
+	case LAYER_PROGRESS:
+		split = r.x1 + (r.x2 - r.x1) * scene->progress / 100;
+		fill_clipped((GRRect){ r.x1, r.y1, split, r.y2 }, clip,
+			     layer->color, layer->alpha);
+		fill_clipped((GRRect){ split, r.y1, r.x2, r.y2 }, clip,
+			     layer->bg, layer->alpha);
+		break;
+	case LAYER_RECT:
+		fill_clipped(r, clip, layer->color, layer->alpha);
+		break;
+	}
+
+	layer->drawn = r;
+}
+
+/* Text can't be drawn in part. Grow area to cover every text layer it
+ * touches, so that no glyph is blended on top of itself. */
+static GRRect
+grow_to_text(const scene_t *scene, GRRect area)
+{
+	bool grown = true;
+	int i;
+
+	while (grown) {
+		grown = false;
+		for (i = 0; i < scene->layer_count; i++) {
+			const layer_t *layer = &scene->layers[i];
+			GRRect r = rect_move(layer->base, layer->dx, layer->dy);
+			GRRect hit = rect_intersect(r, area);
+			GRRect u;
+
+			if (layer->type != LAYER_TEXT || rect_is_empty(&hit))
+				continue;
+
+			u = rect_union(area, r);
+			if (memcmp(&u, &area, sizeof(u))) {
+				area = u;
+				grown = true;
+			}
+		}
+	}
+
+	return area;
+}
+
+void
+scene_draw(scene_t *scene, bool full)
+{
+	int fbw = gr_fb_width();
+	int fbh = gr_fb_height();
+	GRRect screen = { 0, 0, fbw, fbh };
+	GRRect damage = { 0, 0, 0, 0 }, area;
+	int i;
+
+	if (scene->mode_w != fbw || scene->mode_h != fbh) {
+		resolve_layout(scene, fbw, fbh);
+		full = true;
+	}
+
+	if (full) {
+		area = damage = screen;
+	} else {
+		for (i = 0; i < scene->layer_count; i++) {
+			layer_t *layer = &scene->layers[i];
+
+			if (!layer->dirty)
+				continue;
+
+			damage = rect_union(damage, layer->drawn);
+			damage = rect_union(damage,
+					    rect_move(layer->base,
+						      layer->dx, layer->dy));
+		}
+
+		damage = rect_intersect(damage, screen);
+		area = rect_union(damage, scene->prev_damage);
+		area = rect_intersect(grow_to_text(scene, area), screen);
+	}
+
+	scene->prev_damage = damage;
+
+	if (rect_is_empty(&area))
+		return;
+
+	gr_color(scene->bg[0], scene->bg[1], scene->bg[2], 255);
+	if (full)
+		gr_clear();
+	else
+		gr_fill(area.x1, area.y1, area.x2, area.y2);
+
+	for (i = 0; i < scene->layer_count; i++) {
+		draw_layer(scene, &scene->layers[i], &area);
+		scene->layers[i].dirty = false;
+	}
+}
@@ -0,0 +1,81 @@
+#ifndef _SCENE_H_
+#define _SCENE_H_
+
+#include <stdbool.h>
+
+/*
+ * Declarative splash layouts.
+ *
+ * A scene file describes the splash screen as a stack of layers that
+ * are drawn in file order. One statement per line, '#' starts a comment:
+ *
+ *   background RRGGBB
+ *   layer NAME TYPE [KEY=VALUE]...
+ *   track NAME PROPERTY PERIOD VALUE [VALUE]...
+ *
+ * Layer TYPE is one of image, text, progress or rect. Layer keys:
+ *
+ *   anchor=POS         top-left, top, top-right, left, center (default),
+ *                      right, bottom-left, bottom or bottom-right. The same
+ *                      point of the layer and of the screen are aligned.
+ *   x=OFS, y=OFS       offset from the anchor, in pixels or N% of screen
+ *   w=LEN, h=LEN       size of progress and rect layers, pixels or N%,
+ *                      zero or negative values are relative to screen size
+ *   image=NAME[,NAME]  frame(s) of an image layer, ATLAS:SPRITE for a
+ *                      sprite of atlas ATLAS (see atlas.h)
+ *   text="STRING"      content of a text layer, --text if not given
+ *   color=RRGGBB[AA]   text / rect color, done part of progress
+ *   bg=RRGGBB[AA]      remaining part of progress
+ *
+ * A track animates one PROPERTY of layer NAME: x, y, alpha or frame.
+ * The keyframe VALUEs are spread evenly over PERIOD milliseconds and the
+ * animation loops. Position and alpha are interpolated linearly.
+ *
+ * Example:
+ *
+ *   layer logo image image=logo y=-10%
+ *   layer bar progress anchor=bottom y=-40 w=80% h=10
+ *   track logo alpha 2000 255 64
+ */
+
+typedef struct scene scene_t;
+
+/*
+ * Parse scene file and load the images it refers to.
+ * @param path scene file
+ * @param dir directory with images
+ * @return scene, or NULL if the file could not be loaded
+ */
+scene_t *scene_load(const char *path, const char *dir);
+
+/* Free scene and the images it holds. */
+void scene_free(scene_t *scene);
+
+/*
+ * Check if frame clock updates are needed.
+ * @return true if the scene has animation tracks
+ */
+bool scene_is_animated(const scene_t *scene);
+
+/* Set text for text layers that do not define their own. */
+void scene_set_text(scene_t *scene, const char *text);
+
+/* Set percentage shown by progress layers. */
+void scene_set_progress(scene_t *scene, int percentage);
+
+/*
+ * Evaluate animation tracks.
+ * @param now_ms frame clock time in milliseconds
+ * @return true if some layer changed and needs to be drawn
+ */
+bool scene_tick(scene_t *scene, long long now_ms);
+
+/*
+ * Draw the scene. The layout is resolved against the display size on
+ * first use and whenever the display size changes.
+ * @param full true to redraw everything, false to redraw only the
+ *        areas touched by changed layers
+ */
+void scene_draw(scene_t *scene, bool full);
+
+#endif /* _SCENE_H_ */
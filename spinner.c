@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include "spinner.h"
+#include "minui/minui.h"
+
+#define WHEEL_DOTS      12
+#define WHEEL_PERIOD_MS 1200
+#define WHEEL_SIZE_MAX  96
+#define BAR_PERIOD_MS   1500
+#define BAR_SEGMENT     4    /* segment is 1/BAR_SEGMENT of the bar */
+
+/* Colors of progress bar done and remaining parts */
+#define BRIGHT 255
+#define DIM    84
+
+/* Dot positions clockwise from the top, 1000 is the wheel radius */
+static const int wheel_pos[WHEEL_DOTS][2] = {
+	{    0, -1000 }, {  500,  -866 }, {  866,  -500 },
+	{ 1000,     0 }, {  866,   500 }, {  500,   866 },
+	{    0,  1000 }, { -500,   866 }, { -866,   500 },
+	{-1000,     0 }, { -866,  -500 }, { -500,  -866 },
+};
+
+struct spinner {
+	spinner_style_t style;
+	int             x;        /* area drawn to */
+	int             y;
+	int             width;
+	int             height;
+	int             steps;
+	int             step;     /* current step, -1 before first tick */
+	gr_surface     *sprites;  /* wheel: one per step, bar: one strip */
+	int             sprite_count;
+};
+
+/* ------------------------------------------------------------------------ */
+
+/* Draw a dot of radius r centered at cx, cy as one fill per row */
+static void
+draw_dot(int cx, int cy, int r)
+{
+	GRRect rows[2 * WHEEL_SIZE_MAX];
+	int dy, half, n = 0;
+
+	for (dy = -r; dy <= r; dy++) {
+		for (half = r; half * half > r * r - dy * dy; half--)
+			;
+		rows[n++] = (GRRect){ cx - half, cy + dy,
+				      cx + half + 1, cy + dy + 1 };
+	}
+
+	gr_fill_rects(rows, n);
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Render wheel with the bright dot at step */
+static int
+render_wheel(gr_surface sprite, int size, int step)
+{
+	int r = size / 10 + 1;
+	int radius = size / 2 - r - 1;
+	int i, behind, level;
+
+	if (gr_set_draw_surface(sprite))
+		return -1;
+
+	gr_color(0, 0, 0, 255);
+	gr_clear();
+
+	/* Dots fade from bright at the head to dim at the tail */
+	for (i = 0; i < WHEEL_DOTS; i++) {
+		behind = (step - i + WHEEL_DOTS) % WHEEL_DOTS;
+		level = BRIGHT - (BRIGHT - DIM) * behind / (WHEEL_DOTS - 1);
+		gr_color(level, level, level, 255);
+		draw_dot(size / 2 + wheel_pos[i][0] * radius / 1000,
+			 size / 2 + wheel_pos[i][1] * radius / 1000, r);
+	}
+
+	gr_set_draw_surface(NULL);
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Render bar track with the segment in the middle. Drawing a window of
+ * the track width from different offsets slides the segment. */
+static int
+render_bar(gr_surface sprite, int width, int height, int segment)
+{
+	if (gr_set_draw_surface(sprite))
+		return -1;
+
+	gr_color(DIM, DIM, DIM, 255);
+	gr_clear();
+	gr_color(BRIGHT, BRIGHT, BRIGHT, 255);
+	gr_fill(width, 0, width + segment, height);
+
+	gr_set_draw_surface(NULL);
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+spinner_t *
+spinner_new(spinner_style_t style, int x, int y, int width, int height)
+{
+	spinner_t *spinner;
+	int i, segment = width / BAR_SEGMENT;
+
+	if (!(spinner = calloc(1, sizeof *spinner)))
+		return NULL;
+
+	spinner->style = style;
+	spinner->step = -1;
+
+	if (style == SPINNER_WHEEL) {
+		int size = width < height ? width : height;
+
+		if (size > WHEEL_SIZE_MAX)
+			size = WHEEL_SIZE_MAX;
+		if (size < 16)
+			goto fail;
+
+		spinner->x = x + (width - size) / 2;
+		spinner->y = y + (height - size) / 2;
+		spinner->width = spinner->height = size;
+		spinner->steps = WHEEL_DOTS;
+		spinner->sprite_count = WHEEL_DOTS;
+	} else {
+		if (segment < 1 || height < 1)
+			goto fail;
+
+		spinner->x = x;
+		spinner->y = y;
+		spinner->width = width;
+		spinner->height = height;
+		spinner->steps = width + segment + 1;
+		spinner->sprite_count = 1;
+	}
+
+	spinner->sprites = calloc(spinner->sprite_count,
+				  sizeof *spinner->sprites);
+	if (!spinner->sprites)
+		goto fail;
+
+	for (i = 0; i < spinner->sprite_count; i++) {
+		if (style == SPINNER_WHEEL) {
+			/* Square, width is the wheel size */
+			spinner->sprites[i] =
+				gr_new_surface(spinner->width, spinner->width);
+			if (!spinner->sprites[i] ||
+			    render_wheel(spinner->sprites[i], spinner->width,
+					 i) < 0)
+				goto fail;
+		} else {
+			spinner->sprites[i] =
+				gr_new_surface(2 * width + segment, height);
+			if (!spinner->sprites[i] ||
+			    render_bar(spinner->sprites[i], width, height,
+				       segment) < 0)
+				goto fail;
+		}
+	}
+
+	return spinner;
+
+fail:
+	spinner_free(spinner);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+spinner_free(spinner_t *spinner)
+{
+	int i;
+
+	if (!spinner)
+		return;
+
+	for (i = 0; spinner->sprites && i < spinner->sprite_count; i++)
+		if (spinner->sprites[i])
+			res_free_surface(spinner->sprites[i]);
+
+	free(spinner->sprites);
+	free(spinner);
+}
+
+/* ------------------------------------------------------------------------ */
+
+bool
+spinner_tick(spinner_t *spinner, long long now_ms)
+{
+	int period = spinner->style == SPINNER_WHEEL ? WHEEL_PERIOD_MS :
+		     BAR_PERIOD_MS;
+	int step = now_ms % period * spinner->steps / period;
+
+	if (step == spinner->step)
+		return false;
+
+	spinner->step = step;
+	return true;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+spinner_draw(const spinner_t *spinner)
+{
+	int step = spinner->step < 0 ? 0 : spinner->step;
+
+	if (spinner->style == SPINNER_WHEEL)
+		gr_blit(spinner->sprites[step], 0, 0, spinner->width,
+			spinner->height, spinner->x, spinner->y);
+	else
+		/* Segment enters from the left as the window moves left */
+		gr_blit(spinner->sprites[0],
+			spinner->steps - 1 - step, 0, spinner->width,
+			spinner->height, spinner->x, spinner->y);
+}
@@ -0,0 +1,43 @@
+#ifndef _SPINNER_H_
+#define _SPINNER_H_
+
+#include <stdbool.h>
+
+/*
+ * Busy indicators for work of unknown length.
+ *
+ * A wheel of dots where a bright dot goes round, or a bar where a
+ * segment slides from left to right. Every step of the animation is
+ * rendered once when the indicator is created. Drawing a step copies
+ * just the area of the indicator to the screen.
+ */
+
+typedef enum {
+	SPINNER_WHEEL,
+	SPINNER_BAR,
+} spinner_style_t;
+
+typedef struct spinner spinner_t;
+
+/*
+ * Create busy indicator filling an area of the screen. The wheel is
+ * centered in the area.
+ * @return indicator, or NULL if out of memory or the area is too small
+ */
+spinner_t *spinner_new(spinner_style_t style, int x, int y, int width,
+		       int height);
+
+/* Free busy indicator. */
+void spinner_free(spinner_t *spinner);
+
+/*
+ * Select animation step for a point of time.
+ * @param now_ms frame clock time in milliseconds
+ * @return true if the step changed and needs to be drawn
+ */
+bool spinner_tick(spinner_t *spinner, long long now_ms);
+
+/* Draw current animation step. */
+void spinner_draw(const spinner_t *spinner);
+
+#endif /* _SPINNER_H_ */
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measure blit copy throughput.
+ *
+ *   yamui-blitbench [WIDTH HEIGHT]
+ *
+ * Copies rectangles typical for yamui between buffers of the given
+ * display size (default 1080 x 2400) the way gr_blit() used to, with
+ * memcpy() per row, and with the copy paths it uses now. Results of
+ * every path are checked against memcpy().
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../minui/kernels.h"
+
+#define PIXEL_BYTES  4
+#define MIN_TIME_NS  200000000LL
+
+typedef void (*copy_fn)(unsigned char *, const unsigned char *, size_t);
+
+typedef struct {
+	const char *name;
+	int         w;
+	int         h;
+	int         src_stride; /* in pixels */
+	int         dst_stride;
+} rect_t;
+
+static unsigned char *src_buf;
+static unsigned char *dst_buf;
+static unsigned char *ref_buf;
+
+/* ------------------------------------------------------------------------ */
+
+static long long
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+copy_memcpy(unsigned char *dst, const unsigned char *src, size_t n)
+{
+	memcpy(dst, src, n);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+blit(const rect_t *r, copy_fn copy, int merge_rows, unsigned char *dst)
+{
+	size_t row = (size_t)r->w * PIXEL_BYTES;
+	const unsigned char *s = src_buf;
+	int i, h = r->h;
+
+	if (merge_rows && r->w == r->src_stride && r->w == r->dst_stride) {
+		row *= h;
+		h = 1;
+	}
+
+	for (i = 0; i < h; i++) {
+		copy(dst, s, row);
+		s += (size_t)r->src_stride * PIXEL_BYTES;
+		dst += (size_t)r->dst_stride * PIXEL_BYTES;
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+static double
+run(const rect_t *r, copy_fn copy, int merge_rows)
+{
+	long long start, elapsed;
+	long n = 0;
+
+	memset(dst_buf, 0, (size_t)r->dst_stride * r->h * PIXEL_BYTES);
+	blit(r, copy, merge_rows, dst_buf);
+	if (memcmp(dst_buf, ref_buf, (size_t)r->dst_stride * r->h *
+		   PIXEL_BYTES)) {
+		fprintf(stderr, "%s: wrong result\n", r->name);
+		exit(EXIT_FAILURE);
+	}
+
+	start = now_ns();
+	do {
+		blit(r, copy, merge_rows, dst_buf);
+		n++;
+	} while ((elapsed = now_ns() - start) < MIN_TIME_NS);
+
+	/* MB/s */
+	return (double)n * r->w * r->h * PIXEL_BYTES / elapsed * 1000;
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+main(int argc, char *argv[])
+{
+	int width = 1080, height = 2400;
+	size_t size;
+	int i;
+
+	if (argc == 3) {
+		width = atoi(argv[1]);
+		height = atoi(argv[2]);
+	}
+	if ((argc != 1 && argc != 3) || width < 64 || height < 64) {
+		fprintf(stderr, "Usage: %s [WIDTH HEIGHT]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const rect_t rects[] = {
+		{ "full frame", width, height, width, width },
+		{ "logo 400x400", 400, 400, 400, width },
+		{ "frame rows", width, 64, width + 16, width },
+		{ "glyph 10x18", 10, 18, 960, width },
+		{ "icon 32x32", 32, 32, 32, width },
+	};
+
+	size = (size_t)(width + 16) * height * PIXEL_BYTES;
+	src_buf = malloc(size);
+	dst_buf = malloc(size);
+	ref_buf = malloc(size);
+	if (!src_buf || !dst_buf || !ref_buf)
+		return EXIT_FAILURE;
+
+	for (i = 0; i < (int)size; i++)
+		src_buf[i] = i * 31 + (i >> 11);
+
+	printf("kernels: %s, MB/s\n", gr_kernels->name);
+	printf("%-14s %10s %10s %10s\n", "rect", "memcpy", "copy",
+	       "stream");
+
+	for (i = 0; i < (int)(sizeof rects / sizeof *rects); i++) {
+		const rect_t *r = &rects[i];
+
+		memset(ref_buf, 0, (size_t)r->dst_stride * r->h * PIXEL_BYTES);
+		blit(r, copy_memcpy, 0, ref_buf);
+
+		printf("%-14s %10.0f %10.0f %10.0f\n", r->name,
+		       run(r, copy_memcpy, 0),
+		       run(r, gr_kernels->copy, 1),
+		       run(r, gr_kernels->stream, 1));
+	}
+
+	free(src_buf);
+	free(dst_buf);
+	free(ref_buf);
+
+	return EXIT_SUCCESS;
+}
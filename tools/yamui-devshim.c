@@ -0,0 +1,1257 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Emulated display devices for running the fbdev and DRM backends on a
+ * build host.
+ *
+ *   YAMUI_DEVSHIM=OPTIONS LD_PRELOAD=tools/yamui-devshim.so yamui ...
+ *
+ * open() of /dev/fb0 and /dev/graphics/fb0, or of /dev/dri/card0, gets
+ * an emulated device, and its ioctl() and mmap() calls are answered
+ * here. /dev/tty0 is hidden so that the host console is left alone.
+ * OPTIONS is a comma separated list of
+ *
+ *   fb=WxH          emulate a framebuffer device of that size
+ *   fb_buffers=N    framebuffer memory holds N screens, default 2
+ *   fb_cmap=1       directcolor visual with a color map
+ *   fb_bpp=16       RGB565 framebuffer instead of 32 bpp
+ *   drm=WxH         emulate a DRM device, the default with 1080x2400
+ *   hz=R[:R...]     refresh rates of the connector modes, the first one
+ *                   preferred, default 60
+ *   planes=N        0 to 2: primary and overlay plane, default 2
+ *   rotation=0      primary plane can't rotate
+ *   dpms=0          connector has no DPMS property
+ *   gamma=N         gamma table size, default 256, 0 for none
+ *   pad=N           bytes of padding at the end of buffer rows
+ *   fail=NAME[@N]   fail ioctl NAME with EBUSY, N times or always
+ *   cost=NAME:US    ioctl NAME takes US microseconds
+ *   flip_busy=1     page flips fail with EBUSY instead of waiting
+ *                   while the previous flip is pending
+ *   trace=1         print every ioctl
+ *
+ * NAMEs are the ones printed with trace=1, e.g. SETCRTC or
+ * FBIOPUT_VSCREENINFO. Page flips complete at the next vblank of the
+ * current mode, flipping again before that waits for it or fails with
+ * EBUSY, and fails with EINVAL while DPMS is off. Setting a mode with a
+ * buffer smaller than it fails with ENOSPC. Importing the same file
+ * again gives the handle it already has, like with real dma-bufs, and
+ * closing a handle twice fails with ENOENT.
+ *
+ * Counts and time spent in each ioctl are printed at exit.
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/fb.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <drm_fourcc.h>
+
+#define SHIM_ENV     "YAMUI_DEVSHIM"
+#define MODES_MAX    4
+#define BUFFERS_MAX  32
+#define RULES_MAX    16
+
+/* Object ids of the emulated DRM device */
+#define CONNECTOR_ID 10
+#define ENCODER_ID   20
+#define CRTC_ID      30
+#define PLANE_ID     40 /* primary, overlay is next */
+#define PROP_TYPE    50
+#define PROP_ROT     51
+#define PROP_DPMS    52
+#define FB_ID_BASE   100
+
+#define DSI_CONNECTOR 16
+
+#define PTR(p) ((void *)(uintptr_t)(p))
+
+typedef enum {
+	DEV_NONE,
+	DEV_FB,
+	DEV_DRM,
+} device_t;
+
+typedef struct {
+	unsigned long request;
+	const char   *name;
+	long          calls;
+	long long     ns;
+	int           fail;     /* times left to fail, -1 always */
+	long long     cost_ns;
+} ioctl_info_t;
+
+typedef struct {
+	uint32_t handle;   /* 0 if unused */
+	int      memfd;    /* -1 for imported buffers */
+	uint32_t width;
+	uint32_t height;
+	uint32_t pitch;
+	uint64_t size;
+	dev_t    dev;      /* file of imported buffers */
+	ino_t    ino;
+} buffer_t;
+
+typedef struct {
+	uint32_t fb_id;    /* 0 if unused */
+	uint32_t handle;
+	uint32_t width;
+	uint32_t height;
+} fb_t;
+
+static ioctl_info_t ioctls[] = {
+	{ FBIOGET_VSCREENINFO,              "FBIOGET_VSCREENINFO" },
+	{ FBIOPUT_VSCREENINFO,              "FBIOPUT_VSCREENINFO" },
+	{ FBIOGET_FSCREENINFO,              "FBIOGET_FSCREENINFO" },
+	{ FBIOGETCMAP,                      "FBIOGETCMAP" },
+	{ FBIOPUTCMAP,                      "FBIOPUTCMAP" },
+	{ FBIOPAN_DISPLAY,                  "FBIOPAN_DISPLAY" },
+	{ FBIOBLANK,                        "FBIOBLANK" },
+	{ DRM_IOCTL_GET_CAP,                "GET_CAP" },
+	{ DRM_IOCTL_SET_CLIENT_CAP,         "SET_CLIENT_CAP" },
+	{ DRM_IOCTL_GEM_CLOSE,              "GEM_CLOSE" },
+	{ DRM_IOCTL_PRIME_FD_TO_HANDLE,     "PRIME_FD_TO_HANDLE" },
+	{ DRM_IOCTL_MODE_GETRESOURCES,      "GETRESOURCES" },
+	{ DRM_IOCTL_MODE_GETCRTC,           "GETCRTC" },
+	{ DRM_IOCTL_MODE_SETCRTC,           "SETCRTC" },
+	{ DRM_IOCTL_MODE_GETGAMMA,          "GETGAMMA" },
+	{ DRM_IOCTL_MODE_SETGAMMA,          "SETGAMMA" },
+	{ DRM_IOCTL_MODE_GETENCODER,        "GETENCODER" },
+	{ DRM_IOCTL_MODE_GETCONNECTOR,      "GETCONNECTOR" },
+	{ DRM_IOCTL_MODE_GETPROPERTY,       "GETPROPERTY" },
+	{ DRM_IOCTL_MODE_RMFB,              "RMFB" },
+	{ DRM_IOCTL_MODE_PAGE_FLIP,         "PAGE_FLIP" },
+	{ DRM_IOCTL_MODE_CREATE_DUMB,       "CREATE_DUMB" },
+	{ DRM_IOCTL_MODE_MAP_DUMB,          "MAP_DUMB" },
+	{ DRM_IOCTL_MODE_DESTROY_DUMB,      "DESTROY_DUMB" },
+	{ DRM_IOCTL_MODE_GETPLANERESOURCES, "GETPLANERESOURCES" },
+	{ DRM_IOCTL_MODE_GETPLANE,          "GETPLANE" },
+	{ DRM_IOCTL_MODE_SETPLANE,          "SETPLANE" },
+	{ DRM_IOCTL_MODE_ADDFB2,            "ADDFB2" },
+	{ DRM_IOCTL_MODE_OBJ_GETPROPERTIES, "OBJ_GETPROPERTIES" },
+	{ DRM_IOCTL_MODE_OBJ_SETPROPERTY,   "OBJ_SETPROPERTY" },
+};
+
+#define IOCTL_COUNT ((int)(sizeof ioctls / sizeof *ioctls))
+
+/* Configuration */
+static struct {
+	int  fb_width, fb_height;
+	int  fb_buffers;
+	int  fb_cmap;
+	int  fb_bpp;
+	int  drm_width, drm_height;
+	int  hz[MODES_MAX];
+	int  modes;
+	int  planes;
+	int  rotation;
+	int  dpms;
+	int  gamma;
+	int  pad;
+	int  flip_busy;
+	int  trace;
+} cfg;
+
+/* Real libc functions */
+static int   (*real_open)(const char *, int, ...);
+static int   (*real_open64)(const char *, int, ...);
+static int   (*real_openat)(int, const char *, int, ...);
+static int   (*real_close)(int);
+static int   (*real_ioctl)(int, unsigned long, ...);
+static void *(*real_mmap)(void *, size_t, int, int, int, off_t);
+static void *(*real_mmap64)(void *, size_t, int, int, int, off64_t);
+
+/* Emulated devices, fd of each or -1 */
+static int fb_fd = -1;
+static int drm_fd = -1;
+
+/* fbdev state */
+static struct fb_var_screeninfo fb_var;
+static struct fb_fix_screeninfo fb_fix;
+static __u16 *fb_cmap_data;
+
+/* DRM state */
+static drmModeModeInfo modes[MODES_MAX];
+static buffer_t buffers[BUFFERS_MAX];
+static fb_t fbs[BUFFERS_MAX];
+static uint32_t next_handle = 1;
+static uint32_t next_fb_id = FB_ID_BASE;
+static uint32_t crtc_fb;
+static drmModeModeInfo crtc_mode;
+static int crtc_mode_valid;
+static long long flip_done_ns;   /* vblank of the pending flip */
+static uint64_t rotation = DRM_MODE_ROTATE_0;
+static uint64_t dpms = DRM_MODE_DPMS_ON;
+static uint16_t *gamma_lut;
+
+/* ------------------------------------------------------------------------ */
+
+static long long
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static ioctl_info_t *
+find_ioctl_name(const char *name, size_t len)
+{
+	int i;
+
+	for (i = 0; i < IOCTL_COUNT; i++)
+		if (strlen(ioctls[i].name) == len &&
+		    !strncmp(ioctls[i].name, name, len))
+			return &ioctls[i];
+
+	fprintf(stderr, "%s: unknown ioctl %.*s\n", SHIM_ENV, (int)len,
+		name);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+parse_rule(const char *value, int fail)
+{
+	const char *sep = strchr(value, fail ? '@' : ':');
+	size_t len = sep ? (size_t)(sep - value) : strlen(value);
+	ioctl_info_t *info = find_ioctl_name(value, len);
+
+	if (!info)
+		return;
+
+	if (fail)
+		info->fail = sep ? atoi(sep + 1) : -1;
+	else if (sep)
+		info->cost_ns = atoll(sep + 1) * 1000;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+parse_config(void)
+{
+	const char *env = getenv(SHIM_ENV);
+	char *copy, *option, *save = NULL;
+
+	cfg.fb_buffers = 2;
+	cfg.fb_bpp = 32;
+	cfg.planes = 2;
+	cfg.rotation = 1;
+	cfg.dpms = 1;
+	cfg.gamma = 256;
+
+	if (env && (copy = strdup(env))) {
+		for (option = strtok_r(copy, ",", &save); option;
+		     option = strtok_r(NULL, ",", &save)) {
+			char *value = strchr(option, '=');
+			char *rate;
+
+			if (!value) {
+				fprintf(stderr, "%s: bad option %s\n",
+					SHIM_ENV, option);
+				continue;
+			}
+			*value++ = 0;
+
+			if (!strcmp(option, "fb"))
+				sscanf(value, "%dx%d", &cfg.fb_width,
+				       &cfg.fb_height);
+			else if (!strcmp(option, "fb_buffers"))
+				cfg.fb_buffers = atoi(value);
+			else if (!strcmp(option, "fb_cmap"))
+				cfg.fb_cmap = atoi(value);
+			else if (!strcmp(option, "fb_bpp"))
+				cfg.fb_bpp = atoi(value) == 16 ? 16 : 32;
+			else if (!strcmp(option, "drm"))
+				sscanf(value, "%dx%d", &cfg.drm_width,
+				       &cfg.drm_height);
+			else if (!strcmp(option, "hz"))
+				for (rate = strtok(value, ":");
+				     rate && cfg.modes < MODES_MAX;
+				     rate = strtok(NULL, ":"))
+					cfg.hz[cfg.modes++] = atoi(rate);
+			else if (!strcmp(option, "planes"))
+				cfg.planes = atoi(value);
+			else if (!strcmp(option, "rotation"))
+				cfg.rotation = atoi(value);
+			else if (!strcmp(option, "dpms"))
+				cfg.dpms = atoi(value);
+			else if (!strcmp(option, "gamma"))
+				cfg.gamma = atoi(value);
+			else if (!strcmp(option, "pad"))
+				cfg.pad = atoi(value);
+			else if (!strcmp(option, "fail"))
+				parse_rule(value, 1);
+			else if (!strcmp(option, "cost"))
+				parse_rule(value, 0);
+			else if (!strcmp(option, "flip_busy"))
+				cfg.flip_busy = atoi(value);
+			else if (!strcmp(option, "trace"))
+				cfg.trace = atoi(value);
+			else
+				fprintf(stderr, "%s: unknown option %s\n",
+					SHIM_ENV, option);
+		}
+		free(copy);
+	}
+
+	if (!cfg.fb_width && !cfg.drm_width) {
+		cfg.drm_width = 1080;
+		cfg.drm_height = 2400;
+	}
+	if (!cfg.modes)
+		cfg.hz[cfg.modes++] = 60;
+	if (cfg.fb_buffers < 1)
+		cfg.fb_buffers = 1;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+make_modes(void)
+{
+	int i;
+
+	for (i = 0; i < cfg.modes; i++) {
+		drmModeModeInfo *mode = &modes[i];
+
+		memset(mode, 0, sizeof(*mode));
+		mode->hdisplay = cfg.drm_width;
+		mode->hsync_start = cfg.drm_width + 16;
+		mode->hsync_end = cfg.drm_width + 32;
+		mode->htotal = cfg.drm_width + 64;
+		mode->vdisplay = cfg.drm_height;
+		mode->vsync_start = cfg.drm_height + 4;
+		mode->vsync_end = cfg.drm_height + 8;
+		mode->vtotal = cfg.drm_height + 16;
+		mode->vrefresh = cfg.hz[i];
+		mode->clock = (uint64_t)mode->htotal * mode->vtotal *
+			      mode->vrefresh / 1000;
+		mode->type = i ? 0 : DRM_MODE_TYPE_PREFERRED;
+		snprintf(mode->name, sizeof(mode->name), "%dx%d",
+			 cfg.drm_width, cfg.drm_height);
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+__attribute__((constructor)) static void
+shim_init(void)
+{
+	real_open = dlsym(RTLD_NEXT, "open");
+	real_open64 = dlsym(RTLD_NEXT, "open64");
+	real_openat = dlsym(RTLD_NEXT, "openat");
+	real_close = dlsym(RTLD_NEXT, "close");
+	real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+	real_mmap = dlsym(RTLD_NEXT, "mmap");
+	real_mmap64 = dlsym(RTLD_NEXT, "mmap64");
+
+	parse_config();
+	make_modes();
+}
+
+/* ------------------------------------------------------------------------ */
+
+__attribute__((destructor)) static void
+shim_exit(void)
+{
+	int i;
+
+	fprintf(stderr, "%-20s %8s %12s\n", "ioctl", "calls", "ms");
+	for (i = 0; i < IOCTL_COUNT; i++)
+		if (ioctls[i].calls)
+			fprintf(stderr, "%-20s %8ld %12.3f\n", ioctls[i].name,
+				ioctls[i].calls, ioctls[i].ns / 1e6);
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Emulated device for path, or DEV_NONE with hidden set if the path
+ * should not exist */
+static device_t
+device_for(const char *path, int *hidden)
+{
+	*hidden = 0;
+
+	if (!strcmp(path, "/dev/fb0") || !strcmp(path, "/dev/graphics/fb0")) {
+		if (cfg.fb_width)
+			return DEV_FB;
+		*hidden = 1;
+	} else if (!strncmp(path, "/dev/dri/card", 13)) {
+		if (cfg.drm_width && !strcmp(path + 13, "0"))
+			return DEV_DRM;
+		*hidden = 1;
+	} else if (!strcmp(path, "/dev/tty0")) {
+		*hidden = 1;
+	}
+
+	return DEV_NONE;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+open_fb(void)
+{
+	size_t line = (size_t)cfg.fb_width * (cfg.fb_bpp / 8) + cfg.pad;
+	size_t size = line * cfg.fb_height * cfg.fb_buffers;
+	int fd;
+
+	/* Framebuffer memory, mapped with the device fd */
+	if ((fd = memfd_create("fb0", 0)) < 0)
+		return -1;
+	if (ftruncate(fd, size) < 0) {
+		real_close(fd);
+		return -1;
+	}
+
+	memset(&fb_fix, 0, sizeof(fb_fix));
+	strcpy(fb_fix.id, "yamui-devshim");
+	fb_fix.smem_len = size;
+	fb_fix.type = FB_TYPE_PACKED_PIXELS;
+	fb_fix.visual = cfg.fb_cmap ? FB_VISUAL_DIRECTCOLOR :
+				      FB_VISUAL_TRUECOLOR;
+	fb_fix.line_length = line;
+
+	memset(&fb_var, 0, sizeof(fb_var));
+	fb_var.xres = fb_var.xres_virtual = cfg.fb_width;
+	fb_var.yres = fb_var.yres_virtual = cfg.fb_height;
+	fb_var.bits_per_pixel = cfg.fb_bpp;
+	if (cfg.fb_bpp == 16) {
+		fb_var.red.offset = 11;
+		fb_var.red.length = 5;
+		fb_var.green.offset = 5;
+		fb_var.green.length = 6;
+		fb_var.blue.offset = 0;
+		fb_var.blue.length = 5;
+	} else {
+		fb_var.red.offset = 16;
+		fb_var.red.length = 8;
+		fb_var.green.offset = 8;
+		fb_var.green.length = 8;
+		fb_var.blue.offset = 0;
+		fb_var.blue.length = 8;
+	}
+
+	fb_fd = fd;
+	return fd;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+open_device(const char *path, int flags, mode_t mode,
+	    int (*real)(const char *, int, ...))
+{
+	int hidden;
+	device_t dev = device_for(path, &hidden);
+
+	if (dev == DEV_FB && fb_fd == -1)
+		return open_fb();
+
+	if (dev == DEV_DRM && drm_fd == -1) {
+		drm_fd = real("/dev/null", O_RDWR);
+		return drm_fd;
+	}
+
+	if (dev != DEV_NONE || hidden) {
+		errno = dev != DEV_NONE ? EBUSY : ENOENT;
+		return -1;
+	}
+
+	return real(path, flags, mode);
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+open(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list ap;
+
+	if (flags & (O_CREAT | O_TMPFILE)) {
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+
+	return open_device(path, flags, mode, real_open);
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+open64(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list ap;
+
+	if (flags & (O_CREAT | O_TMPFILE)) {
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+
+	return open_device(path, flags, mode, real_open64);
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+openat(int dirfd, const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list ap;
+	int hidden;
+
+	if (flags & (O_CREAT | O_TMPFILE)) {
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+
+	if (path[0] == '/' &&
+	    (device_for(path, &hidden) != DEV_NONE || hidden))
+		return open_device(path, flags, mode, real_open);
+
+	return real_openat(dirfd, path, flags, mode);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+free_buffers(void)
+{
+	int i;
+
+	for (i = 0; i < BUFFERS_MAX; i++) {
+		if (buffers[i].handle && buffers[i].memfd >= 0)
+			real_close(buffers[i].memfd);
+		memset(&buffers[i], 0, sizeof(buffers[i]));
+		memset(&fbs[i], 0, sizeof(fbs[i]));
+	}
+	crtc_fb = 0;
+	crtc_mode_valid = 0;
+	flip_done_ns = 0;
+	rotation = DRM_MODE_ROTATE_0;
+	dpms = DRM_MODE_DPMS_ON;
+	free(gamma_lut), gamma_lut = NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+close(int fd)
+{
+	if (fd >= 0 && fd == fb_fd) {
+		fb_fd = -1;
+		free(fb_cmap_data), fb_cmap_data = NULL;
+	} else if (fd >= 0 && fd == drm_fd) {
+		drm_fd = -1;
+		free_buffers();
+	}
+
+	return real_close(fd);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static buffer_t *
+find_buffer(uint32_t handle)
+{
+	int i;
+
+	for (i = 0; handle && i < BUFFERS_MAX; i++)
+		if (buffers[i].handle == handle)
+			return &buffers[i];
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static buffer_t *
+find_import(const struct stat *st)
+{
+	int i;
+
+	for (i = 0; i < BUFFERS_MAX; i++)
+		if (buffers[i].handle && buffers[i].memfd < 0 &&
+		    buffers[i].dev == st->st_dev &&
+		    buffers[i].ino == st->st_ino)
+			return &buffers[i];
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static buffer_t *
+alloc_buffer(void)
+{
+	int i;
+
+	for (i = 0; i < BUFFERS_MAX; i++)
+		if (!buffers[i].handle)
+			return &buffers[i];
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static fb_t *
+find_fb(uint32_t fb_id)
+{
+	int i;
+
+	for (i = 0; fb_id && i < BUFFERS_MAX; i++)
+		if (fbs[i].fb_id == fb_id)
+			return &fbs[i];
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Copy count items to user array ptr if it has room for them, like
+ * the kernel does, and report the count */
+static void
+copy_out(uint64_t ptr, uint32_t *user_count, const void *items,
+	 uint32_t count, size_t item_size)
+{
+	if (ptr && *user_count >= count)
+		memcpy(PTR(ptr), items, count * item_size);
+	*user_count = count;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+fb_ioctl(unsigned long request, void *arg)
+{
+	struct fb_var_screeninfo *var = arg;
+	struct fb_cmap *cmap = arg;
+	__u32 len = 256;
+
+	switch (request) {
+	case FBIOGET_FSCREENINFO:
+		memcpy(arg, &fb_fix, sizeof(fb_fix));
+		return 0;
+	case FBIOGET_VSCREENINFO:
+		memcpy(arg, &fb_var, sizeof(fb_var));
+		return 0;
+	case FBIOPUT_VSCREENINFO:
+	case FBIOPAN_DISPLAY:
+		if (var->xres != fb_var.xres || var->yres != fb_var.yres ||
+		    var->bits_per_pixel != fb_var.bits_per_pixel ||
+		    var->yres_virtual > fb_var.yres * cfg.fb_buffers ||
+		    var->yoffset + var->yres > var->yres_virtual)
+			return -EINVAL;
+		if (request == FBIOPUT_VSCREENINFO)
+			fb_var = *var;
+		fb_var.yoffset = var->yoffset;
+		return 0;
+	case FBIOBLANK:
+		return 0;
+	case FBIOGETCMAP:
+	case FBIOPUTCMAP:
+		if (!cfg.fb_cmap || cmap->start + cmap->len > len)
+			return -EINVAL;
+		if (!fb_cmap_data) {
+			__u32 i;
+
+			if (!(fb_cmap_data = calloc(3 * len,
+						    sizeof(*fb_cmap_data))))
+				return -ENOMEM;
+			for (i = 0; i < 3 * len; i++)
+				fb_cmap_data[i] = (i % len) * 0x101;
+		}
+		if (request == FBIOGETCMAP) {
+			memcpy(cmap->red, fb_cmap_data + cmap->start,
+			       cmap->len * 2);
+			memcpy(cmap->green, fb_cmap_data + len + cmap->start,
+			       cmap->len * 2);
+			memcpy(cmap->blue,
+			       fb_cmap_data + 2 * len + cmap->start,
+			       cmap->len * 2);
+		} else {
+			memcpy(fb_cmap_data + cmap->start, cmap->red,
+			       cmap->len * 2);
+			memcpy(fb_cmap_data + len + cmap->start, cmap->green,
+			       cmap->len * 2);
+			memcpy(fb_cmap_data + 2 * len + cmap->start,
+			       cmap->blue, cmap->len * 2);
+		}
+		return 0;
+	}
+
+	return -ENOTTY;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+drm_get_connector(struct drm_mode_get_connector *conn)
+{
+	uint32_t encoder = ENCODER_ID;
+
+	if (conn->connector_id != CONNECTOR_ID)
+		return -ENOENT;
+
+	copy_out(conn->modes_ptr, &conn->count_modes, modes, cfg.modes,
+		 sizeof(*modes));
+	copy_out(conn->encoders_ptr, &conn->count_encoders, &encoder, 1,
+		 sizeof(encoder));
+	conn->count_props = 0;
+	conn->encoder_id = ENCODER_ID;
+	conn->connector_type = DSI_CONNECTOR;
+	conn->connector_type_id = 1;
+	conn->connection = DRM_MODE_CONNECTED;
+	conn->mm_width = 70;
+	conn->mm_height = 150;
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+drm_set_crtc(struct drm_mode_crtc *crtc)
+{
+	drmModeModeInfo *mode = (drmModeModeInfo *)&crtc->mode;
+	fb_t *fb;
+	int i;
+
+	if (crtc->crtc_id != CRTC_ID)
+		return -ENOENT;
+
+	/* Disable */
+	if (!crtc->fb_id && !crtc->mode_valid) {
+		crtc_fb = 0;
+		crtc_mode_valid = 0;
+		return 0;
+	}
+
+	if (!(fb = find_fb(crtc->fb_id)))
+		return -ENOENT;
+
+	for (i = 0; i < cfg.modes; i++)
+		if (!memcmp(&modes[i], mode, sizeof(*mode)))
+			break;
+	if (i == cfg.modes)
+		return -EINVAL;
+
+	if (fb->width < mode->hdisplay + crtc->x ||
+	    fb->height < mode->vdisplay + crtc->y)
+		return -ENOSPC;
+
+	crtc_fb = crtc->fb_id;
+	crtc_mode = *mode;
+	crtc_mode_valid = 1;
+	flip_done_ns = 0;
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+drm_page_flip(struct drm_mode_crtc_page_flip *flip)
+{
+	long long now = now_ns(), period;
+	struct timespec ts;
+
+	if (flip->crtc_id != CRTC_ID)
+		return -ENOENT;
+	if (!crtc_mode_valid || dpms != DRM_MODE_DPMS_ON)
+		return -EINVAL;
+	if (!find_fb(flip->fb_id))
+		return -ENOENT;
+
+	if (now < flip_done_ns) {
+		if (cfg.flip_busy)
+			return -EBUSY;
+		ts.tv_sec = flip_done_ns / 1000000000;
+		ts.tv_nsec = flip_done_ns % 1000000000;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		now = now_ns();
+	}
+
+	/* Shown at the next vblank */
+	period = 1000000000LL / crtc_mode.vrefresh;
+	flip_done_ns = (now / period + 1) * period;
+	crtc_fb = flip->fb_id;
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+drm_create_dumb(struct drm_mode_create_dumb *create)
+{
+	buffer_t *buffer = alloc_buffer();
+
+	if (!buffer)
+		return -ENOMEM;
+	if (!create->width || !create->height || create->bpp != 32)
+		return -EINVAL;
+
+	buffer->width = create->width;
+	buffer->height = create->height;
+	buffer->pitch = create->width * 4 + cfg.pad;
+	buffer->size = (uint64_t)buffer->pitch * create->height;
+
+	if ((buffer->memfd = memfd_create("dumb", 0)) < 0)
+		return -errno;
+	if (ftruncate(buffer->memfd, buffer->size) < 0) {
+		real_close(buffer->memfd);
+		return -ENOMEM;
+	}
+
+	buffer->handle = next_handle++;
+	create->handle = buffer->handle;
+	create->pitch = buffer->pitch;
+	create->size = buffer->size;
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+drm_add_fb2(struct drm_mode_fb_cmd2 *cmd)
+{
+	buffer_t *buffer = find_buffer(cmd->handles[0]);
+	int i;
+
+	if (!buffer)
+		return -ENOENT;
+
+	/* Imported buffers have no size of their own */
+	if (buffer->memfd >= 0 &&
+	    (cmd->pitches[0] < cmd->width * 4 ||
+	     (uint64_t)cmd->pitches[0] * cmd->height > buffer->size))
+		return -EINVAL;
+
+	for (i = 0; i < BUFFERS_MAX; i++) {
+		if (fbs[i].fb_id)
+			continue;
+		fbs[i].fb_id = next_fb_id++;
+		fbs[i].handle = cmd->handles[0];
+		fbs[i].width = cmd->width;
+		fbs[i].height = cmd->height;
+		cmd->fb_id = fbs[i].fb_id;
+		return 0;
+	}
+
+	return -ENOMEM;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+drm_get_plane(struct drm_mode_get_plane *plane)
+{
+	uint32_t format = DRM_FORMAT_XBGR8888;
+
+	if (plane->plane_id < PLANE_ID ||
+	    plane->plane_id >= PLANE_ID + (uint32_t)cfg.planes)
+		return -ENOENT;
+
+	plane->crtc_id = plane->plane_id == PLANE_ID && crtc_mode_valid ?
+			 CRTC_ID : 0;
+	plane->fb_id = plane->crtc_id ? crtc_fb : 0;
+	plane->possible_crtcs = 1;
+	plane->gamma_size = 0;
+	copy_out(plane->format_type_ptr, &plane->count_format_types,
+		 &format, 1, sizeof(format));
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+drm_set_plane(struct drm_mode_set_plane *plane)
+{
+	fb_t *fb;
+
+	if (plane->plane_id < PLANE_ID ||
+	    plane->plane_id >= PLANE_ID + (uint32_t)cfg.planes)
+		return -ENOENT;
+
+	/* Disable */
+	if (!plane->fb_id)
+		return 0;
+
+	if (plane->crtc_id != CRTC_ID || !crtc_mode_valid)
+		return -EINVAL;
+	if (!(fb = find_fb(plane->fb_id)))
+		return -ENOENT;
+	if (plane->src_x + plane->src_w > fb->width << 16 ||
+	    plane->src_y + plane->src_h > fb->height << 16)
+		return -ENOSPC;
+
+	if (plane->plane_id == PLANE_ID)
+		crtc_fb = plane->fb_id;
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+drm_get_properties(struct drm_mode_obj_get_properties *props)
+{
+	uint32_t ids[2] = { PROP_TYPE, PROP_ROT };
+	uint64_t values[2];
+	uint32_t count, plane = props->obj_id - PLANE_ID;
+
+	if (props->obj_type == DRM_MODE_OBJECT_CONNECTOR &&
+	    props->obj_id == CONNECTOR_ID && cfg.dpms) {
+		ids[0] = PROP_DPMS;
+		values[0] = dpms;
+		count = 1;
+	} else if (props->obj_type == DRM_MODE_OBJECT_PLANE &&
+		   plane < (uint32_t)cfg.planes) {
+		values[0] = plane ? DRM_PLANE_TYPE_OVERLAY :
+				    DRM_PLANE_TYPE_PRIMARY;
+		values[1] = rotation;
+		count = !plane && cfg.rotation ? 2 : 1;
+	} else {
+		props->count_props = 0;
+		return 0;
+	}
+
+	if (props->props_ptr && props->count_props >= count) {
+		memcpy(PTR(props->props_ptr), ids, count * sizeof(*ids));
+		memcpy(PTR(props->prop_values_ptr), values,
+		       count * sizeof(*values));
+	}
+	props->count_props = count;
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+drm_get_property(struct drm_mode_get_property *prop)
+{
+	if (prop->prop_id == PROP_TYPE) {
+		strcpy(prop->name, "type");
+		prop->flags = DRM_MODE_PROP_ENUM;
+	} else if (prop->prop_id == PROP_ROT) {
+		strcpy(prop->name, "rotation");
+		prop->flags = DRM_MODE_PROP_BITMASK;
+	} else if (prop->prop_id == PROP_DPMS) {
+		strcpy(prop->name, "DPMS");
+		prop->flags = DRM_MODE_PROP_ENUM;
+	} else {
+		return -ENOENT;
+	}
+
+	prop->count_values = 0;
+	prop->count_enum_blobs = 0;
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+drm_gamma(unsigned long request, struct drm_mode_crtc_lut *lut)
+{
+	size_t size = cfg.gamma * sizeof(*gamma_lut);
+	int i;
+
+	if (lut->crtc_id != CRTC_ID)
+		return -ENOENT;
+	if (!cfg.gamma || lut->gamma_size != (uint32_t)cfg.gamma)
+		return -EINVAL;
+
+	if (!gamma_lut) {
+		if (!(gamma_lut = calloc(3, size)))
+			return -ENOMEM;
+		for (i = 0; i < 3 * cfg.gamma; i++)
+			gamma_lut[i] = (i % cfg.gamma) * 0xffff /
+				       (cfg.gamma - 1);
+	}
+
+	if (request == DRM_IOCTL_MODE_GETGAMMA) {
+		memcpy(PTR(lut->red), gamma_lut, size);
+		memcpy(PTR(lut->green), gamma_lut + cfg.gamma, size);
+		memcpy(PTR(lut->blue), gamma_lut + 2 * cfg.gamma, size);
+	} else {
+		memcpy(gamma_lut, PTR(lut->red), size);
+		memcpy(gamma_lut + cfg.gamma, PTR(lut->green), size);
+		memcpy(gamma_lut + 2 * cfg.gamma, PTR(lut->blue), size);
+	}
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+drm_ioctl(unsigned long request, void *arg)
+{
+	uint32_t crtc = CRTC_ID, connector = CONNECTOR_ID;
+	uint32_t encoder = ENCODER_ID;
+	uint32_t planes[2] = { PLANE_ID, PLANE_ID + 1 };
+	struct drm_mode_card_res *res = arg;
+	struct drm_mode_crtc *get_crtc = arg;
+	struct drm_mode_get_encoder *enc = arg;
+	struct drm_mode_get_plane_res *plane_res = arg;
+	struct drm_get_cap *cap = arg;
+	struct drm_mode_map_dumb *map = arg;
+	struct drm_mode_obj_set_property *set_prop = arg;
+	struct drm_prime_handle *prime = arg;
+	struct stat st;
+	buffer_t *buffer;
+	fb_t *fb;
+
+	switch (request) {
+	case DRM_IOCTL_GET_CAP:
+		cap->value = cap->capability == DRM_CAP_DUMB_BUFFER;
+		return 0;
+	case DRM_IOCTL_SET_CLIENT_CAP:
+		return 0;
+	case DRM_IOCTL_MODE_GETRESOURCES:
+		res->count_fbs = 0;
+		copy_out(res->crtc_id_ptr, &res->count_crtcs, &crtc, 1,
+			 sizeof(crtc));
+		copy_out(res->connector_id_ptr, &res->count_connectors,
+			 &connector, 1, sizeof(connector));
+		copy_out(res->encoder_id_ptr, &res->count_encoders, &encoder,
+			 1, sizeof(encoder));
+		res->min_width = res->min_height = 1;
+		res->max_width = res->max_height = 8192;
+		return 0;
+	case DRM_IOCTL_MODE_GETCONNECTOR:
+		return drm_get_connector(arg);
+	case DRM_IOCTL_MODE_GETENCODER:
+		if (enc->encoder_id != ENCODER_ID)
+			return -ENOENT;
+		enc->encoder_type = 0;
+		enc->crtc_id = CRTC_ID;
+		enc->possible_crtcs = 1;
+		enc->possible_clones = 0;
+		return 0;
+	case DRM_IOCTL_MODE_GETCRTC:
+		if (get_crtc->crtc_id != CRTC_ID)
+			return -ENOENT;
+		get_crtc->fb_id = crtc_fb;
+		get_crtc->x = get_crtc->y = 0;
+		get_crtc->gamma_size = cfg.gamma;
+		get_crtc->mode_valid = crtc_mode_valid;
+		memcpy(&get_crtc->mode, crtc_mode_valid ? &crtc_mode :
+		       &modes[0], sizeof(get_crtc->mode));
+		return 0;
+	case DRM_IOCTL_MODE_SETCRTC:
+		return drm_set_crtc(arg);
+	case DRM_IOCTL_MODE_PAGE_FLIP:
+		return drm_page_flip(arg);
+	case DRM_IOCTL_MODE_CREATE_DUMB:
+		return drm_create_dumb(arg);
+	case DRM_IOCTL_MODE_MAP_DUMB:
+		if (!(buffer = find_buffer(map->handle)) || buffer->memfd < 0)
+			return -ENOENT;
+		map->offset = (uint64_t)buffer->handle << 32;
+		return 0;
+	case DRM_IOCTL_MODE_DESTROY_DUMB:
+	case DRM_IOCTL_GEM_CLOSE:
+		if (!(buffer = find_buffer(*(uint32_t *)arg)))
+			return -ENOENT;
+		if (buffer->memfd >= 0)
+			real_close(buffer->memfd);
+		memset(buffer, 0, sizeof(*buffer));
+		return 0;
+	case DRM_IOCTL_PRIME_FD_TO_HANDLE:
+		if (fstat(prime->fd, &st) == -1)
+			return -errno;
+		if ((buffer = find_import(&st))) {
+			prime->handle = buffer->handle;
+			return 0;
+		}
+		/* Imported buffers can't be mapped */
+		if (!(buffer = alloc_buffer()))
+			return -ENOMEM;
+		buffer->memfd = -1;
+		buffer->handle = next_handle++;
+		buffer->dev = st.st_dev;
+		buffer->ino = st.st_ino;
+		prime->handle = buffer->handle;
+		return 0;
+	case DRM_IOCTL_MODE_ADDFB2:
+		return drm_add_fb2(arg);
+	case DRM_IOCTL_MODE_RMFB:
+		if (!(fb = find_fb(*(uint32_t *)arg)))
+			return -ENOENT;
+		/* Removing the buffer on screen turns the crtc off */
+		if (fb->fb_id == crtc_fb)
+			crtc_fb = 0, crtc_mode_valid = 0;
+		memset(fb, 0, sizeof(*fb));
+		return 0;
+	case DRM_IOCTL_MODE_GETPLANERESOURCES:
+		copy_out(plane_res->plane_id_ptr, &plane_res->count_planes,
+			 planes, cfg.planes, sizeof(*planes));
+		return 0;
+	case DRM_IOCTL_MODE_GETPLANE:
+		return drm_get_plane(arg);
+	case DRM_IOCTL_MODE_SETPLANE:
+		return drm_set_plane(arg);
+	case DRM_IOCTL_MODE_OBJ_GETPROPERTIES:
+		return drm_get_properties(arg);
+	case DRM_IOCTL_MODE_GETPROPERTY:
+		return drm_get_property(arg);
+	case DRM_IOCTL_MODE_OBJ_SETPROPERTY:
+		if (set_prop->obj_id == CONNECTOR_ID &&
+		    set_prop->prop_id == PROP_DPMS && cfg.dpms) {
+			dpms = set_prop->value;
+			return 0;
+		}
+		if (set_prop->obj_id != PLANE_ID ||
+		    set_prop->prop_id != PROP_ROT || !cfg.rotation)
+			return -EINVAL;
+		rotation = set_prop->value;
+		return 0;
+	case DRM_IOCTL_MODE_GETGAMMA:
+	case DRM_IOCTL_MODE_SETGAMMA:
+		return drm_gamma(request, arg);
+	}
+
+	return -ENOTTY;
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+ioctl(int fd, unsigned long request, ...)
+{
+	ioctl_info_t *info = NULL;
+	long long start;
+	void *arg;
+	va_list ap;
+	int i, ret;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	if (fd < 0 || (fd != fb_fd && fd != drm_fd))
+		return real_ioctl(fd, request, arg);
+
+	start = now_ns();
+
+	for (i = 0; i < IOCTL_COUNT; i++)
+		if (ioctls[i].request == request)
+			info = &ioctls[i];
+
+	if (!info) {
+		ret = -ENOTTY;
+	} else if (info->fail) {
+		if (info->fail > 0)
+			info->fail--;
+		ret = -EBUSY;
+	} else {
+		ret = fd == fb_fd ? fb_ioctl(request, arg) :
+				    drm_ioctl(request, arg);
+	}
+
+	if (info) {
+		while (now_ns() - start < info->cost_ns)
+			;
+		info->calls++;
+		info->ns += now_ns() - start;
+	}
+
+	if (cfg.trace)
+		fprintf(stderr, "%s %s = %d\n", fd == fb_fd ? "fb0" : "card0",
+			info ? info->name : "?", ret);
+
+	if (ret < 0) {
+		errno = -ret;
+		return -1;
+	}
+	return ret;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void *
+map_device(void *addr, size_t length, int prot, int flags, int fd,
+	   off64_t offset)
+{
+	buffer_t *buffer;
+
+	if (fd == fb_fd)
+		return real_mmap64(addr, length, prot, flags, fd, offset);
+
+	/* Dumb buffer offsets hold the handle */
+	buffer = find_buffer(offset >> 32);
+	if (!buffer || buffer->memfd < 0 || length > buffer->size) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+
+	return real_mmap64(addr, length, prot, flags, buffer->memfd, 0);
+}
+
+/* ------------------------------------------------------------------------ */
+
+void *
+mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+	if (fd >= 0 && fd == drm_fd)
+		return map_device(addr, length, prot, flags, fd, offset);
+
+	return real_mmap(addr, length, prot, flags, fd, offset);
+}
+
+/* ------------------------------------------------------------------------ */
+
+void *
+mmap64(void *addr, size_t length, int prot, int flags, int fd,
+       off64_t offset)
+{
+	if (fd >= 0 && fd == drm_fd)
+		return map_device(addr, length, prot, flags, fd, offset);
+
+	return real_mmap64(addr, length, prot, flags, fd, offset);
+}
@@ -0,0 +1,967 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Check drawing results bit for bit and measure drawing speed.
+ *
+ *   yamui-drawcheck [CALLS [SEED]]
+ *
+ * Draws a random sequence of CALLS (default 2000) fills, texts, icons,
+ * blits and blends, with all alpha values, odd sizes and coordinates
+ * past the edges, to the display and to an offscreen surface with
+ * padded rows. The display is simulated with YAMUI_VIRTUAL, 719x1283
+ * unless set. The tool is built with 3 % overscan, unlike yamui, so
+ * drawing offset by overscan is checked too.
+ *
+ * Results with the plain C kernels are compared to the ones gr_kernels
+ * has for the target CPU, in every rotation. Without rotation they are
+ * also compared to a per pixel model of each call; text is left out of
+ * that. PNG images of every format the loaders take are checked
+ * against the pixels written to them. The first call giving a
+ * different result is reported.
+ *
+ * Drawing speed of each kind of call is printed for both kernel sets,
+ * and loading speed of each image format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <png.h>
+
+#include "../minui/minui.h"
+#include "../minui/kernels.h"
+
+#define DEFAULT_DISPLAY "719x1283"
+#define DEFAULT_CALLS   2000
+#define DEFAULT_SEED    1
+#define SOURCES         4
+#define ICONS           4
+#define RECTS_MAX       8
+#define TEXT_MAX        16
+#define PAD_PIXELS      3    /* offscreen surface row padding */
+#define MIN_TIME_NS     100000000LL
+
+typedef enum {
+	OP_FILL,
+	OP_FILL_RECTS,
+	OP_TEXT,
+	OP_TEXTICON,
+	OP_BLIT,
+	OP_BLEND,
+	OP_COUNT
+} op_type_t;
+
+static const char *op_names[OP_COUNT] = {
+	"fill", "fill_rects", "text", "texticon", "blit", "blend",
+};
+
+typedef struct {
+	op_type_t     type;
+	unsigned char color[4];
+	int           x;          /* destination, or first corner */
+	int           y;
+	int           x2;         /* second corner of fills */
+	int           y2;
+	int           sx;         /* source area */
+	int           sy;
+	int           w;
+	int           h;
+	int           source;     /* source surface pair or icon */
+	int           alpha;      /* of blends */
+	int           bold;
+	int           count;
+	GRRect        rects[RECTS_MAX];
+	char          text[TEXT_MAX];
+	long          pixels;     /* area drawn, for speed */
+} op_t;
+
+/* Surface drawn to, with the data replaced by each run's own buffer */
+typedef struct {
+	const char *name;
+	GRSurface  *surface;
+	bool        offscreen;
+	int         width;        /* logical drawing area */
+	int         height;
+	int         ox;           /* overscan */
+	int         oy;
+	size_t      size;
+} target_t;
+
+typedef void (*draw_fn)(const op_t *, const target_t *, unsigned char *);
+
+static unsigned rng_state;
+
+static GRSurface *sources_a[SOURCES];
+static GRSurface *sources_b[SOURCES];
+static GRSurface *icons[ICONS];
+static int font_width;
+static int font_height;
+
+static const int source_sizes[SOURCES][2] = {
+	{ 1, 1 }, { 7, 13 }, { 161, 97 }, { 0, 0 }, /* last is the display */
+};
+static const int icon_sizes[ICONS][2] = {
+	{ 1, 1 }, { 10, 18 }, { 33, 7 }, { 64, 64 },
+};
+
+/* ------------------------------------------------------------------------ */
+
+static long long
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Same sequence on every platform, unlike rand() */
+static unsigned
+rnd(unsigned n)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return n ? rng_state % n : 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+fill_random(unsigned char *data, size_t size, unsigned seed)
+{
+	size_t i;
+
+	rng_state = seed;
+	for (i = 0; i < size; i++)
+		data[i] = rnd(256);
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Alpha values 0 and 255 take paths of their own */
+static int
+random_alpha(void)
+{
+	switch (rnd(4)) {
+	case 0:  return 0;
+	case 1:  return 255;
+	default: return rnd(256);
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Coordinate on an axis of length n: mostly on it, sometimes past the
+ * edges */
+static int
+random_coord(int n)
+{
+	return rnd(4) ? (int)rnd(n) : (int)rnd(n * 3 / 2) - n / 4;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Sources and icons in the orientation of the current rotation */
+static int
+create_sources(int width, int height)
+{
+	int i, w, h;
+
+	for (i = 0; i < SOURCES; i++) {
+		w = source_sizes[i][0] ? source_sizes[i][0] : width;
+		h = source_sizes[i][1] ? source_sizes[i][1] : height;
+		sources_a[i] = gr_new_surface(w, h);
+		sources_b[i] = gr_new_surface(w, h);
+		if (!sources_a[i] || !sources_b[i])
+			return -1;
+		fill_random(sources_a[i]->data, (size_t)w * h * 4, 100 + i);
+		fill_random(sources_b[i]->data, (size_t)w * h * 4, 200 + i);
+	}
+
+	for (i = 0; i < ICONS; i++) {
+		size_t size = (size_t)icon_sizes[i][0] * icon_sizes[i][1];
+		size_t j;
+
+		if (!(icons[i] = calloc(1, sizeof(GRSurface) + size)))
+			return -1;
+		icons[i]->width = icon_sizes[i][0];
+		icons[i]->height = icon_sizes[i][1];
+		icons[i]->row_bytes = icon_sizes[i][0];
+		icons[i]->pixel_bytes = 1;
+		icons[i]->data = (unsigned char *)(icons[i] + 1);
+
+		/* Glyph like: mostly fully transparent or opaque */
+		rng_state = 300 + i;
+		for (j = 0; j < size; j++)
+			icons[i]->data[j] = rnd(3) ? rnd(2) * 255 : rnd(256);
+	}
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+free_sources(void)
+{
+	int i;
+
+	for (i = 0; i < SOURCES; i++) {
+		free(sources_a[i]), sources_a[i] = NULL;
+		free(sources_b[i]), sources_b[i] = NULL;
+	}
+	for (i = 0; i < ICONS; i++)
+		free(icons[i]), icons[i] = NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Clip rectangle to the target like gr_fill_rects() and gr_blit() do,
+ * in target data coordinates without rotation */
+static bool
+clip(const target_t *t, int *x1, int *y1, int *x2, int *y2)
+{
+	int w = t->width + 2 * t->ox, h = t->height + 2 * t->oy;
+
+	*x1 += t->ox, *x2 += t->ox;
+	*y1 += t->oy, *y2 += t->oy;
+	if (*x1 < 0) *x1 = 0;
+	if (*y1 < 0) *y1 = 0;
+	if (*x2 > w) *x2 = w;
+	if (*y2 > h) *y2 = h;
+
+	return *x1 < *x2 && *y1 < *y2;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Whether area is inside the target, for calls that draw all or
+ * nothing */
+static bool
+inside(const target_t *t, int x1, int y1, int x2, int y2)
+{
+	int w = t->width + 2 * t->ox, h = t->height + 2 * t->oy;
+
+	x1 += t->ox, x2 += t->ox;
+	y1 += t->oy, y2 += t->oy;
+
+	return x1 >= 0 && y1 >= 0 && x2 <= w && y2 <= h &&
+	       x1 < x2 && y1 < y2;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static long
+op_area(const op_t *op, const target_t *t)
+{
+	int x1 = op->x, y1 = op->y, x2 = op->x2, y2 = op->y2;
+	long area = 0;
+	int i;
+
+	switch (op->type) {
+	case OP_FILL:
+		if (inside(t, x1, y1, x2, y2))
+			area = (long)(x2 - x1) * (y2 - y1);
+		break;
+	case OP_FILL_RECTS:
+		for (i = 0; i < op->count; i++) {
+			x1 = op->rects[i].x1, y1 = op->rects[i].y1;
+			x2 = op->rects[i].x2, y2 = op->rects[i].y2;
+			if (clip(t, &x1, &y1, &x2, &y2))
+				area += (long)(x2 - x1) * (y2 - y1);
+		}
+		break;
+	case OP_TEXT:
+		/* Glyphs are drawn when inside, counted alike */
+		x2 = x1 + (int)strlen(op->text) * font_width;
+		y2 = y1 + font_height;
+		if (clip(t, &x1, &y1, &x2, &y2))
+			area = (long)(x2 - x1) * (y2 - y1);
+		break;
+	case OP_TEXTICON:
+		if (inside(t, x1, y1, x1 + op->w, y1 + op->h))
+			area = (long)op->w * op->h;
+		break;
+	case OP_BLIT:
+	case OP_BLEND:
+		x2 = x1 + op->w, y2 = y1 + op->h;
+		if (clip(t, &x1, &y1, &x2, &y2))
+			area = (long)(x2 - x1) * (y2 - y1);
+		break;
+	default:
+		break;
+	}
+
+	return area;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+generate(op_t *ops, int count, const target_t *t)
+{
+	int i, j, sw, sh;
+
+	for (i = 0; i < count; i++) {
+		op_t *op = &ops[i];
+
+		memset(op, 0, sizeof(*op));
+		op->type = rnd(OP_COUNT);
+		op->color[0] = rnd(256);
+		op->color[1] = rnd(256);
+		op->color[2] = rnd(256);
+		op->color[3] = random_alpha();
+		op->x = random_coord(t->width);
+		op->y = random_coord(t->height);
+
+		switch (op->type) {
+		case OP_FILL:
+			op->x2 = op->x + 1 + rnd(t->width);
+			op->y2 = op->y + 1 + rnd(t->height);
+			break;
+		case OP_FILL_RECTS:
+			op->count = 1 + rnd(RECTS_MAX);
+			for (j = 0; j < op->count; j++) {
+				GRRect *r = &op->rects[j];
+
+				r->x1 = random_coord(t->width);
+				r->y1 = random_coord(t->height);
+				r->x2 = r->x1 + rnd(t->width / 2);
+				r->y2 = r->y1 + rnd(t->height / 2);
+			}
+			break;
+		case OP_TEXT:
+			op->bold = rnd(2);
+			for (j = rnd(TEXT_MAX - 1); j >= 0; j--)
+				op->text[j] = rnd(8) ? 32 + rnd(96) : '\n';
+			break;
+		case OP_TEXTICON:
+			op->source = rnd(ICONS);
+			op->w = icon_sizes[op->source][0];
+			op->h = icon_sizes[op->source][1];
+			break;
+		case OP_BLIT:
+		case OP_BLEND:
+			op->source = rnd(SOURCES);
+			op->alpha = random_alpha();
+			sw = gr_get_width(sources_a[op->source]);
+			sh = gr_get_height(sources_a[op->source]);
+			op->sx = rnd(sw);
+			op->sy = rnd(sh);
+			op->w = 1 + rnd(sw - op->sx);
+			op->h = 1 + rnd(sh - op->sy);
+			/* Full size blits take the single block path */
+			if (op->source == SOURCES - 1 && rnd(2)) {
+				op->x = op->y = op->sx = op->sy = 0;
+				op->w = sw;
+				op->h = sh;
+			}
+			break;
+		default:
+			break;
+		}
+
+		op->pixels = op_area(op, t);
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+draw_gr(const op_t *op, const target_t *t, unsigned char *data)
+{
+	t->surface->data = data;
+	if (t->offscreen)
+		gr_set_draw_surface(t->surface);
+
+	gr_color(op->color[0], op->color[1], op->color[2], op->color[3]);
+
+	switch (op->type) {
+	case OP_FILL:
+		gr_fill(op->x, op->y, op->x2, op->y2);
+		break;
+	case OP_FILL_RECTS:
+		gr_fill_rects(op->rects, op->count);
+		break;
+	case OP_TEXT:
+		gr_text(op->x, op->y, op->text, op->bold);
+		break;
+	case OP_TEXTICON:
+		gr_texticon(op->x, op->y, icons[op->source]);
+		break;
+	case OP_BLIT:
+		gr_blit(sources_a[op->source], op->sx, op->sy, op->w, op->h,
+			op->x, op->y);
+		break;
+	case OP_BLEND:
+		gr_blend(sources_a[op->source], sources_b[op->source],
+			 op->sx, op->sy, op->w, op->h, op->x, op->y,
+			 op->alpha);
+		break;
+	default:
+		break;
+	}
+
+	if (t->offscreen)
+		gr_set_draw_surface(NULL);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+draw_scalar(const op_t *op, const target_t *t, unsigned char *data)
+{
+	const GRKernels *saved = gr_kernels;
+
+	gr_kernels = &gr_kernels_scalar;
+	draw_gr(op, t, data);
+	gr_kernels = saved;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static unsigned char
+model_mix(unsigned char dst, unsigned char color, int alpha)
+{
+	return (dst * (255 - alpha) + color * alpha) / 255;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+model_fill(const target_t *t, unsigned char *data, const op_t *op,
+	   int x1, int y1, int x2, int y2)
+{
+	int x, y, i;
+
+	if (op->color[3] == 0)
+		return;
+
+	for (y = y1; y < y2; y++) {
+		unsigned char *px = data + (size_t)y * t->surface->row_bytes;
+
+		for (x = x1; x < x2; x++)
+			for (i = 0; i < 3; i++)
+				px[4 * x + i] = model_mix(px[4 * x + i],
+							  op->color[i],
+							  op->color[3]);
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* What each call should draw without rotation, one pixel at a time */
+static void
+draw_model(const op_t *op, const target_t *t, unsigned char *data)
+{
+	const GRSurface *a = sources_a[op->source];
+	const GRSurface *b = sources_b[op->source];
+	int row_bytes = t->surface->row_bytes;
+	int x1 = op->x, y1 = op->y, x2 = op->x2, y2 = op->y2;
+	int x, y, i, alpha, weight;
+
+	switch (op->type) {
+	case OP_FILL:
+		if (inside(t, x1, y1, x2, y2))
+			model_fill(t, data, op, x1 + t->ox, y1 + t->oy,
+				   x2 + t->ox, y2 + t->oy);
+		break;
+	case OP_FILL_RECTS:
+		for (i = 0; i < op->count; i++) {
+			x1 = op->rects[i].x1, y1 = op->rects[i].y1;
+			x2 = op->rects[i].x2, y2 = op->rects[i].y2;
+			if (clip(t, &x1, &y1, &x2, &y2))
+				model_fill(t, data, op, x1, y1, x2, y2);
+		}
+		break;
+	case OP_TEXTICON:
+		if (!inside(t, x1, y1, x1 + op->w, y1 + op->h))
+			break;
+		for (y = 0; y < op->h; y++) {
+			unsigned char *px = data +
+				(size_t)(y1 + t->oy + y) * row_bytes +
+				(size_t)(x1 + t->ox) * 4;
+
+			for (x = 0; x < op->w; x++, px += 4) {
+				alpha = icons[op->source]->data[y * op->w + x];
+				alpha = alpha * op->color[3] / 255;
+				for (i = 0; i < 3; i++)
+					px[i] = model_mix(px[i], op->color[i],
+							  alpha);
+			}
+		}
+		break;
+	case OP_BLIT:
+	case OP_BLEND:
+		x2 = x1 + op->w, y2 = y1 + op->h;
+		if (!clip(t, &x1, &y1, &x2, &y2))
+			break;
+		/* Source area moves with the clipped destination */
+		weight = op->alpha + (op->alpha >> 7);
+		for (y = y1; y < y2; y++) {
+			int sy = op->sy + y - (op->y + t->oy);
+			unsigned char *px = data + (size_t)y * row_bytes;
+
+			for (x = x1; x < x2; x++) {
+				int sx = op->sx + x - (op->x + t->ox);
+				const unsigned char *pa = a->data +
+					(size_t)sy * a->row_bytes + sx * 4;
+				const unsigned char *pb = b->data +
+					(size_t)sy * b->row_bytes + sx * 4;
+
+				for (i = 0; i < 4; i++)
+					px[4 * x + i] = op->type == OP_BLIT ?
+						pa[i] :
+						(pa[i] * (256 - weight) +
+						 pb[i] * weight + 128) >> 8;
+			}
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+run(draw_fn draw, const op_t *ops, int count, const target_t *t,
+    unsigned char *data, bool skip_text)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (!skip_text || ops[i].type != OP_TEXT)
+			draw(&ops[i], t, data);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+report_op(const op_t *op)
+{
+	fprintf(stderr, "  %s color %d,%d,%d,%d at %d,%d", op_names[op->type],
+		op->color[0], op->color[1], op->color[2], op->color[3],
+		op->x, op->y);
+	if (op->type == OP_FILL)
+		fprintf(stderr, " to %d,%d", op->x2, op->y2);
+	if (op->type == OP_BLIT || op->type == OP_BLEND ||
+	    op->type == OP_TEXTICON)
+		fprintf(stderr, " source %d (%d,%d %dx%d) alpha %d",
+			op->source, op->sx, op->sy, op->w, op->h, op->alpha);
+	fprintf(stderr, "\n");
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Draw calls with two implementations, and if the results differ, again
+ * one call at a time to find the first that differs. */
+static int
+compare(const char *what, draw_fn draw_a, draw_fn draw_b, const op_t *ops,
+	int count, const target_t *t, bool skip_text)
+{
+	unsigned char *a = malloc(t->size), *b = malloc(t->size);
+	int i, result = -1;
+	size_t j;
+
+	if (!a || !b)
+		goto cleanup;
+
+	fill_random(a, t->size, 1);
+	memcpy(b, a, t->size);
+	run(draw_a, ops, count, t, a, skip_text);
+	run(draw_b, ops, count, t, b, skip_text);
+	if (!memcmp(a, b, t->size)) {
+		result = 0;
+		goto cleanup;
+	}
+
+	fill_random(a, t->size, 1);
+	memcpy(b, a, t->size);
+	for (i = 0; i < count; i++) {
+		if (skip_text && ops[i].type == OP_TEXT)
+			continue;
+		draw_a(&ops[i], t, a);
+		draw_b(&ops[i], t, b);
+		if (memcmp(a, b, t->size))
+			break;
+	}
+
+	for (j = 0; j < t->size && a[j] == b[j]; j++)
+		;
+	fprintf(stderr, "%s, %s: call %d differs at data %zu,%zu byte %zu: "
+		"%d != %d\n", what, t->name, i,
+		j % t->surface->row_bytes / 4, j / t->surface->row_bytes,
+		j % 4, a[j], b[j]);
+	if (i < count)
+		report_op(&ops[i]);
+
+cleanup:
+	free(a);
+	free(b);
+	return result;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Mpixel/s for each kind of call */
+static void
+measure(draw_fn draw, const op_t *ops, int count, const target_t *t,
+	double *speed)
+{
+	unsigned char *data = malloc(t->size);
+	long long start, elapsed;
+	long pixels;
+	int type, i;
+
+	if (!data)
+		return;
+	fill_random(data, t->size, 1);
+
+	for (type = 0; type < OP_COUNT; type++) {
+		pixels = 0;
+		start = now_ns();
+		do {
+			for (i = 0; i < count; i++) {
+				if (ops[i].type != (op_type_t)type)
+					continue;
+				draw(&ops[i], t, data);
+				pixels += ops[i].pixels;
+			}
+		} while ((elapsed = now_ns() - start) < MIN_TIME_NS &&
+			 pixels > 0);
+
+		speed[type] = (double)pixels / elapsed * 1000;
+	}
+
+	free(data);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+check_rotation(int rotation, int count, unsigned seed)
+{
+	GRSurface *screen, offscreen;
+	target_t targets[2];
+	op_t *ops = NULL;
+	double speed[2][OP_COUNT];
+	int i, type, result = 0;
+	void *screen_data;
+
+	gr_set_rotation(rotation);
+	if (gr_init(false)) {
+		fprintf(stderr, "display init failed\n");
+		return -1;
+	}
+	gr_font_size(&font_width, &font_height);
+
+	screen = gr_draw_surface();
+	screen_data = screen->data;
+
+	targets[0] = (target_t){
+		.name    = "display",
+		.surface = screen,
+		.width   = gr_fb_width(),
+		.height  = gr_fb_height(),
+		.size    = (size_t)screen->height * screen->row_bytes,
+	};
+	targets[0].ox = ((rotation % 180 ? screen->height : screen->width) -
+			 targets[0].width) / 2;
+	targets[0].oy = ((rotation % 180 ? screen->width : screen->height) -
+			 targets[0].height) / 2;
+
+	/* Odd size, rows padded */
+	offscreen.width = rotation % 180 ? 303 : 501;
+	offscreen.height = rotation % 180 ? 501 : 303;
+	offscreen.pixel_bytes = 4;
+	offscreen.row_bytes = (offscreen.width + PAD_PIXELS) * 4;
+	offscreen.rotation = rotation;
+	targets[1] = (target_t){
+		.name      = "offscreen",
+		.surface   = &offscreen,
+		.offscreen = true,
+		.width     = 501,
+		.height    = 303,
+		.size      = (size_t)offscreen.height * offscreen.row_bytes,
+	};
+
+	if (create_sources(targets[0].width, targets[0].height) ||
+	    !(ops = calloc(count, sizeof(*ops)))) {
+		fprintf(stderr, "out of memory\n");
+		result = -1;
+		goto cleanup;
+	}
+
+	for (i = 0; i < 2; i++) {
+		const target_t *t = &targets[i];
+
+		rng_state = seed + rotation + i;
+		generate(ops, count, t);
+
+		if (gr_kernels != &gr_kernels_scalar &&
+		    compare(gr_kernels->name, draw_scalar, draw_gr, ops, count,
+			    t, false))
+			result = -1;
+
+		if (rotation == 0 &&
+		    compare("model", draw_model, draw_scalar, ops, count, t,
+			    true))
+			result = -1;
+
+		if (rotation != 0 || t->offscreen)
+			continue;
+
+		measure(draw_scalar, ops, count, t, speed[0]);
+		measure(draw_gr, ops, count, t, speed[1]);
+
+		printf("%s, Mpixel/s\n", t->name);
+		printf("%-12s %10s %10s\n", "call", "scalar",
+		       gr_kernels->name);
+		for (type = 0; type < OP_COUNT; type++)
+			printf("%-12s %10.1f %10.1f\n", op_names[type],
+			       speed[0][type], speed[1][type]);
+	}
+
+	printf("rotation %d: %s\n", rotation, result ? "FAILED" : "ok");
+
+cleanup:
+	free(ops);
+	free_sources();
+	screen->data = screen_data;
+	gr_exit();
+	return result;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+write_png(const char *path, int width, int height, int color_type,
+	  int depth, unsigned char *rows)
+{
+	png_structp png = NULL;
+	png_infop info = NULL;
+	png_color palette[256];
+	volatile int result = -1;
+	int i;
+	FILE *fp;
+
+	if (!(fp = fopen(path, "wb")))
+		return -1;
+
+	png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL,
+				      NULL);
+	if (!png || !(info = png_create_info_struct(png)))
+		goto cleanup;
+	if (setjmp(png_jmpbuf(png)))
+		goto cleanup;
+
+	png_init_io(png, fp);
+	png_set_IHDR(png, info, width, height, depth, color_type,
+		     PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+		     PNG_FILTER_TYPE_DEFAULT);
+	if (color_type == PNG_COLOR_TYPE_PALETTE) {
+		for (i = 0; i < 256; i++)
+			palette[i] = (png_color){ i, 255 - i, i * 7 };
+		png_set_PLTE(png, info, palette, 256);
+	}
+	png_write_info(png, info);
+	if (depth < 8)
+		png_set_packing(png);
+	for (i = 0; i < height; i++)
+		png_write_row(png, rows + (size_t)i * width *
+			      (color_type == PNG_COLOR_TYPE_RGB ? 3 : 1));
+	png_write_end(png, NULL);
+	result = 0;
+
+cleanup:
+	png_destroy_write_struct(&png, &info);
+	fclose(fp);
+	return result;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Write an image, load it and compare to what it should be */
+static int
+check_png(const char *dir, const char *name, int color_type, int depth,
+	  int width, int height, bool alpha)
+{
+	int channels = color_type == PNG_COLOR_TYPE_RGB ? 3 : 1;
+	size_t n = (size_t)width * height, i;
+	unsigned char *rows = malloc(n * channels);
+	unsigned char expect[4];
+	char path[256];
+	GRSurface *surface = NULL;
+	long long start, elapsed;
+	int loads, result = -1;
+
+	if (!rows)
+		return -1;
+
+	rng_state = width + depth;
+	for (i = 0; i < n * channels; i++)
+		rows[i] = rnd(1 << depth);
+
+	snprintf(path, sizeof path, "%s/%s.png", dir, name);
+	if (write_png(path, width, height, color_type, depth, rows)) {
+		fprintf(stderr, "%s: can't write\n", path);
+		goto cleanup;
+	}
+
+	if ((alpha ? res_create_alpha_surface(name, dir, &surface) :
+		     res_create_display_surface(name, dir, &surface)) < 0) {
+		fprintf(stderr, "%s: can't load\n", path);
+		goto cleanup;
+	}
+
+	for (i = 0; i < n; i++) {
+		const unsigned char *px = surface->data +
+			i / width * surface->row_bytes +
+			i % width * surface->pixel_bytes;
+		int level = rows[i] * 255 / ((1 << depth) - 1);
+
+		if (color_type == PNG_COLOR_TYPE_RGB)
+			memcpy(expect, &rows[3 * i], 3);
+		else if (color_type == PNG_COLOR_TYPE_PALETTE)
+			expect[0] = rows[i], expect[1] = 255 - rows[i],
+			expect[2] = rows[i] * 7;
+		else
+			expect[0] = expect[1] = expect[2] = level;
+		expect[3] = 255;
+
+		if (memcmp(px, expect, surface->pixel_bytes)) {
+			fprintf(stderr, "%s: pixel %zu,%zu differs\n", name,
+				i % width, i / width);
+			goto cleanup;
+		}
+	}
+
+	/* Display sized images for speed */
+	if (width < 100) {
+		result = 0;
+		goto cleanup;
+	}
+	loads = 0;
+	start = now_ns();
+	do {
+		res_free_surface(surface);
+		if (alpha)
+			res_create_alpha_surface(name, dir, &surface);
+		else
+			res_create_display_surface(name, dir, &surface);
+		loads++;
+	} while ((elapsed = now_ns() - start) < MIN_TIME_NS);
+	printf("%-12s %10.1f\n", name, (double)n * loads / elapsed * 1000);
+	result = 0;
+
+cleanup:
+	unlink(path);
+	if (surface)
+		res_free_surface(surface);
+	free(rows);
+	return result;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+check_pngs(int width, int height)
+{
+	static const struct {
+		const char *name;
+		int         color_type;
+		int         depth;
+		bool        alpha;
+	} formats[] = {
+		{ "gray1",   PNG_COLOR_TYPE_GRAY,    1, false },
+		{ "gray2",   PNG_COLOR_TYPE_GRAY,    2, false },
+		{ "gray4",   PNG_COLOR_TYPE_GRAY,    4, false },
+		{ "gray8",   PNG_COLOR_TYPE_GRAY,    8, false },
+		{ "rgb",     PNG_COLOR_TYPE_RGB,     8, false },
+		{ "palette", PNG_COLOR_TYPE_PALETTE, 8, false },
+		{ "alpha1",  PNG_COLOR_TYPE_GRAY,    1, true },
+		{ "alpha8",  PNG_COLOR_TYPE_GRAY,    8, true },
+	};
+	char dir[] = "/tmp/yamui-drawcheck-XXXXXX";
+	int i, result = 0;
+
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp() failed");
+		return -1;
+	}
+
+	printf("png, Mpixel/s\n");
+	for (i = 0; i < (int)(sizeof formats / sizeof *formats); i++) {
+		/* Odd size for the edges, display size for speed */
+		if (check_png(dir, formats[i].name, formats[i].color_type,
+			      formats[i].depth, 37, 5, formats[i].alpha) ||
+		    check_png(dir, formats[i].name, formats[i].color_type,
+			      formats[i].depth, width, height,
+			      formats[i].alpha))
+			result = -1;
+	}
+
+	rmdir(dir);
+	printf("png: %s\n", result ? "FAILED" : "ok");
+	return result;
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+main(int argc, char *argv[])
+{
+	int count = DEFAULT_CALLS;
+	unsigned seed = DEFAULT_SEED;
+	int rotation, width, height, result = EXIT_SUCCESS;
+
+	if (argc > 1)
+		count = atoi(argv[1]);
+	if (argc > 2)
+		seed = strtoul(argv[2], NULL, 0);
+	if (argc > 3 || count <= 0 || !seed) {
+		fprintf(stderr, "Usage: %s [CALLS [SEED]]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	setenv("YAMUI_VIRTUAL", DEFAULT_DISPLAY, 0);
+	printf("kernels: %s, %d calls, seed %u\n", gr_kernels->name, count,
+	       seed);
+
+	for (rotation = 0; rotation < 360; rotation += 90)
+		if (check_rotation(rotation, count, seed))
+			result = EXIT_FAILURE;
+
+	/* Loaders need the display unrotated */
+	gr_set_rotation(0);
+	if (gr_init(false))
+		return EXIT_FAILURE;
+	width = gr_fb_width();
+	height = gr_fb_height();
+	if (check_pngs(width, height))
+		result = EXIT_FAILURE;
+	gr_exit();
+
+	return result;
+}
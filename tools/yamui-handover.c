@@ -0,0 +1,697 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measure how long yamui takes to give the display to the compositor.
+ *
+ *   yamui-handover [-n RUNS] [-w MS] [-f MS] [-y YAMUI] [-- YAMUI_ARGS]
+ *
+ * Starts a private dbus-daemon configured as the system bus, listening
+ * in a temporary directory, and runs yamui RUNS times (default 20)
+ * against it with YAMUI_TIMING set. The display is simulated with
+ * YAMUI_VIRTUAL, 1080x2400 unless set. Each run plays the parts of mce
+ * and the compositor during boot:
+ *
+ *   - once yamui owns org.nemomobile.compositor, setUpdatesEnabled(true)
+ *     is called on it, like mce does when the display turns on
+ *   - MS milliseconds (default 500) after the first flip, a connection
+ *     of its own requests the name with replacement, like the compositor
+ *     does when it starts
+ *
+ * YAMUI_ARGS are --text=Starting unless given. Times from the name
+ * request are printed as percentiles:
+ *
+ *   owned     the request returned with the name owned
+ *   handover  yamui saw the name lost
+ *   release   yamui released the display, or with -c among YAMUI_ARGS
+ *             handed it over as is
+ *   exit      yamui returned from main()
+ *
+ * With -f, the exit status is nonzero if the 90th percentile of release
+ * is over MS milliseconds, or if any run fails.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#define DEFAULT_YAMUI   "./yamui"
+#define DEFAULT_DISPLAY "1080x2400"
+#define DEFAULT_RUNS    20
+#define DEFAULT_WINDOW  500
+#define START_TIMEOUT   10000 /* ms to wait for the first flip */
+#define STOP_TIMEOUT    5000  /* ms to wait for exit after the request */
+#define CALL_TIMEOUT    5000  /* ms to wait for D-Bus replies */
+#define POLL_INTERVAL   2     /* ms between checks for the name owner */
+#define ARGS_MAX        32
+#define TIMING_PREFIX   "yamui: T: "
+
+#define DBUS_SERVICE    "org.freedesktop.DBus"
+#define DBUS_PATH       "/org/freedesktop/DBus"
+#define DBUS_INTERFACE  "org.freedesktop.DBus"
+
+#define DBUS_NAME_FLAG_REPLACE_EXISTING 2
+#define DBUS_REQUEST_NAME_PRIMARY_OWNER 1
+
+#define COMPOSITOR_SERVICE   "org.nemomobile.compositor"
+#define COMPOSITOR_PATH      "/"
+#define COMPOSITOR_INTERFACE "org.nemomobile.compositor"
+
+/* Anyone may own and call anything, the bus is private to the run */
+static const char bus_config[] =
+"<!DOCTYPE busconfig PUBLIC \"-//freedesktop//DTD D-Bus Bus Configuration 1.0//EN\"\n"
+" \"http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd\">\n"
+"<busconfig>\n"
+"  <type>system</type>\n"
+"  <listen>unix:path=%s</listen>\n"
+"  <auth>EXTERNAL</auth>\n"
+"  <policy context=\"default\">\n"
+"    <allow user=\"*\"/>\n"
+"    <allow own=\"*\"/>\n"
+"    <allow send_type=\"method_call\"/>\n"
+"    <allow send_type=\"method_return\"/>\n"
+"    <allow send_type=\"signal\"/>\n"
+"    <allow send_type=\"error\"/>\n"
+"    <allow receive_type=\"method_call\"/>\n"
+"    <allow receive_type=\"method_return\"/>\n"
+"    <allow receive_type=\"signal\"/>\n"
+"    <allow receive_type=\"error\"/>\n"
+"  </policy>\n"
+"</busconfig>\n";
+
+typedef enum {
+	EVENT_OWNED,
+	EVENT_HANDOVER,
+	EVENT_RELEASE,
+	EVENT_EXIT,
+	EVENT_COUNT
+} event_t;
+
+static const char *event_names[EVENT_COUNT] = {
+	"owned", "handover", "release", "exit",
+};
+
+/* Timing output of a running yamui */
+typedef struct {
+	int       fd;
+	char      buf[4096];
+	size_t    len;
+	bool      eof;
+	long long first_flip;
+	long long times[EVENT_COUNT];  /* monotonic microseconds, or -1 */
+} yamui_output_t;
+
+/* Configuration */
+static const char *yamui_path = DEFAULT_YAMUI;
+static const char *yamui_args[ARGS_MAX] = { "--text=Starting" };
+static int yamui_arg_count = 1;
+static int runs = DEFAULT_RUNS;
+static int window_ms = DEFAULT_WINDOW;
+
+/* Private bus */
+static char bus_dir[] = "/tmp/yamui-handover-XXXXXX";
+static char bus_socket[PATH_MAX];
+static char bus_config_path[PATH_MAX];
+static char bus_address[PATH_MAX];
+static pid_t bus_pid = -1;
+
+/* ------------------------------------------------------------------------ */
+
+/* Same clock as g_get_monotonic_time() in yamui */
+static long long
+now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static bool
+write_bus_config(void)
+{
+	FILE *fp;
+	bool done;
+
+	if (!(fp = fopen(bus_config_path, "w"))) {
+		perror(bus_config_path);
+		return false;
+	}
+	done = fprintf(fp, bus_config, bus_socket) > 0;
+	done = fclose(fp) == 0 && done;
+
+	return done;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Start dbus-daemon and point yamui at it */
+static bool
+bus_start(void)
+{
+	struct pollfd pfd;
+	int fds[2], null_fd;
+	size_t len = 0;
+	ssize_t n;
+
+	if (!mkdtemp(bus_dir)) {
+		perror("mkdtemp() failed");
+		bus_dir[0] = 0;
+		return false;
+	}
+	snprintf(bus_socket, sizeof bus_socket, "%s/system_bus_socket",
+		 bus_dir);
+	snprintf(bus_config_path, sizeof bus_config_path, "%s/system.conf",
+		 bus_dir);
+	if (!write_bus_config())
+		return false;
+
+	if (pipe2(fds, O_CLOEXEC) < 0) {
+		perror("pipe2() failed");
+		return false;
+	}
+
+	if ((bus_pid = fork()) == 0) {
+		/* Only the address is of interest */
+		null_fd = open("/dev/null", O_WRONLY);
+		dup2(fds[1], STDOUT_FILENO);
+		dup2(null_fd, STDERR_FILENO);
+		execlp("dbus-daemon", "dbus-daemon", "--nofork",
+		       "--print-address", "--config-file", bus_config_path,
+		       (char *)NULL);
+		_exit(127);
+	}
+	close(fds[1]);
+
+	if (bus_pid < 0) {
+		perror("fork() failed");
+		close(fds[0]);
+		return false;
+	}
+
+	/* The address is printed once the bus is listening */
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+	while (!memchr(bus_address, '\n', len) &&
+	       len < sizeof bus_address - 1 &&
+	       poll(&pfd, 1, START_TIMEOUT) > 0 &&
+	       (n = read(fds[0], bus_address + len,
+			 sizeof bus_address - 1 - len)) > 0)
+		len += n;
+	close(fds[0]);
+
+	bus_address[len] = 0;
+	bus_address[strcspn(bus_address, "\n")] = 0;
+	if (!bus_address[0]) {
+		fprintf(stderr, "dbus-daemon did not start\n");
+		return false;
+	}
+
+	setenv("DBUS_SYSTEM_BUS_ADDRESS", bus_address, 1);
+	return true;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+bus_stop(void)
+{
+	if (bus_pid > 0) {
+		kill(bus_pid, SIGTERM);
+		waitpid(bus_pid, NULL, 0);
+		bus_pid = -1;
+	}
+
+	if (bus_dir[0]) {
+		unlink(bus_socket);
+		unlink(bus_config_path);
+		rmdir(bus_dir);
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+static GDBusConnection *
+bus_connect(void)
+{
+	GDBusConnection *connection;
+	GError *err = NULL;
+
+	connection = g_dbus_connection_new_for_address_sync(bus_address,
+		G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+		G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+		NULL, NULL, &err);
+	if (!connection)
+		fprintf(stderr, "%s: connect failed: %s\n", bus_address,
+			err->message);
+	g_clear_error(&err);
+
+	return connection;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+bus_disconnect(GDBusConnection *connection)
+{
+	if (connection) {
+		g_dbus_connection_close_sync(connection, NULL, NULL);
+		g_object_unref(connection);
+	}
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Method call, returns the reply or NULL */
+static GVariant *
+bus_call(GDBusConnection *connection, const char *service, const char *path,
+	 const char *interface, const char *method, GVariant *args,
+	 const char *reply_type)
+{
+	GVariant *reply;
+	GError *err = NULL;
+
+	reply = g_dbus_connection_call_sync(connection, service, path,
+					    interface, method, args,
+					    G_VARIANT_TYPE(reply_type),
+					    G_DBUS_CALL_FLAGS_NONE,
+					    CALL_TIMEOUT, NULL, &err);
+	if (!reply)
+		fprintf(stderr, "%s.%s: %s\n", interface, method,
+			err->message);
+	g_clear_error(&err);
+
+	return reply;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static bool
+compositor_has_owner(GDBusConnection *connection)
+{
+	GVariant *reply;
+	gboolean owned = FALSE;
+
+	reply = bus_call(connection, DBUS_SERVICE, DBUS_PATH, DBUS_INTERFACE,
+			 "NameHasOwner", g_variant_new("(s)",
+						       COMPOSITOR_SERVICE),
+			 "(b)");
+	if (reply) {
+		g_variant_get(reply, "(b)", &owned);
+		g_variant_unref(reply);
+	}
+
+	return owned;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static bool
+compositor_request_name(GDBusConnection *connection)
+{
+	GVariant *reply;
+	guint32 result = 0;
+
+	reply = bus_call(connection, DBUS_SERVICE, DBUS_PATH, DBUS_INTERFACE,
+			 "RequestName", g_variant_new("(su)",
+						      COMPOSITOR_SERVICE,
+						      DBUS_NAME_FLAG_REPLACE_EXISTING),
+			 "(u)");
+	if (reply) {
+		g_variant_get(reply, "(u)", &result);
+		g_variant_unref(reply);
+	}
+
+	return result == DBUS_REQUEST_NAME_PRIMARY_OWNER;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static bool
+compositor_enable_updates(GDBusConnection *connection)
+{
+	GVariant *reply;
+
+	reply = bus_call(connection, COMPOSITOR_SERVICE, COMPOSITOR_PATH,
+			 COMPOSITOR_INTERFACE, "setUpdatesEnabled",
+			 g_variant_new("(b)", TRUE), "()");
+	if (reply)
+		g_variant_unref(reply);
+
+	return reply != NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+parse_line(yamui_output_t *out, const char *line)
+{
+	char event[32];
+	long long t;
+	int i;
+
+	if (strncmp(line, TIMING_PREFIX, strlen(TIMING_PREFIX)) ||
+	    sscanf(line + strlen(TIMING_PREFIX), "%31s %lld", event, &t) != 2)
+		return;
+
+	if (!strcmp(event, "flip")) {
+		if (out->first_flip < 0)
+			out->first_flip = t;
+		return;
+	}
+
+	for (i = 0; i < EVENT_COUNT; i++)
+		if (!strcmp(event, event_names[i]) && out->times[i] < 0)
+			out->times[i] = t;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Read timing lines until *until is set. Returns false if the deadline
+ * passes or yamui closes its output first. */
+static bool
+read_output(yamui_output_t *out, const long long *until, long long deadline)
+{
+	struct pollfd pfd;
+	long long now;
+	ssize_t n;
+	char *end;
+
+	pfd.fd = out->fd;
+	pfd.events = POLLIN;
+
+	while (!until || *until < 0) {
+		if (out->eof || (now = now_us()) >= deadline)
+			return false;
+
+		if (poll(&pfd, 1, (deadline - now + 999) / 1000) < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		if (!(pfd.revents & (POLLIN | POLLHUP)))
+			continue;
+
+		n = read(out->fd, out->buf + out->len,
+			 sizeof out->buf - out->len - 1);
+		if (n <= 0) {
+			out->eof = true;
+			return false;
+		}
+		out->len += n;
+		out->buf[out->len] = 0;
+
+		/* Complete lines */
+		while ((end = strchr(out->buf, '\n'))) {
+			*end = 0;
+			parse_line(out, out->buf);
+			out->len -= end + 1 - out->buf;
+			memmove(out->buf, end + 1, out->len + 1);
+		}
+		if (out->len == sizeof out->buf - 1)
+			out->len = 0;
+	}
+
+	return true;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static pid_t
+spawn(int out_fd)
+{
+	const char *argv[ARGS_MAX + 2];
+	int i, null_fd;
+	pid_t pid;
+
+	argv[0] = yamui_path;
+	for (i = 0; i < yamui_arg_count; i++)
+		argv[i + 1] = yamui_args[i];
+	argv[i + 1] = NULL;
+
+	if ((pid = fork()) != 0)
+		return pid;
+
+	/* Timing lines come on stderr, the rest is not of interest */
+	null_fd = open("/dev/null", O_WRONLY);
+	dup2(null_fd, STDOUT_FILENO);
+	dup2(out_fd, STDERR_FILENO);
+	setenv("YAMUI_TIMING", "1", 1);
+	execv(yamui_path, (char **)argv);
+	_exit(127);
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Start yamui, enable updates, take its name and wait for it to exit.
+ * Fills times from the name request in microseconds. */
+static int
+run(GDBusConnection *mce, long long *times)
+{
+	static yamui_output_t out;
+	GDBusConnection *compositor = NULL;
+	long long deadline, request = 0;
+	int fds[2], i, result = -1;
+	pid_t pid;
+
+	for (i = 0; i < EVENT_COUNT; i++)
+		times[i] = out.times[i] = -1;
+	out.first_flip = -1;
+	out.len = 0;
+	out.eof = false;
+
+	if (pipe2(fds, O_CLOEXEC) < 0) {
+		perror("pipe2() failed");
+		return -1;
+	}
+
+	if ((pid = spawn(fds[1])) < 0) {
+		perror("fork() failed");
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	close(fds[1]);
+	out.fd = fds[0];
+
+	/* mce: turn the display on once yamui is on the bus */
+	deadline = now_us() + START_TIMEOUT * 1000LL;
+	while (!compositor_has_owner(mce)) {
+		read_output(&out, NULL, now_us() + POLL_INTERVAL * 1000LL);
+		if (out.eof || now_us() >= deadline) {
+			fprintf(stderr, "yamui did not own %s\n",
+				COMPOSITOR_SERVICE);
+			goto cleanup;
+		}
+	}
+
+	if (!compositor_enable_updates(mce))
+		goto cleanup;
+
+	if (!read_output(&out, &out.first_flip, deadline)) {
+		fprintf(stderr, "yamui did not draw\n");
+		goto cleanup;
+	}
+	read_output(&out, NULL, out.first_flip + window_ms * 1000LL);
+
+	/* Compositor: connecting is not part of the handover */
+	if (!(compositor = bus_connect()))
+		goto cleanup;
+
+	request = now_us();
+	if (!compositor_request_name(compositor)) {
+		fprintf(stderr, "%s not owned after request\n",
+			COMPOSITOR_SERVICE);
+		goto cleanup;
+	}
+	out.times[EVENT_OWNED] = now_us();
+
+	if (!read_output(&out, &out.times[EVENT_EXIT],
+			 request + STOP_TIMEOUT * 1000LL)) {
+		fprintf(stderr, "yamui did not exit\n");
+		goto cleanup;
+	}
+
+	for (i = 0; i < EVENT_COUNT; i++)
+		if (out.times[i] >= 0)
+			times[i] = out.times[i] - request;
+	result = 0;
+
+cleanup:
+	if (result < 0)
+		kill(pid, SIGKILL);
+	close(out.fd);
+	waitpid(pid, NULL, 0);
+
+	/* Frees the name for the next run */
+	bus_disconnect(compositor);
+
+	return result;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+compare_times(const void *a, const void *b)
+{
+	long long ta = *(const long long *)a, tb = *(const long long *)b;
+
+	return ta < tb ? -1 : ta > tb;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Nearest rank percentile of sorted times */
+static double
+percentile(const long long *sorted, int count, int pct)
+{
+	int rank = (pct * count + 99) / 100;
+
+	return sorted[rank > 0 ? rank - 1 : 0] / 1000.0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Returns the 90th percentile of release in ms, or -1 if a run failed */
+static double
+bench(GDBusConnection *mce)
+{
+	long long (*times)[EVENT_COUNT] = calloc(runs, sizeof(*times));
+	long long *sorted = calloc(runs, sizeof(*sorted));
+	double release_p90 = -1;
+	int i, ok = 0, event;
+
+	if (!times || !sorted)
+		goto cleanup;
+
+	for (i = 0; i < runs; i++)
+		if (run(mce, times[ok]) == 0)
+			ok++;
+
+	printf("%d/%d runs\n", ok, runs);
+	printf("%-9s %8s %8s %8s %8s %8s\n", "event", "min", "p50", "p90",
+	       "p99", "max");
+
+	for (event = 0; event < EVENT_COUNT; event++) {
+		int n = 0;
+
+		for (i = 0; i < ok; i++)
+			if (times[i][event] >= 0)
+				sorted[n++] = times[i][event];
+		qsort(sorted, n, sizeof *sorted, compare_times);
+
+		if (!n) {
+			printf("%-9s %8s\n", event_names[event], "-");
+			continue;
+		}
+		printf("%-9s %8.1f %8.1f %8.1f %8.1f %8.1f\n",
+		       event_names[event], sorted[0] / 1000.0,
+		       percentile(sorted, n, 50), percentile(sorted, n, 90),
+		       percentile(sorted, n, 99), sorted[n - 1] / 1000.0);
+
+		if (event == EVENT_RELEASE)
+			release_p90 = percentile(sorted, n, 90);
+	}
+
+	if (ok < runs)
+		release_p90 = -1;
+
+cleanup:
+	free(times);
+	free(sorted);
+	return release_p90;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n RUNS] [-w MS] [-f MS] [-y YAMUI] "
+		"[-- YAMUI_ARGS]\n", name);
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+main(int argc, char *argv[])
+{
+	GDBusConnection *mce = NULL;
+	double limit_ms = 0, p90;
+	int opt, result = EXIT_FAILURE;
+
+	while ((opt = getopt(argc, argv, "n:w:f:y:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			runs = atoi(optarg);
+			break;
+		case 'w':
+			window_ms = atoi(optarg);
+			break;
+		case 'f':
+			limit_ms = atof(optarg);
+			break;
+		case 'y':
+			yamui_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (runs < 1 || window_ms < 0 || argc - optind > ARGS_MAX) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (optind < argc) {
+		for (yamui_arg_count = 0; optind < argc; optind++)
+			yamui_args[yamui_arg_count++] = argv[optind];
+	}
+
+	setenv("YAMUI_VIRTUAL", DEFAULT_DISPLAY, 0);
+
+	if (!bus_start() || !(mce = bus_connect()))
+		goto cleanup;
+
+	printf("%s on %s, ms from the name request\n", yamui_path,
+	       getenv("YAMUI_VIRTUAL"));
+
+	p90 = bench(mce);
+	if (limit_ms <= 0 || (p90 >= 0 && p90 <= limit_ms))
+		result = EXIT_SUCCESS;
+
+cleanup:
+	bus_disconnect(mce);
+	bus_stop();
+
+	return result;
+}
@@ -0,0 +1,553 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measure yamui startup time.
+ *
+ *   yamui-startbench [-n RUNS] [-w MS] [-m MODES] [-c CACHE] [-f MS]
+ *                    [-y YAMUI] IMAGE1 IMAGE2
+ *
+ * Starts yamui RUNS times (default 20) in each mode, with YAMUI_TIMING
+ * set so that it prints when it reaches main(), gets the display and
+ * flips, and stops it with SIGTERM MS milliseconds (default 1000) after
+ * the first flip. The display is simulated with YAMUI_VIRTUAL, 1080x2400
+ * unless set. yamui is pointed at a system bus that does not exist, so
+ * that it draws right away instead of waiting for mce to enable updates.
+ *
+ * MODES is a comma separated list of image, animate, progress and
+ * text, all by default. IMAGE1 and IMAGE2 are png files; animate uses
+ * both, image and progress the first.
+ *
+ * CACHE is warm, cold or both (default). Warm runs follow an unmeasured
+ * run. Before cold runs the page cache is dropped if that is allowed,
+ * and otherwise the files yamui had mapped and the images are evicted
+ * with posix_fadvise(). Pages other processes have mapped, like those
+ * of the C library, stay cached then.
+ *
+ * Times from starting the process are printed as percentiles:
+ *
+ *   main         yamui reached main()
+ *   display      display initialized
+ *   first-frame  first flip
+ *   steady       drawing settled: the last flip if flipping stopped,
+ *                otherwise the flip after which no interval is longer
+ *                than 1.5 times the median interval
+ *
+ * With -f, the exit status is nonzero if the 90th percentile of
+ * first-frame is over MS milliseconds in any mode, or if any run fails.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+#define DEFAULT_YAMUI   "./yamui"
+#define DEFAULT_DISPLAY "1080x2400"
+#define DEFAULT_RUNS    20
+#define DEFAULT_WINDOW  1000
+#define START_TIMEOUT   10000 /* ms to wait for the first flip */
+#define STOP_TIMEOUT    5000  /* ms to wait for exit after SIGTERM */
+#define FLIPS_MAX       4096
+#define MAPPED_MAX      128
+#define TIMING_PREFIX   "yamui: T: "
+#define NO_BUS_ADDRESS  "unix:path=/nonexistent/yamui-startbench/system_bus_socket"
+
+typedef enum {
+	EVENT_MAIN,
+	EVENT_DISPLAY,
+	EVENT_FIRST_FRAME,
+	EVENT_STEADY,
+	EVENT_COUNT
+} event_t;
+
+static const char *event_names[EVENT_COUNT] = {
+	"main", "display", "first-frame", "steady",
+};
+
+typedef struct {
+	const char *name;
+	const char *option;  /* or NULL */
+	int         images;  /* IMAGEs given to yamui */
+} bench_mode_t;
+
+static const bench_mode_t modes[] = {
+	{ "image",    NULL,                        1 },
+	{ "animate",  "--animate=200",             2 },
+	{ "progress", "--progressbar=2000",        1 },
+	{ "text",     "--text=Installing update",  0 },
+};
+
+#define MODE_COUNT ((int)(sizeof modes / sizeof *modes))
+
+/* Configuration */
+static const char *yamui_path = DEFAULT_YAMUI;
+static const char *image_paths[2];
+static int runs = DEFAULT_RUNS;
+static int window_ms = DEFAULT_WINDOW;
+
+/* Files yamui had mapped, evicted before cold runs */
+static char *mapped[MAPPED_MAX];
+static int mapped_count;
+
+/* ------------------------------------------------------------------------ */
+
+/* Same clock as g_get_monotonic_time() in yamui */
+static long long
+now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+collect_mapped(pid_t pid)
+{
+	char path[64], line[512], *file;
+	FILE *fp;
+	int i;
+
+	snprintf(path, sizeof path, "/proc/%d/maps", (int)pid);
+	if (!(fp = fopen(path, "r")))
+		return;
+
+	while (fgets(line, sizeof line, fp) && mapped_count < MAPPED_MAX) {
+		if (!(file = strchr(line, '/')))
+			continue;
+		file[strcspn(file, "\n")] = 0;
+
+		for (i = 0; i < mapped_count; i++)
+			if (!strcmp(mapped[i], file))
+				break;
+		if (i == mapped_count && (mapped[i] = strdup(file)))
+			mapped_count++;
+	}
+
+	fclose(fp);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+evict_file(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return;
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static bool
+drop_caches(void)
+{
+	int fd;
+	bool done;
+
+	sync();
+
+	if ((fd = open("/proc/sys/vm/drop_caches", O_WRONLY)) < 0)
+		return false;
+	done = write(fd, "3", 1) == 1;
+	close(fd);
+
+	return done;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+evict_caches(void)
+{
+	int i;
+
+	if (drop_caches())
+		return;
+
+	evict_file(yamui_path);
+	for (i = 0; i < 2; i++)
+		evict_file(image_paths[i]);
+	for (i = 0; i < mapped_count; i++)
+		evict_file(mapped[i]);
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+compare_times(const void *a, const void *b)
+{
+	long long ta = *(const long long *)a, tb = *(const long long *)b;
+
+	return ta < tb ? -1 : ta > tb;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Time drawing settled, from flip times before the end of the window */
+static long long
+steady_time(long long *flips, int count, long long end)
+{
+	long long intervals[FLIPS_MAX], median;
+	int i;
+
+	if (count < 2)
+		return count ? flips[0] : -1;
+
+	for (i = 0; i < count - 1; i++)
+		intervals[i] = flips[i + 1] - flips[i];
+	qsort(intervals, count - 1, sizeof *intervals, compare_times);
+	median = intervals[(count - 1) / 2];
+
+	/* Flipping stopped */
+	if (end - flips[count - 1] > 4 * median + 50000)
+		return flips[count - 1];
+
+	/* Flipping goes on: from the last interval too long back */
+	for (i = count - 1; i > 0; i--)
+		if (2 * (flips[i] - flips[i - 1]) > 3 * median)
+			break;
+
+	return flips[i];
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Handle a line of yamui output, and tell if it was a flip */
+static bool
+parse_line(const char *line, long long start, long long *times,
+	   long long *flips, int *flip_count)
+{
+	char event[32];
+	long long t;
+
+	if (strncmp(line, TIMING_PREFIX, strlen(TIMING_PREFIX)) ||
+	    sscanf(line + strlen(TIMING_PREFIX), "%31s %lld", event, &t) != 2)
+		return false;
+
+	t -= start;
+
+	if (!strcmp(event, "main"))
+		times[EVENT_MAIN] = t;
+	else if (!strcmp(event, "display"))
+		times[EVENT_DISPLAY] = t;
+	if (strcmp(event, "flip"))
+		return false;
+
+	if (*flip_count < FLIPS_MAX)
+		flips[(*flip_count)++] = t;
+	return true;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static pid_t
+spawn(const bench_mode_t *mode, int out_fd)
+{
+	const char *argv[8];
+	int argc = 0, i, null_fd;
+	pid_t pid;
+
+	argv[argc++] = yamui_path;
+	if (mode->option)
+		argv[argc++] = mode->option;
+	for (i = 0; i < mode->images; i++)
+		argv[argc++] = image_paths[i];
+	argv[argc] = NULL;
+
+	if ((pid = fork()) != 0)
+		return pid;
+
+	/* Timing lines come on stderr, the rest is not of interest */
+	null_fd = open("/dev/null", O_WRONLY);
+	dup2(null_fd, STDOUT_FILENO);
+	dup2(out_fd, STDERR_FILENO);
+	setenv("YAMUI_TIMING", "1", 1);
+	setenv("DBUS_SYSTEM_BUS_ADDRESS", NO_BUS_ADDRESS, 1);
+	execv(yamui_path, (char **)argv);
+	_exit(127);
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Start yamui, read its timing and stop it. Fills times from process
+ * start in microseconds. */
+static int
+run(const bench_mode_t *mode, long long *times, bool collect)
+{
+	static long long flips[FLIPS_MAX];
+	char buf[4096];
+	size_t len = 0;
+	int fds[2], flip_count = 0, status, i;
+	long long start, deadline, stopped = 0;
+	struct pollfd pfd;
+	pid_t pid;
+	ssize_t n;
+	char *end;
+
+	for (i = 0; i < EVENT_COUNT; i++)
+		times[i] = -1;
+
+	if (pipe2(fds, O_CLOEXEC) < 0) {
+		perror("pipe2() failed");
+		return -1;
+	}
+
+	start = now_us();
+	if ((pid = spawn(mode, fds[1])) < 0) {
+		perror("fork() failed");
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	close(fds[1]);
+
+	deadline = start + START_TIMEOUT * 1000LL;
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+
+	for (;;) {
+		long long now = now_us();
+
+		if (now >= deadline) {
+			if (stopped) {
+				kill(pid, SIGKILL);
+				break;
+			}
+			kill(pid, SIGTERM);
+			stopped = now;
+			deadline = now + STOP_TIMEOUT * 1000LL;
+		}
+
+		if (poll(&pfd, 1, (deadline - now) / 1000 + 1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (!(pfd.revents & (POLLIN | POLLHUP)))
+			continue;
+
+		if ((n = read(fds[0], buf + len, sizeof buf - len - 1)) <= 0)
+			break;
+		len += n;
+		buf[len] = 0;
+
+		/* Complete lines */
+		while ((end = strchr(buf, '\n'))) {
+			*end = 0;
+			if (parse_line(buf, start, times, flips, &flip_count) &&
+			    !stopped && flip_count == 1) {
+				deadline = start + flips[0] +
+					   window_ms * 1000LL;
+				if (collect)
+					collect_mapped(pid);
+			}
+			len -= end + 1 - buf;
+			memmove(buf, end + 1, len + 1);
+		}
+		if (len == sizeof buf - 1)
+			len = 0;
+	}
+
+	close(fds[0]);
+	waitpid(pid, &status, 0);
+
+	/* Flips after SIGTERM belong to exit, like fade out */
+	while (flip_count > 0 && stopped &&
+	       flips[flip_count - 1] > stopped - start)
+		flip_count--;
+
+	if (!flip_count) {
+		fprintf(stderr, "%s: no frames\n", mode->name);
+		return -1;
+	}
+
+	times[EVENT_FIRST_FRAME] = flips[0];
+	times[EVENT_STEADY] = steady_time(flips, flip_count,
+					  stopped ? stopped - start :
+						    now_us() - start);
+
+	return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Nearest rank percentile of sorted times */
+static double
+percentile(const long long *sorted, int count, int pct)
+{
+	int rank = (pct * count + 99) / 100;
+
+	return sorted[rank > 0 ? rank - 1 : 0] / 1000.0;
+}
+
+/* ------------------------------------------------------------------------ */
+
+/* Returns the 90th percentile of first-frame in ms, or -1 if no run
+ * worked */
+static double
+bench(const bench_mode_t *mode, bool cold)
+{
+	long long (*times)[EVENT_COUNT] = calloc(runs, sizeof(*times));
+	long long *sorted = calloc(runs, sizeof(*sorted));
+	double first_frame_p90 = -1;
+	int i, ok = 0, event;
+
+	if (!times || !sorted)
+		goto cleanup;
+
+	/* Unmeasured run warms the cache and finds the files to evict */
+	if (!cold || !mapped_count)
+		run(mode, times[0], !mapped_count);
+
+	for (i = 0; i < runs; i++) {
+		if (cold)
+			evict_caches();
+		if (run(mode, times[ok], false) == 0)
+			ok++;
+	}
+
+	printf("%-9s %-5s %3d/%-3d", mode->name, cold ? "cold" : "warm", ok,
+	       runs);
+
+	for (event = 0; event < EVENT_COUNT; event++) {
+		int n = 0;
+
+		for (i = 0; i < ok; i++)
+			if (times[i][event] >= 0)
+				sorted[n++] = times[i][event];
+		qsort(sorted, n, sizeof *sorted, compare_times);
+
+		if (event)
+			printf("%-23s", "");
+		if (!n) {
+			printf(" %-12s %8s\n", event_names[event], "-");
+			continue;
+		}
+		printf(" %-12s %8.1f %8.1f %8.1f %8.1f %8.1f\n",
+		       event_names[event], sorted[0] / 1000.0,
+		       percentile(sorted, n, 50), percentile(sorted, n, 90),
+		       percentile(sorted, n, 99), sorted[n - 1] / 1000.0);
+
+		if (event == EVENT_FIRST_FRAME)
+			first_frame_p90 = percentile(sorted, n, 90);
+	}
+
+	if (ok < runs)
+		first_frame_p90 = -1;
+
+cleanup:
+	free(times);
+	free(sorted);
+	return first_frame_p90;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n RUNS] [-w MS] [-m MODES] [-c CACHE] "
+		"[-f MS] [-y YAMUI] IMAGE1 IMAGE2\n", name);
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+main(int argc, char *argv[])
+{
+	const char *mode_list = NULL, *cache = "both";
+	double limit_ms = 0, p90;
+	int opt, i, cold, result = EXIT_SUCCESS;
+
+	while ((opt = getopt(argc, argv, "n:w:m:c:f:y:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			runs = atoi(optarg);
+			break;
+		case 'w':
+			window_ms = atoi(optarg);
+			break;
+		case 'm':
+			mode_list = optarg;
+			break;
+		case 'c':
+			cache = optarg;
+			break;
+		case 'f':
+			limit_ms = atof(optarg);
+			break;
+		case 'y':
+			yamui_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind != 2 || runs < 1 || window_ms < 0 ||
+	    (strcmp(cache, "warm") && strcmp(cache, "cold") &&
+	     strcmp(cache, "both"))) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	image_paths[0] = argv[optind];
+	image_paths[1] = argv[optind + 1];
+
+	setenv("YAMUI_VIRTUAL", DEFAULT_DISPLAY, 0);
+
+	printf("%s on %s, %d runs, ms from process start\n", yamui_path,
+	       getenv("YAMUI_VIRTUAL"), runs);
+	printf("%-9s %-5s %-7s %-12s %8s %8s %8s %8s %8s\n", "mode", "cache",
+	       "ok", "event", "min", "p50", "p90", "p99", "max");
+
+	for (i = 0; i < MODE_COUNT; i++) {
+		if (mode_list && !strstr(mode_list, modes[i].name))
+			continue;
+
+		for (cold = 0; cold < 2; cold++) {
+			if (strcmp(cache, "both") &&
+			    strcmp(cache, cold ? "cold" : "warm"))
+				continue;
+
+			p90 = bench(&modes[i], cold);
+			if (limit_ms > 0 && (p90 < 0 || p90 > limit_ms))
+				result = EXIT_FAILURE;
+		}
+	}
+
+	for (i = 0; i < mapped_count; i++)
+		free(mapped[i]);
+
+	return result;
+}
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Trim uniform border off splash images.
+ *
+ *   yamui-trimpng INPUT OUTPUT
+ *
+ * The color of the top-left pixel is taken to be the background, or the
+ * recorded one for an image trimmed before. Rows and columns of only
+ * that color are cut from the edges, and the rest is written to OUTPUT
+ * as 8-bit RGB PNG. A 'Trim' text chunk records where the rest goes,
+ * "WIDTH HEIGHT X Y RRGGBB", for res_create_trimmed_display_surface().
+ * Trimming a trimmed image again keeps the placement in the original
+ * image.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <png.h>
+
+typedef struct {
+	int width;
+	int height;
+	int x;
+	int y;
+	unsigned int bg; /* 0xRRGGBB, or -1 if not trimmed before */
+} trim_t;
+
+/* ------------------------------------------------------------------------ */
+
+static png_bytepp
+read_image(const char *path, int *width, int *height, trim_t *trim)
+{
+	png_structp png_ptr = NULL;
+	png_infop info_ptr = NULL;
+	png_bytepp rows = NULL, result = NULL;
+	png_textp text;
+	FILE *fp;
+	int i, num_text, h;
+
+	if (!(fp = fopen(path, "rb"))) {
+		perror(path);
+		return NULL;
+	}
+
+	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL,
+					 NULL);
+	if (!png_ptr || !(info_ptr = png_create_info_struct(png_ptr)))
+		goto exit;
+
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		fprintf(stderr, "%s: could not read PNG\n", path);
+		goto exit;
+	}
+
+	png_init_io(png_ptr, fp);
+	png_read_png(png_ptr, info_ptr, PNG_TRANSFORM_STRIP_16 |
+		     PNG_TRANSFORM_STRIP_ALPHA | PNG_TRANSFORM_PACKING |
+		     PNG_TRANSFORM_EXPAND | PNG_TRANSFORM_GRAY_TO_RGB, NULL);
+
+	*width = png_get_image_width(png_ptr, info_ptr);
+	*height = h = png_get_image_height(png_ptr, info_ptr);
+
+	trim->width = *width;
+	trim->height = *height;
+	trim->x = trim->y = 0;
+	trim->bg = -1;
+
+	if (png_get_text(png_ptr, info_ptr, &text, &num_text)) {
+		for (i = 0; i < num_text; i++)
+			if (text[i].key && !strcmp(text[i].key, "Trim") &&
+			    text[i].text)
+				sscanf(text[i].text, "%d %d %d %d %6x",
+				       &trim->width, &trim->height,
+				       &trim->x, &trim->y, &trim->bg);
+	}
+
+	/* Rows are freed with the read struct, keep copies */
+	if (!(rows = calloc(h, sizeof *rows)))
+		goto exit;
+
+	for (i = 0; i < h; i++) {
+		if (!(rows[i] = malloc(*width * 3)))
+			goto exit;
+		memcpy(rows[i], png_get_rows(png_ptr, info_ptr)[i],
+		       *width * 3);
+	}
+
+	result = rows, rows = NULL;
+
+exit:
+	if (rows) {
+		for (i = 0; i < h; i++)
+			free(rows[i]);
+		free(rows);
+	}
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+	fclose(fp);
+
+	return result;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+write_image(const char *path, png_bytepp rows, int x, int width, int height,
+	    const char *trim)
+{
+	png_structp png_ptr = NULL;
+	png_infop info_ptr = NULL;
+	png_text text = {
+		.compression = PNG_TEXT_COMPRESSION_NONE,
+		.key         = "Trim",
+		.text        = (char *)trim,
+	};
+	volatile int result = -1;
+	FILE *fp;
+	int y;
+
+	if (!(fp = fopen(path, "wb"))) {
+		perror(path);
+		return -1;
+	}
+
+	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL,
+					  NULL);
+	if (!png_ptr || !(info_ptr = png_create_info_struct(png_ptr)))
+		goto exit;
+
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		fprintf(stderr, "%s: could not write PNG\n", path);
+		goto exit;
+	}
+
+	png_init_io(png_ptr, fp);
+	png_set_compression_level(png_ptr, 9);
+	png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB,
+		     PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+		     PNG_FILTER_TYPE_DEFAULT);
+
+	/* Before image data, so that the loader gets it with the header */
+	if (trim)
+		png_set_text(png_ptr, info_ptr, &text, 1);
+
+	png_write_info(png_ptr, info_ptr);
+	for (y = 0; y < height; y++)
+		png_write_row(png_ptr, rows[y] + x * 3);
+	png_write_end(png_ptr, NULL);
+
+	result = 0;
+
+exit:
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+	if (fclose(fp) && !result) {
+		perror(path);
+		result = -1;
+	}
+
+	return result;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+column_is_bg(png_bytepp rows, int x, int y1, int y2, const png_byte *bg)
+{
+	for (; y1 < y2; y1++)
+		if (memcmp(rows[y1] + x * 3, bg, 3))
+			return 0;
+
+	return 1;
+}
+
+/* ------------------------------------------------------------------------ */
+
+static int
+row_is_bg(png_bytep row, int width, const png_byte *bg)
+{
+	int x;
+
+	for (x = 0; x < width; x++)
+		if (memcmp(row + x * 3, bg, 3))
+			return 0;
+
+	return 1;
+}
+
+/* ------------------------------------------------------------------------ */
+
+int
+main(int argc, char *argv[])
+{
+	png_bytepp rows;
+	png_byte bg[3];
+	trim_t trim;
+	char text[64];
+	int width, height, x1, y1, x2, y2, y, result;
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s INPUT OUTPUT\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!(rows = read_image(argv[1], &width, &height, &trim)))
+		return EXIT_FAILURE;
+
+	/* Keep the border color of an image trimmed before */
+	if (trim.bg != (unsigned int)-1) {
+		bg[0] = trim.bg >> 16;
+		bg[1] = trim.bg >> 8;
+		bg[2] = trim.bg;
+	} else {
+		memcpy(bg, rows[0], sizeof bg);
+	}
+
+	y1 = 0, y2 = height;
+	while (y1 < y2 - 1 && row_is_bg(rows[y1], width, bg))
+		y1++;
+	while (y2 > y1 + 1 && row_is_bg(rows[y2 - 1], width, bg))
+		y2--;
+
+	x1 = 0, x2 = width;
+	while (x1 < x2 - 1 && column_is_bg(rows, x1, y1, y2, bg))
+		x1++;
+	while (x2 > x1 + 1 && column_is_bg(rows, x2 - 1, y1, y2, bg))
+		x2--;
+
+	snprintf(text, sizeof text, "%d %d %d %d %02x%02x%02x",
+		 trim.width, trim.height, trim.x + x1, trim.y + y1,
+		 bg[0], bg[1], bg[2]);
+
+	printf("%s: %dx%d at %d,%d in %dx%d\n", argv[2], x2 - x1, y2 - y1,
+	       trim.x + x1, trim.y + y1, trim.width, trim.height);
+
+	result = write_image(argv[2], rows + y1, x1, x2 - x1, y2 - y1,
+			     x2 - x1 == trim.width && y2 - y1 == trim.height ?
+			     NULL : text);
+
+	for (y = 0; y < height; y++)
+		free(rows[y]);
+	free(rows);
+
+	return result ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2023 Jolla Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "transition.h"
+
+/* Draws that cover the whole image area, so that both display buffers
+ * hold the start image outside of the blended area */
+#define FULL_DRAWS 2
+
+struct transition {
+	gr_surface     from;
+	gr_surface     to;
+	GRRect         diff;      /* area where from and to differ */
+	int            period_ms;
+	int            steps;
+	unsigned char *schedule;  /* blend factor for each tick, steps + 1 */
+	long long      start_ms;  /* -1 until first drawn */
+	int            draws;
+	unsigned char  alpha;     /* last blend factor drawn */
+};
+
+/* ------------------------------------------------------------------------ */
+
+transition_t *
+transition_new(gr_surface from, gr_surface to, int duration_ms, int period_ms)
+{
+	transition_t *transition;
+	int i;
+
+	if (!from || !to || period_ms <= 0)
+		return NULL;
+
+	if (!(transition = calloc(1, sizeof(*transition))))
+		return NULL;
+
+	if (!gr_diff_rect(from, to, &transition->diff)) {
+		printf("transition: images have different size\n");
+		free(transition);
+		return NULL;
+	}
+
+	transition->from = from;
+	transition->to = to;
+	transition->period_ms = period_ms;
+	transition->steps = duration_ms / period_ms;
+	if (transition->steps < 1)
+		transition->steps = 1;
+	transition->start_ms = -1;
+
+	if (!(transition->schedule = malloc(transition->steps + 1))) {
+		free(transition);
+		return NULL;
+	}
+
+	/* Ease in and out: 3t^2 - 2t^3 */
+	for (i = 0; i <= transition->steps; i++) {
+		double t = (double)i / transition->steps;
+
+		transition->schedule[i] = 255 * t * t * (3 - 2 * t) + 0.5;
+	}
+
+	return transition;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+transition_free(transition_t *transition)
+{
+	if (!transition)
+		return;
+
+	free(transition->schedule);
+	free(transition);
+}
+
+/* ------------------------------------------------------------------------ */
+
+bool
+transition_draw(transition_t *transition, int dx, int dy, long long now_ms)
+{
+	const GRRect *r = &transition->diff;
+	long long step;
+
+	if (transition->start_ms < 0)
+		transition->start_ms = now_ms;
+
+	step = (now_ms - transition->start_ms) / transition->period_ms;
+	if (step > transition->steps)
+		step = transition->steps;
+
+	transition->alpha = transition->schedule[step];
+
+	if (transition->draws < FULL_DRAWS) {
+		transition->draws++;
+		transition_redraw(transition, dx, dy);
+	} else {
+		gr_blend(transition->from, transition->to,
+			 r->x1, r->y1, r->x2 - r->x1, r->y2 - r->y1,
+			 dx + r->x1, dy + r->y1, transition->alpha);
+	}
+
+	return step < transition->steps;
+}
+
+/* ------------------------------------------------------------------------ */
+
+void
+transition_redraw(transition_t *transition, int dx, int dy)
+{
+	gr_blend(transition->from, transition->to, 0, 0,
+		 gr_get_width(transition->to), gr_get_height(transition->to),
+		 dx, dy, transition->alpha);
+}
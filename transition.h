@@ -0,0 +1,43 @@
+#ifndef _TRANSITION_H_
+#define _TRANSITION_H_
+
+#include <stdbool.h>
+
+#include "minui/minui.h"
+
+/*
+ * Crossfade between two images of the same size.
+ *
+ * Only the area where the images differ is blended, and the blend
+ * factor for each frame clock tick is computed once up front.
+ */
+
+typedef struct transition transition_t;
+
+/*
+ * Prepare crossfade. The surfaces must stay valid until the transition
+ * is freed.
+ * @param from image shown at start
+ * @param to image shown at end
+ * @param duration_ms length of the crossfade
+ * @param period_ms frame clock tick interval
+ * @return transition, or NULL if the images can't be crossfaded
+ */
+transition_t *transition_new(gr_surface from, gr_surface to,
+			     int duration_ms, int period_ms);
+
+void transition_free(transition_t *transition);
+
+/*
+ * Draw next step of the crossfade. The first call starts it.
+ * @param dx, dy position of the images on screen
+ * @param now_ms frame clock time in milliseconds
+ * @return true while the crossfade is in progress
+ */
+bool transition_draw(transition_t *transition, int dx, int dy,
+		     long long now_ms);
+
+/* Draw the whole image area as it was at the last transition_draw(). */
+void transition_redraw(transition_t *transition, int dx, int dy);
+
+#endif /* _TRANSITION_H_ */
@@ -0,0 +1,55 @@
+#ifndef _YAMUI_FRAME_H_
+#define _YAMUI_FRAME_H_
+
+#include <stdint.h>
+
+/*
+ * Showing frames through yamui.
+ *
+ * Other processes can show their own content while yamui owns the
+ * display. The client connects to a SOCK_SEQPACKET unix socket at
+ * abstract address YAMUI_FRAME_SOCKET. Only root is accepted.
+ *
+ * On connect yamui sends yamui_frame_hello_t. Size is zero if the
+ * display has not been opened yet.
+ *
+ * The client then sends yamui_frame_t messages. Each one carries the
+ * file descriptor of a memfd or dma-buf holding the pixels, attached
+ * as SCM_RIGHTS. Each message is answered with one status byte:
+ * YAMUI_FRAME_OK or YAMUI_FRAME_ERROR.
+ *
+ * The buffer must be exactly the display size from the hello message.
+ * format is a DRM fourcc code. A dma-buf the display can scan out is
+ * shown as is. Otherwise the buffer is copied once. This works for
+ * DRM_FORMAT_XBGR8888 and DRM_FORMAT_ABGR8888.
+ *
+ * The buffer is shown again whenever the display is unblanked. The
+ * client must not draw to a buffer after sending it. Alternate between
+ * two buffers instead.
+ *
+ * When the client disconnects, yamui goes back to drawing its own
+ * content.
+ */
+
+#define YAMUI_FRAME_SOCKET "@yamuiframe"
+
+#define YAMUI_FRAME_OK    0
+#define YAMUI_FRAME_ERROR 1
+
+/* DRM_FORMAT_XBGR8888: bytes R, G, B, X */
+#define YAMUI_FRAME_FORMAT_XBGR8888 0x34324258
+
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uint32_t format; /* format that can be copied, DRM fourcc */
+} yamui_frame_hello_t;
+
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride; /* bytes per row */
+	uint32_t format; /* DRM fourcc */
+} yamui_frame_t;
+
+#endif /* _YAMUI_FRAME_H_ */
@@ -20,11 +20,15 @@
 #include <stdbool.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
 #include <unistd.h>
 #include <poll.h>
 #include <signal.h>
+#include <fcntl.h>
 
 #include <sys/signalfd.h>
+#include <sys/stat.h>
 #include <sys/select.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -35,8 +39,14 @@
 #include <gio/gio.h>
 
 #include <systemd/sd-daemon.h>
+#include <systemd/sd-journal.h>
 
 #include "os-update.h"
+#include "scene.h"
+#include "frameseq.h"
+#include "console.h"
+#include "spinner.h"
+#include "yamui-frame.h"
 #include "minui/minui.h"
 
 #define IMAGES_MAX      30
@@ -61,6 +71,18 @@
 # define log_debug(FMT, ARGS...)     do {} while (0)
 #endif
 
+/* Monotonic microseconds of startup, frame and handover events, for
+ * measuring with tools/yamui-startbench and tools/yamui-handover.
+ * Enabled with YAMUI_TIMING in environment.
+ */
+static bool log_timing_enabled = false;
+
+#define log_timing(EVENT) do {\
+	if (log_timing_enabled)\
+		fprintf(stderr, PFIX "T: %s %" G_GINT64_FORMAT "\n",\
+			EVENT, g_get_monotonic_time());\
+} while (0)
+
 /* ========================================================================= *
  * Prototypes
  * ========================================================================= */
@@ -74,12 +96,17 @@ static void display_release            (void);
 static bool display_is_acquired        (void);
 static void display_set_updates_enabled(bool enabled);
 static void display_set_blanked        (bool blanked);
+static bool display_is_visible         (void);
+static void display_set_external       (bool external);
 static bool display_can_be_drawn       (void);
+static void display_set_fade           (int level);
+static void display_flip               (void);
 
 /* ------------------------------------------------------------------------- *
  * SYSTEMBUS
  * ------------------------------------------------------------------------- */
 
+static const char *systembus_get_socket_path (void);
 static bool systembus_is_available           (void);
 static void systembus_probe_socket           (void);
 static void systembus_socket_monitor_event_cb(GFileMonitor *mon, GFile *file, GFile *other_file, GFileMonitorEvent event_type, gpointer user_data);
@@ -93,6 +120,19 @@ static bool systembus_init_socket_monitor    (void);
 static void mainloop_run (void);
 static void mainloop_stop(void);
 
+/* ------------------------------------------------------------------------- *
+ * FRAMECLOCK
+ * ------------------------------------------------------------------------- */
+
+typedef bool (*frameclock_cb_t)(gint64 now_ms);
+
+static gint64   frameclock_now     (void);
+static gboolean frameclock_timer_cb(gpointer aptr);
+static void     frameclock_add     (frameclock_cb_t cb);
+static void     frameclock_remove  (frameclock_cb_t cb);
+static void     frameclock_flip    (void);
+static void     frameclock_set_max_fps(int fps);
+
 /* ------------------------------------------------------------------------- *
  * SIGNALS
  * ------------------------------------------------------------------------- */
@@ -101,16 +141,53 @@ static gboolean signals_iowatch_cb(GIOChannel *chn, GIOCondition cnd, gpointer a
 static bool     signals_init      (void);
 static void     signals_quit      (void);
 
+/* ------------------------------------------------------------------------- *
+ * SCREENSHOT
+ * ------------------------------------------------------------------------- */
+
+static gboolean screenshot_done_cb(gpointer aptr);
+static gpointer screenshot_thread (gpointer aptr);
+static void     screenshot_take   (void);
+
 /* ------------------------------------------------------------------------- *
  * UNIX_SERVER
  * ------------------------------------------------------------------------- */
 
 static bool     unix_server_handle_client(void);
 static gboolean unix_server_iowatch_cb   (GIOChannel *chn, GIOCondition cnd, gpointer aptr);
-static bool     unix_server_addr         (struct sockaddr_un *sa, socklen_t *sa_len);
+static bool     unix_server_addr         (const char *path, struct sockaddr_un *sa, socklen_t *sa_len);
 static bool     unix_server_init         (void);
 static void     unix_server_quit         (void);
 
+/* ------------------------------------------------------------------------- *
+ * FRAME_SERVER
+ * ------------------------------------------------------------------------- */
+
+static bool     frame_server_draw             (void);
+static void     frame_server_drop_buffer      (void);
+static void     frame_server_drop_frame       (void);
+static void     frame_server_drop_client      (void);
+static bool     frame_server_handle_frame     (void);
+static gboolean frame_server_client_iowatch_cb(GIOChannel *chn, GIOCondition cnd, gpointer aptr);
+static bool     frame_server_handle_client    (void);
+static gboolean frame_server_iowatch_cb       (GIOChannel *chn, GIOCondition cnd, gpointer aptr);
+static bool     frame_server_init             (void);
+static void     frame_server_quit             (void);
+
+/* ------------------------------------------------------------------------- *
+ * LOGFEED
+ * ------------------------------------------------------------------------- */
+
+static void     logfeed_read_journal(void);
+static bool     logfeed_read_fd     (void);
+static gboolean logfeed_iowatch_cb  (GIOChannel *chn, GIOCondition cnd, gpointer aptr);
+static void     logfeed_read_file   (void);
+static void     logfeed_monitor_cb  (GFileMonitor *mon, GFile *file, GFile *other_file, GFileMonitorEvent event_type, gpointer user_data);
+static bool     logfeed_init_monitor(void);
+static bool     logfeed_open        (const char *source);
+static bool     logfeed_init        (const char *source);
+static void     logfeed_quit        (void);
+
 /* ------------------------------------------------------------------------- *
  * UNIX_CLIENT
  * ------------------------------------------------------------------------- */
@@ -147,16 +224,49 @@ static void     app_draw_text               (void);
 static void     app_draw_single_image_cb    (void);
 static void     app_start_single_image      (void);
 static void     app_draw_progress_bar_cb    (void);
+static bool     app_tick_progress_bar_cb    (gint64 now_ms);
+static void     app_ease_progress_bar       (void);
 static gboolean app_update_progress_bar_cb  (gpointer aptr);
 static void     app_start_progress_bar      (void);
+static void     app_draw_busy_background    (void);
+static void     app_draw_busy_cb            (void);
+static bool     app_tick_busy_cb            (gint64 now_ms);
+static void     app_start_busy              (void);
 static void     app_draw_animate_images_cb  (void);
 static gboolean app_update_animate_images_cb(gpointer aptr);
+static bool     app_tick_crossfade_cb       (gint64 now_ms);
 static void     app_start_animate_images    (void);
+static void     app_draw_scene_cb           (void);
+static bool     app_tick_scene_cb           (gint64 now_ms);
+static void     app_start_scene             (void);
+static void     app_draw_frames_cb          (void);
+static bool     app_tick_frames_cb          (gint64 now_ms);
+static void     app_start_frames            (void);
+static void     app_write_console           (const char *data, size_t size);
+static void     app_draw_console            (void);
+static bool     app_tick_console_cb         (gint64 now_ms);
+static void     app_draw_console_only_cb    (void);
+static void     app_start_console_only      (void);
+static bool     app_fade_cb                 (gint64 now_ms);
+static void     app_start_fade              (bool out);
+static void     app_quit                    (void);
 static gboolean app_start_cb                (gpointer aptr);
 static gboolean app_stop_cb                 (gpointer aptr);
 static void     app_print_short_help        (void);
 static void     app_print_long_help         (void);
 
+/* ------------------------------------------------------------------------- *
+ * SNAPSHOT
+ * ------------------------------------------------------------------------- */
+
+static guint64 snapshot_hash_bytes(guint64 hash, const void *data, size_t size);
+static guint64 snapshot_hash_file (guint64 hash, const char *path);
+static guint64 snapshot_hash      (const char *files, size_t size);
+static void    snapshot_note_file (const char *path);
+static void    snapshot_init      (const char *path, int argc, char **argv);
+static bool    snapshot_show      (void);
+static void    snapshot_store     (void);
+
 /* ------------------------------------------------------------------------- *
  * MAIN
  * ------------------------------------------------------------------------- */
@@ -171,6 +281,7 @@ static bool display_acquired = false;
 static bool display_released = false;
 static bool display_enabled  = false;
 static bool display_blanked  = false;
+static bool display_external = false;
 
 /** Acquire display
  *
@@ -188,6 +299,7 @@ display_acquire(void)
 			mainloop_stop();
 		}
 		else {
+			log_timing("display");
 			gr_color(0, 0, 0, 255);
 			gr_clear();
 		}
@@ -205,6 +317,8 @@ display_release(void)
 		display_released = true;
 		freeLogo();
 		gr_exit();
+		if (display_acquired)
+			log_timing("release");
 	}
 }
 
@@ -254,25 +368,115 @@ display_set_blanked(bool blanked)
 	}
 }
 
+/** Predicate for: something drawn would be seen
+ */
+static bool
+display_is_visible(void)
+{
+	return display_is_acquired() && display_enabled && !display_blanked;
+}
+
+/** Hand display over to / back from frame server clients
+ *
+ * While an external client shows its frames, UI drawing is suspended.
+ */
+static void
+display_set_external(bool external)
+{
+	if (display_external != external) {
+		display_external = external;
+		log_debug("showing %s frames", external ? "external" : "own");
+	}
+}
+
 /** Predicate for: UI can draw
  */
 static bool
 display_can_be_drawn(void)
 {
-	return display_is_acquired() && display_enabled && !display_blanked;
+	return display_is_visible() && !display_external;
+}
+
+/** Set when display can't fade by itself */
+static bool display_fade_in_sw = false;
+
+/** Scale brightness of display content
+ *
+ * Uses display color lookup table if possible. Otherwise the content
+ * is darkened in software, and the new level shows up with the
+ * next flip.
+ *
+ * @param level 0 (black) to 255 (as drawn)
+ */
+static void
+display_set_fade(int level)
+{
+	if (!display_is_acquired())
+		return;
+
+	if (!display_fade_in_sw) {
+		if (gr_fade(level) == 0)
+			return;
+		log_debug("fading in software");
+		display_fade_in_sw = true;
+	}
+
+	if (gr_darken(level) == -1)
+		log_err("can't fade in software");
+}
+
+/** Make drawn content visible
+ */
+static void
+display_flip(void)
+{
+	app_draw_console();
+	gr_flip();
+	log_timing("flip");
+	snapshot_store();
 }
 
 /* ========================================================================= *
  * SYSTEMBUS
  * ========================================================================= */
 
-/** Path to D-Bus SystemBus socket */
+/** Default path to D-Bus SystemBus socket */
 #define SYSTEMBUS_SOCKET_PATH "/run/dbus/system_bus_socket"
 
+/** Environment variable gio takes SystemBus address from */
+#define SYSTEMBUS_ADDRESS_ENV "DBUS_SYSTEM_BUS_ADDRESS"
+
+static gchar        *systembus_socket_path      = NULL;
 static bool          systembus_socket_exists    = false;
 static GFileMonitor *systembus_socket_monitor   = NULL;
 static gulong        systembus_monitor_event_id = 0;
 
+/** Path of the systembus socket to watch
+ *
+ * The bus gio connects to can be moved elsewhere, e.g. to a private
+ * dbus-daemon, via SYSTEMBUS_ADDRESS_ENV. Follow it when the address
+ * is a plain unix socket path.
+ */
+static const char *
+systembus_get_socket_path(void)
+{
+	static const char prefix[] = "unix:path=";
+	const char *address;
+
+	if (!systembus_socket_path) {
+		address = getenv(SYSTEMBUS_ADDRESS_ENV);
+		if (address && g_str_has_prefix(address, prefix)) {
+			address += sizeof prefix - 1;
+			systembus_socket_path =
+				g_strndup(address, strcspn(address, ",;"));
+		}
+		else {
+			systembus_socket_path = g_strdup(SYSTEMBUS_SOCKET_PATH);
+		}
+	}
+	return systembus_socket_path;
+}
+
 /** Predicate for: systembus connect can be attempted
  */
 static bool
@@ -286,7 +490,7 @@ systembus_is_available(void)
 static void
 systembus_probe_socket(void)
 {
-	bool socket_exists = (access(SYSTEMBUS_SOCKET_PATH, F_OK) == 0);
+	bool socket_exists = (access(systembus_get_socket_path(), F_OK) == 0);
 	if (systembus_socket_exists != socket_exists) {
 		log_debug("systembus_socket_exists: %s -> %s",
 			  systembus_socket_exists ? "true" : "false",
@@ -331,6 +535,7 @@ systembus_quit_socket_monitor(void)
 		g_object_unref(systembus_socket_monitor),
 			systembus_socket_monitor = NULL;
 	}
+	g_free(systembus_socket_path), systembus_socket_path = NULL;
 }
 
 /** Start monitoring systembus socket
@@ -344,24 +549,23 @@ systembus_init_socket_monitor(void)
 	GFileMonitorFlags  flags = G_FILE_MONITOR_WATCH_MOVES;
 	GError            *err   = NULL;
 	gulong             id    = 0;
+	const char        *path  = systembus_get_socket_path();
 
-	if (!(file = g_file_new_for_path(SYSTEMBUS_SOCKET_PATH))) {
-		log_err("%s: failed to create file object",
-			SYSTEMBUS_SOCKET_PATH);
+	if (!(file = g_file_new_for_path(path))) {
+		log_err("%s: failed to create file object", path);
 		goto cleanup;
 	}
 
 	if (!(mon = g_file_monitor_file(file, flags, NULL, &err))) {
 		log_err("%s: failed to create monitor object: %s",
-			SYSTEMBUS_SOCKET_PATH, err->message);
+			path, err->message);
 		goto cleanup;
 	}
 
 	if (!(id = g_signal_connect(G_OBJECT(mon), "changed",
 				    G_CALLBACK(systembus_socket_monitor_event_cb),
 				    NULL))) {
-		log_err("%s: failed to subscribe monitor sginals",
-			SYSTEMBUS_SOCKET_PATH);
+		log_err("%s: failed to subscribe monitor sginals", path);
 		goto cleanup;
 	}
 
@@ -413,6 +617,137 @@ mainloop_stop(void)
 	g_main_loop_quit(mainloop_handle);
 }
 
+/* ========================================================================= *
+ * FRAMECLOCK
+ * ========================================================================= */
+
+/** Frame clock tick interval */
+#define FRAMECLOCK_PERIOD_MS 16
+
+/** Maximum number of simultaneous frame clock users */
+#define FRAMECLOCK_CLIENTS_MAX 4
+
+static frameclock_cb_t frameclock_clients[FRAMECLOCK_CLIENTS_MAX] = {};
+static guint           frameclock_timer_id = 0;
+static bool            frameclock_ticking  = false;
+static int             frameclock_period_ms = FRAMECLOCK_PERIOD_MS;
+
+/** Get frame clock time in milliseconds
+ */
+static gint64
+frameclock_now(void)
+{
+	return g_get_monotonic_time() / 1000;
+}
+
+/** Timer callback for advancing animations
+ *
+ * Each client draws its changes to the back buffer and returns
+ * true if it wants to be called again on the next tick. All the
+ * changes are then made visible with a single flip.
+ */
+static gboolean
+frameclock_timer_cb(gpointer aptr)
+{
+	(void)aptr;
+
+	gint64 now = frameclock_now();
+	bool   active = false;
+
+	frameclock_ticking = true;
+	for (int i = 0; i < FRAMECLOCK_CLIENTS_MAX; i++) {
+		frameclock_cb_t cb = frameclock_clients[i];
+		if (!cb)
+			continue;
+		if (cb(now))
+			active = true;
+		else
+			frameclock_clients[i] = NULL;
+	}
+	frameclock_ticking = false;
+
+	if (display_can_be_drawn())
+		display_flip();
+
+	if (!active) {
+		log_debug("frame clock idle");
+		log_timing("idle");
+		frameclock_timer_id = 0;
+		return G_SOURCE_REMOVE;
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+/** Start calling cb on every frame clock tick
+ *
+ * The callback is removed when it returns false.
+ */
+static void
+frameclock_add(frameclock_cb_t cb)
+{
+	int slot = -1;
+
+	for (int i = 0; i < FRAMECLOCK_CLIENTS_MAX; i++) {
+		if (frameclock_clients[i] == cb)
+			goto cleanup;
+		if (slot == -1 && !frameclock_clients[i])
+			slot = i;
+	}
+
+	if (slot == -1) {
+		log_err("too many frame clock clients");
+		goto cleanup;
+	}
+
+	frameclock_clients[slot] = cb;
+
+	if (!frameclock_timer_id) {
+		log_debug("frame clock active");
+		frameclock_timer_id = g_timeout_add(frameclock_period_ms,
+						    frameclock_timer_cb, NULL);
+	}
+
+cleanup:
+	return;
+}
+
+/** Stop calling cb on frame clock ticks
+ */
+static void
+frameclock_remove(frameclock_cb_t cb)
+{
+	for (int i = 0; i < FRAMECLOCK_CLIENTS_MAX; i++)
+		if (frameclock_clients[i] == cb)
+			frameclock_clients[i] = NULL;
+}
+
+/** Make drawn content visible
+ *
+ * When called from a frame clock client, the flip is left to the end
+ * of the tick so that all changes show up in the same frame.
+ */
+static void
+frameclock_flip(void)
+{
+	if (!frameclock_ticking)
+		display_flip();
+}
+
+/** Tick no more often than fps times per second
+ *
+ * The display is also told, so that it can refresh less often.
+ */
+static void
+frameclock_set_max_fps(int fps)
+{
+	gr_set_max_fps(fps);
+
+	if (fps > 0 && 1000 / fps > FRAMECLOCK_PERIOD_MS)
+		frameclock_period_ms = 1000 / fps;
+	else
+		frameclock_period_ms = FRAMECLOCK_PERIOD_MS;
+}
+
 /* ========================================================================= *
  * SIGNALS
  * ========================================================================= */
@@ -431,11 +766,15 @@ signals_iowatch_cb(GIOChannel *chn, GIOCondition cnd, gpointer aptr)
 
 	/* Acknowledge the signal as received */
 	struct signalfd_siginfo si = {};
-	if (read(signals_signal_fd, &si, sizeof si) == -1)
+	if (read(signals_signal_fd, &si, sizeof si) == -1) {
 		log_err("Could not read signal fd: %m");
-	else
+	} else if (si.ssi_signo == SIGUSR1) {
+		screenshot_take();
+		return G_SOURCE_CONTINUE;
+	} else {
 		log_err("Caught signal %u: %s",
 			(unsigned)si.ssi_signo, strsignal(si.ssi_signo));
+	}
 
 	/* Request exit from mainloop */
 	mainloop_stop();
@@ -465,6 +804,7 @@ signals_init(void)
 	sigemptyset(&mask);
 	sigaddset(&mask, SIGTERM);
 	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGUSR1);
 
 	if ((fd = signalfd(-1, &mask, 0)) == -1) {
 		log_err("Could not create signal fd");
@@ -509,6 +849,7 @@ signals_quit(void)
 	sigemptyset(&mask);
 	sigaddset(&mask, SIGTERM);
 	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGUSR1);
 
 	if (sigprocmask(SIG_UNBLOCK, &mask, NULL) == -1)
 		log_err("Could not unblock signals");
@@ -524,6 +865,120 @@ signals_quit(void)
 	}
 }
 
+/* ========================================================================= *
+ * SCREENSHOT
+ * ========================================================================= */
+
+/** Directory screenshots are written to */
+#define SCREENSHOT_DIR "/tmp"
+
+/** Screenshot being written, or NULL */
+static gchar *screenshot_path = NULL;
+
+/** Copy of the screen being written */
+static gr_surface screenshot_surface = NULL;
+
+/** Result from the writer thread */
+static int screenshot_result = 0;
+
+/** Report the result of writing a screenshot, in mainloop context
+ */
+static gboolean
+screenshot_done_cb(gpointer aptr)
+{
+	(void)aptr;
+
+	if (screenshot_result)
+		log_err("%s: could not write screenshot (%d)",
+			screenshot_path, screenshot_result);
+	else
+		log_debug("%s: screenshot written", screenshot_path);
+
+	res_free_surface(screenshot_surface), screenshot_surface = NULL;
+	g_free(screenshot_path), screenshot_path = NULL;
+	return G_SOURCE_REMOVE;
+}
+
+/** Encode screenshot to a file, outside mainloop context
+ *
+ * PNG encoding takes much longer than a frame, so it must not block
+ * drawing. Only screenshot_path and screenshot_surface are used, and
+ * the mainloop does not touch them while the thread runs.
+ */
+static gpointer
+screenshot_thread(gpointer aptr)
+{
+	(void)aptr;
+
+	/* Write and rename, so that a partial file is never seen */
+	gchar *temp = g_strdup_printf("%s.tmp", screenshot_path);
+
+	screenshot_result = res_write_png(temp, screenshot_surface);
+	if (!screenshot_result && rename(temp, screenshot_path) == -1)
+		screenshot_result = -errno;
+	if (screenshot_result)
+		unlink(temp);
+	g_free(temp);
+
+	g_idle_add(screenshot_done_cb, NULL);
+	return NULL;
+}
+
+/** Save what is on screen to a PNG file in SCREENSHOT_DIR
+ *
+ * Only copying the screen is done right away. The file is written in
+ * a thread of its own.
+ */
+static void
+screenshot_take(void)
+{
+	GDateTime *now    = NULL;
+	gchar     *stamp  = NULL;
+	GThread   *thread = NULL;
+	GError    *err    = NULL;
+
+	if (screenshot_surface) {
+		log_err("Screenshot already being written");
+		goto cleanup;
+	}
+
+	if (!display_is_acquired()) {
+		log_err("Screenshot not taken: display not in use");
+		goto cleanup;
+	}
+
+	if (!(screenshot_surface = gr_copy_screen())) {
+		log_err("Screenshot not taken: screen content not available");
+		goto cleanup;
+	}
+
+	if (gr_has_overlay())
+		log_debug("Screenshot lacks logo shown on overlay plane");
+
+	now = g_date_time_new_now_local();
+	stamp = g_date_time_format(now, "%Y%m%d-%H%M%S");
+	screenshot_path = g_strdup_printf("%s/yamui-screenshot-%s.png",
+					  SCREENSHOT_DIR, stamp);
+
+	if (!(thread = g_thread_try_new("screenshot", screenshot_thread,
+					NULL, &err))) {
+		log_err("Could not start screenshot thread: %s", err->message);
+		res_free_surface(screenshot_surface), screenshot_surface = NULL;
+		g_free(screenshot_path), screenshot_path = NULL;
+		goto cleanup;
+	}
+
+	/* Thread is not joined, it reports back via idle callback */
+	g_thread_unref(thread);
+
+cleanup:
+	if (err)
+		g_error_free(err);
+	g_free(stamp);
+	if (now)
+		g_date_time_unref(now);
+}
+
 /* ========================================================================= *
  * UNIX_SERVER
  * ========================================================================= */
@@ -571,22 +1026,22 @@ unix_server_iowatch_cb(GIOChannel *chn, GIOCondition cnd, gpointer aptr)
 	}
 
 	if (unix_server_handle_client())
-		mainloop_stop();
+		app_quit();
 	return G_SOURCE_CONTINUE;
 }
 
 static bool
-unix_server_addr(struct sockaddr_un *sa, socklen_t *sa_len)
+unix_server_addr(const char *path, struct sockaddr_un *sa, socklen_t *sa_len)
 {
-	socklen_t len = strnlen(unix_server_path, sizeof sa->sun_path) + 1;
+	socklen_t len = strnlen(path, sizeof sa->sun_path) + 1;
 	if (len > sizeof sa->sun_path) {
-		log_err("%s: unix socket path too long", unix_server_path);
+		log_err("%s: unix socket path too long", path);
 		return false;
 	}
 
 	memset(sa, 0, sizeof *sa);
 	sa->sun_family = AF_UNIX;
-	strcpy(sa->sun_path, unix_server_path);
+	strcpy(sa->sun_path, path);
 	/* Starts with a '@' -> turn into abstract address */
 	if (sa->sun_path[0] == '@')
 		sa->sun_path[0] = 0;
@@ -615,7 +1070,7 @@ unix_server_init(void)
 	if (unix_server_iowatch_id != 0)
 		goto cleanup;
 
-	if (!unix_server_addr(&sa, &len))
+	if (!unix_server_addr(unix_server_path, &sa, &len))
 		goto cleanup;
 
 	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
@@ -667,71 +1122,728 @@ unix_server_quit(void)
 }
 
 /* ========================================================================= *
- * UNIX_CLIENT
+ * FRAME_SERVER
  * ========================================================================= */
 
-/** Terminate already running splashscreen application via unix socket ipc
+static const char    frame_server_path[]           = YAMUI_FRAME_SOCKET;
+static int           frame_server_socket_fd        = -1;
+static guint         frame_server_iowatch_id       = 0;
+static int           frame_server_client_fd        = -1;
+static guint         frame_server_client_iowatch_id = 0;
+static int           frame_server_buffer_fd        = -1;
+static yamui_frame_t frame_server_buffer           = {};
+
+/** Show the latest buffer received from client
  *
- * This is expected to work only when there is splashscreen application
- * running that was started before systembus became available.
+ * A buffer that can't be shown is dropped, and own UI drawn instead.
+ *
+ * @return true if the buffer is on screen
  */
 static bool
-unix_client_terminate_server(void)
+frame_server_draw(void)
 {
-	bool               ack = false;
-	int                fd  = -1;
-	struct sockaddr_un sa  = {};
-	socklen_t          len = 0;
+	if (frame_server_buffer_fd == -1 || !display_is_visible())
+		return false;
 
-	if (!unix_server_addr(&sa, &len))
-		goto cleanup;
+	if (gr_show_buffer(frame_server_buffer_fd,
+			   frame_server_buffer.width,
+			   frame_server_buffer.height,
+			   frame_server_buffer.stride,
+			   frame_server_buffer.format) == -1) {
+		log_err("%s: could not show %ux%u buffer", frame_server_path,
+			frame_server_buffer.width, frame_server_buffer.height);
+		frame_server_drop_frame();
+		return false;
+	}
+	return true;
+}
 
-	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
-		log_err("%s: socket(): %m", unix_server_path);
-		goto cleanup;
+/** Forget buffer received from client
+ */
+static void
+frame_server_drop_buffer(void)
+{
+	if (frame_server_buffer_fd != -1)
+		close(frame_server_buffer_fd), frame_server_buffer_fd = -1;
+}
+
+/** Forget buffer received from client and go back to drawing own UI
+ */
+static void
+frame_server_drop_frame(void)
+{
+	frame_server_drop_buffer();
+
+	if (display_external) {
+		display_set_external(false);
+		app_draw_ui();
 	}
+}
 
-	if (connect(fd, (struct sockaddr *)&sa, len) == -1) {
-		if (errno == ECONNREFUSED) {
-			log_debug("%s: server not running", unix_server_path);
-			goto success;
-		}
-		log_err("%s: connect(): %m", unix_server_path);
-		goto cleanup;
+/** Disconnect client and go back to drawing own UI
+ */
+static void
+frame_server_drop_client(void)
+{
+	if (frame_server_client_iowatch_id)
+		g_source_remove(frame_server_client_iowatch_id),
+			frame_server_client_iowatch_id = 0;
+
+	if (frame_server_client_fd != -1) {
+		close(frame_server_client_fd), frame_server_client_fd = -1;
+		log_debug("%s: client disconnected", frame_server_path);
 	}
 
-	char tmp[32];
-	int rc = read(fd, tmp, sizeof tmp);
+	frame_server_drop_frame();
+}
 
+/** Receive buffer from client and show it
+ *
+ * @return false if the client should be disconnected
+ */
+static bool
+frame_server_handle_frame(void)
+{
+	bool            keep   = false;
+	unsigned char   status = YAMUI_FRAME_ERROR;
+	int             fd     = -1;
+	yamui_frame_t   frame  = {};
+	char            ctl[CMSG_SPACE(sizeof fd)];
+	struct iovec    iov    = { .iov_base = &frame, .iov_len = sizeof frame };
+	struct msghdr   msg    = {
+		.msg_iov        = &iov,
+		.msg_iovlen     = 1,
+		.msg_control    = ctl,
+		.msg_controllen = sizeof ctl,
+	};
+	struct cmsghdr *cmsg;
+
+	ssize_t rc = recvmsg(frame_server_client_fd, &msg, MSG_CMSG_CLOEXEC);
 	if (rc == -1) {
-		log_err("%s: read(): %m", unix_server_path);
+		log_err("%s: recvmsg(): %m", frame_server_path);
 		goto cleanup;
 	}
-
-	if (rc > 0) {
-		log_err("%s: read(): got data?", unix_server_path);
+	if (rc == 0)
 		goto cleanup;
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+	    cmsg->cmsg_type == SCM_RIGHTS &&
+	    cmsg->cmsg_len == CMSG_LEN(sizeof fd))
+		memcpy(&fd, CMSG_DATA(cmsg), sizeof fd);
+
+	keep = true;
+
+	if (rc != sizeof frame || fd == -1 || (msg.msg_flags & MSG_CTRUNC)) {
+		log_err("%s: malformed frame message", frame_server_path);
+		goto reply;
+	}
+	if (frame.width == 0 || frame.height == 0 ||
+	    frame.width > INT_MAX / 4 || frame.stride > INT_MAX ||
+	    frame.stride < frame.width * 4 || frame.height > INT_MAX) {
+		log_err("%s: bad frame geometry", frame_server_path);
+		goto reply;
 	}
 
-	log_debug("%s: read(): got EOF", unix_server_path);
+	/* Swap buffers first, gr_show_buffer() reads the new one */
+	frame_server_drop_buffer();
+	frame_server_buffer_fd = fd, fd = -1;
+	frame_server_buffer = frame;
 
-success:
-	ack = true;
+	display_set_external(true);
+
+	/* While display is off, the buffer waits for unblank */
+	if (display_is_visible() && !frame_server_draw())
+		goto reply;
+	status = YAMUI_FRAME_OK;
+
+reply:
+	if (send(frame_server_client_fd, &status, sizeof status,
+		 MSG_NOSIGNAL) == -1) {
+		log_err("%s: send(): %m", frame_server_path);
+		keep = false;
+	}
 
 cleanup:
 	if (fd != -1)
 		close(fd);
-	return ack;
+	return keep;
 }
 
-/* ========================================================================= *
- * COMPOSITOR
- * ========================================================================= */
-
-/** Well known dbus name of compositor service */
-#define COMPOSITOR_SERVICE                     "org.nemomobile.compositor"
-#define COMPOSITOR_PATH                        "/"
-#define COMPOSITOR_IFACE                       "org.nemomobile.compositor"
+/** I/O watch callback for handling messages from client
+ */
+static gboolean
+frame_server_client_iowatch_cb(GIOChannel *chn, GIOCondition cnd,
+			       gpointer aptr)
+{
+	(void)chn;
+	(void)aptr;
+
+	if ((cnd & ~G_IO_IN) || !frame_server_handle_frame()) {
+		/* Watch is removed by returning G_SOURCE_REMOVE */
+		frame_server_client_iowatch_id = 0;
+		frame_server_drop_client();
+		return G_SOURCE_REMOVE;
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+/** Accept client connecting to frame server socket
+ *
+ * Only one client is served at a time. A new client replaces the
+ * previous one.
+ */
+static bool
+frame_server_handle_client(void)
+{
+	int                 fd    = -1;
+	GIOChannel         *chn   = NULL;
+	GIOCondition        cnd   = G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL;
+	struct ucred        cred  = {};
+	socklen_t           len   = sizeof cred;
+	yamui_frame_hello_t hello = {
+		.format = YAMUI_FRAME_FORMAT_XBGR8888,
+	};
+
+	if ((fd = accept4(frame_server_socket_fd, NULL, NULL,
+			  SOCK_CLOEXEC)) == -1) {
+		log_err("%s: accept(): %m", frame_server_path);
+		goto cleanup;
+	}
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1) {
+		log_err("%s: getsockopt(): %m", frame_server_path);
+		goto cleanup;
+	}
+	if (cred.uid != 0) {
+		log_err("%s: rejected client with uid %d", frame_server_path,
+			(int)cred.uid);
+		goto cleanup;
+	}
+
+	if (display_is_acquired()) {
+		hello.width = gr_fb_width();
+		hello.height = gr_fb_height();
+	}
+	if (send(fd, &hello, sizeof hello, MSG_NOSIGNAL) == -1) {
+		log_err("%s: send(): %m", frame_server_path);
+		goto cleanup;
+	}
+
+	if (!(chn = g_io_channel_unix_new(fd))) {
+		log_err("Could not create frame client io channel");
+		goto cleanup;
+	}
+
+	frame_server_drop_client();
+
+	if (!(frame_server_client_iowatch_id =
+	      g_io_add_watch(chn, cnd, frame_server_client_iowatch_cb, NULL))) {
+		log_err("Could not add frame client io watch");
+		goto cleanup;
+	}
+
+	frame_server_client_fd = fd, fd = -1;
+	log_debug("%s: client pid %d connected", frame_server_path,
+		  (int)cred.pid);
+
+cleanup:
+	if (chn)
+		g_io_channel_unref(chn);
+	if (fd != -1)
+		close(fd);
+
+	return frame_server_client_fd != -1;
+}
+
+/** I/O watch callback for handling connects to frame server socket
+ */
+static gboolean
+frame_server_iowatch_cb(GIOChannel *chn, GIOCondition cnd, gpointer aptr)
+{
+	(void)chn;
+	(void)aptr;
+
+	if (cnd & ~G_IO_IN) {
+		log_err("%s: server socket failed", frame_server_path);
+		frame_server_iowatch_id = 0;
+		return G_SOURCE_REMOVE;
+	}
+
+	frame_server_handle_client();
+	return G_SOURCE_CONTINUE;
+}
+
+/** Start frame server
+ *
+ * Lets other early boot components, such as installer or encryption
+ * unlock prompt, show their content without their own display code.
+ * See yamui-frame.h for the protocol.
+ */
+static bool
+frame_server_init(void)
+{
+	int                fd  = -1;
+	GIOChannel        *chn = NULL;
+	guint              wid = 0;
+	GIOCondition       cnd = G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL;
+	struct sockaddr_un sa  = {};
+	socklen_t          len = 0;
+
+	if (frame_server_iowatch_id != 0)
+		goto cleanup;
+
+	if (!unix_server_addr(frame_server_path, &sa, &len))
+		goto cleanup;
+
+	if ((fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) == -1) {
+		log_err("%s: socket(): %m", frame_server_path);
+		goto cleanup;
+	}
+	if (bind(fd, (struct sockaddr *)&sa, len) == -1) {
+		log_err("%s: bind(): %m", frame_server_path);
+		goto cleanup;
+	}
+	if (listen(fd, 1) == -1) {
+		log_err("%s: listen(): %m", frame_server_path);
+		goto cleanup;
+	}
+	if (!(chn = g_io_channel_unix_new(fd))) {
+		log_err("Could not create frame server io channel");
+		goto cleanup;
+	}
+
+	if (!(wid = g_io_add_watch(chn, cnd, frame_server_iowatch_cb, NULL))) {
+		log_err("Could not add frame server io watch");
+		goto cleanup;
+	}
+
+	frame_server_socket_fd = fd, fd = -1;
+	frame_server_iowatch_id = wid, wid = 0;
+
+cleanup:
+	if (wid)
+		g_source_remove(wid);
+	if (chn)
+		g_io_channel_unref(chn);
+	if (fd != -1)
+		close(fd);
+
+	return frame_server_iowatch_id != 0;
+}
+
+/** Stop frame server
+ */
+static void
+frame_server_quit(void)
+{
+	if (frame_server_iowatch_id)
+		g_source_remove(frame_server_iowatch_id),
+			frame_server_iowatch_id = 0;
+
+	if (frame_server_socket_fd != -1)
+		close(frame_server_socket_fd), frame_server_socket_fd = -1;
+
+	if (frame_server_client_iowatch_id)
+		g_source_remove(frame_server_client_iowatch_id),
+			frame_server_client_iowatch_id = 0;
+
+	if (frame_server_client_fd != -1)
+		close(frame_server_client_fd), frame_server_client_fd = -1;
+
+	frame_server_drop_buffer();
+}
+
+/* ========================================================================= *
+ * LOGFEED
+ * ========================================================================= */
+
+/** Source name for following systemd journal */
+#define LOGFEED_JOURNAL "journal"
+
+/** Journal entries to show from before startup */
+#define LOGFEED_JOURNAL_BACKLOG 50
+
+/** Milliseconds between reads of a followed file while it is written */
+#define LOGFEED_FILE_RATE_LIMIT 100
+
+static int           logfeed_fd         = -1;
+static guint         logfeed_iowatch_id = 0;
+static sd_journal   *logfeed_journal    = NULL;
+static gchar        *logfeed_path       = NULL;
+static GFileMonitor *logfeed_monitor    = NULL;
+static gulong        logfeed_monitor_id = 0;
+
+/** Pass new journal entries to console
+ */
+static void
+logfeed_read_journal(void)
+{
+	const void *data;
+	size_t      size;
+
+	do {
+		if (sd_journal_get_data(logfeed_journal, "SYSLOG_IDENTIFIER",
+					&data, &size) >= 0 && size > 18) {
+			app_write_console((const char *)data + 18, size - 18);
+			app_write_console(": ", 2);
+		}
+		if (sd_journal_get_data(logfeed_journal, "MESSAGE",
+					&data, &size) >= 0 && size > 8)
+			app_write_console((const char *)data + 8, size - 8);
+		app_write_console("\n", 1);
+	} while (sd_journal_next(logfeed_journal) > 0);
+}
+
+/** Pass data read from file descriptor to console
+ *
+ * @return false on end of file or error
+ */
+static bool
+logfeed_read_fd(void)
+{
+	char    buf[4096];
+	ssize_t rc = read(logfeed_fd, buf, sizeof buf);
+
+	if (rc > 0) {
+		app_write_console(buf, rc);
+		return true;
+	}
+	if (rc == -1 && (errno == EAGAIN || errno == EINTR))
+		return true;
+	if (rc == -1)
+		log_err("console: read(): %m");
+	else
+		log_debug("console: end of input");
+	return false;
+}
+
+/** I/O watch callback for handling console input
+ */
+static gboolean
+logfeed_iowatch_cb(GIOChannel *chn, GIOCondition cnd, gpointer aptr)
+{
+	(void)chn;
+	(void)aptr;
+
+	if (logfeed_journal) {
+		sd_journal_process(logfeed_journal);
+		if (sd_journal_next(logfeed_journal) > 0)
+			logfeed_read_journal();
+		return G_SOURCE_CONTINUE;
+	}
+
+	if ((cnd & G_IO_IN) && logfeed_read_fd())
+		return G_SOURCE_CONTINUE;
+
+	/* Keep what was shown, but stop following */
+	logfeed_iowatch_id = 0;
+	logfeed_quit();
+	return G_SOURCE_REMOVE;
+}
+
+/** Pass data appended to followed file to console
+ *
+ * Reading continues from where it stopped. If the file was truncated
+ * it is read from the start, and if it was replaced by a new one, the
+ * rest of the old one is read before switching over.
+ */
+static void
+logfeed_read_file(void)
+{
+	char        buf[4096];
+	ssize_t     rc;
+	struct stat st  = {};
+	struct stat cur = {};
+	int         fd;
+
+	for (;;) {
+		while ((rc = read(logfeed_fd, buf, sizeof buf)) > 0)
+			app_write_console(buf, rc);
+		if (rc == -1 && errno != EINTR) {
+			log_err("%s: read(): %m", logfeed_path);
+			break;
+		}
+
+		if (fstat(logfeed_fd, &cur) == -1)
+			break;
+		if (lseek(logfeed_fd, 0, SEEK_CUR) > cur.st_size) {
+			log_debug("%s: truncated", logfeed_path);
+			lseek(logfeed_fd, 0, SEEK_SET);
+			continue;
+		}
+
+		if (stat(logfeed_path, &st) == -1 ||
+		    (st.st_dev == cur.st_dev && st.st_ino == cur.st_ino))
+			break;
+		if ((fd = open(logfeed_path, O_RDONLY | O_CLOEXEC)) == -1) {
+			log_err("%s: open(): %m", logfeed_path);
+			break;
+		}
+		log_debug("%s: replaced", logfeed_path);
+		dup2(fd, logfeed_fd);
+		close(fd);
+	}
+}
+
+/** File monitor callback for following console input file
+ */
+static void
+logfeed_monitor_cb(GFileMonitor *mon,
+		   GFile *file,
+		   GFile *other_file,
+		   GFileMonitorEvent event_type,
+		   gpointer user_data)
+{
+	(void)mon;
+	(void)file;
+	(void)other_file;
+	(void)event_type;
+	(void)user_data;
+
+	logfeed_read_file();
+}
+
+/** Start following console input file
+ */
+static bool
+logfeed_init_monitor(void)
+{
+	bool               ack   = false;
+	GFileMonitor      *mon   = NULL;
+	GFile             *file  = NULL;
+	GFileMonitorFlags  flags = G_FILE_MONITOR_WATCH_MOVES;
+	GError            *err   = NULL;
+	gulong             id    = 0;
+
+	if (!(file = g_file_new_for_path(logfeed_path))) {
+		log_err("%s: failed to create file object", logfeed_path);
+		goto cleanup;
+	}
+
+	if (!(mon = g_file_monitor_file(file, flags, NULL, &err))) {
+		log_err("%s: failed to create monitor object: %s",
+			logfeed_path, err->message);
+		goto cleanup;
+	}
+	g_file_monitor_set_rate_limit(mon, LOGFEED_FILE_RATE_LIMIT);
+
+	if (!(id = g_signal_connect(G_OBJECT(mon), "changed",
+				    G_CALLBACK(logfeed_monitor_cb), NULL))) {
+		log_err("%s: failed to subscribe monitor signals",
+			logfeed_path);
+		goto cleanup;
+	}
+
+	logfeed_monitor = mon, mon = NULL;
+	logfeed_monitor_id = id, id = 0;
+	ack = true;
+
+	logfeed_read_file();
+
+cleanup:
+	if (id)
+		g_signal_handler_disconnect(mon, id);
+	if (mon)
+		g_object_unref(mon);
+	if (file)
+		g_object_unref(file);
+	g_clear_error(&err);
+
+	return ack;
+}
+
+/** Open console input
+ *
+ * @param source "-" for stdin, "journal" or path to a file or fifo
+ */
+static bool
+logfeed_open(const char *source)
+{
+	struct stat st = {};
+	int         rc;
+
+	if (!strcmp(source, LOGFEED_JOURNAL)) {
+		if ((rc = sd_journal_open(&logfeed_journal,
+					  SD_JOURNAL_LOCAL_ONLY)) < 0) {
+			log_err("console: sd_journal_open(): %s", strerror(-rc));
+			return false;
+		}
+		if ((logfeed_fd = sd_journal_get_fd(logfeed_journal)) < 0) {
+			log_err("console: sd_journal_get_fd(): %s",
+				strerror(-logfeed_fd));
+			return false;
+		}
+		sd_journal_seek_tail(logfeed_journal);
+		if (sd_journal_previous_skip(logfeed_journal,
+					     LOGFEED_JOURNAL_BACKLOG) > 0)
+			logfeed_read_journal();
+		return true;
+	}
+
+	if (!strcmp(source, "-")) {
+		/* Shares file status flags with the caller, so it is left
+		 * blocking; the io watch reads only when there is data */
+		if ((logfeed_fd = dup(STDIN_FILENO)) == -1) {
+			log_err("console: dup(): %m");
+			return false;
+		}
+		return true;
+	}
+	else if (stat(source, &st) == 0 && S_ISFIFO(st.st_mode)) {
+		/* Being a writer too avoids end of file before the
+		 * real writer opens the fifo, or when it reopens it */
+		logfeed_fd = open(source, O_RDWR | O_CLOEXEC);
+	}
+	else {
+		/* Regular files are followed as they grow */
+		if (S_ISREG(st.st_mode))
+			logfeed_path = g_strdup(source);
+		logfeed_fd = open(source, O_RDONLY | O_CLOEXEC);
+	}
+
+	if (logfeed_fd == -1) {
+		log_err("%s: open(): %m", source);
+		return false;
+	}
+	fcntl(logfeed_fd, F_SETFL, fcntl(logfeed_fd, F_GETFL) | O_NONBLOCK);
+	return true;
+}
+
+/** Start feeding console
+ *
+ * @param source "-" for stdin, "journal" or path to a file or fifo
+ */
+static bool
+logfeed_init(const char *source)
+{
+	GIOChannel   *chn = NULL;
+	GIOCondition  cnd = G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL;
+
+	if (logfeed_iowatch_id || logfeed_monitor)
+		goto cleanup;
+
+	if (!logfeed_open(source))
+		goto cleanup;
+
+	/* Regular files are always readable, so an io watch would not
+	 * wait for more data */
+	if (logfeed_path) {
+		logfeed_init_monitor();
+		goto cleanup;
+	}
+
+	if (!(chn = g_io_channel_unix_new(logfeed_fd))) {
+		log_err("Could not create console io channel");
+		goto cleanup;
+	}
+
+	if (!(logfeed_iowatch_id = g_io_add_watch(chn, cnd,
+						  logfeed_iowatch_cb, NULL)))
+		log_err("Could not add console io watch");
+
+cleanup:
+	if (chn)
+		g_io_channel_unref(chn);
+	if (!logfeed_iowatch_id && !logfeed_monitor)
+		logfeed_quit();
+
+	return logfeed_iowatch_id || logfeed_monitor;
+}
+
+/** Stop feeding console
+ */
+static void
+logfeed_quit(void)
+{
+	if (logfeed_iowatch_id)
+		g_source_remove(logfeed_iowatch_id), logfeed_iowatch_id = 0;
+
+	if (logfeed_monitor) {
+		if (logfeed_monitor_id)
+			g_signal_handler_disconnect(logfeed_monitor,
+						    logfeed_monitor_id),
+				logfeed_monitor_id = 0;
+		g_object_unref(logfeed_monitor), logfeed_monitor = NULL;
+	}
+	g_free(logfeed_path), logfeed_path = NULL;
+
+	if (logfeed_journal) {
+		/* Descriptor is owned by journal */
+		sd_journal_close(logfeed_journal), logfeed_journal = NULL;
+		logfeed_fd = -1;
+	}
+
+	if (logfeed_fd != -1)
+		close(logfeed_fd), logfeed_fd = -1;
+}
+
+/* ========================================================================= *
+ * UNIX_CLIENT
+ * ========================================================================= */
+
+/** Terminate already running splashscreen application via unix socket ipc
+ *
+ * This is expected to work only when there is splashscreen application
+ * running that was started before systembus became available.
+ */
+static bool
+unix_client_terminate_server(void)
+{
+	bool               ack = false;
+	int                fd  = -1;
+	struct sockaddr_un sa  = {};
+	socklen_t          len = 0;
+
+	if (!unix_server_addr(unix_server_path, &sa, &len))
+		goto cleanup;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		log_err("%s: socket(): %m", unix_server_path);
+		goto cleanup;
+	}
+
+	if (connect(fd, (struct sockaddr *)&sa, len) == -1) {
+		if (errno == ECONNREFUSED) {
+			log_debug("%s: server not running", unix_server_path);
+			goto success;
+		}
+		log_err("%s: connect(): %m", unix_server_path);
+		goto cleanup;
+	}
+
+	char tmp[32];
+	int rc = read(fd, tmp, sizeof tmp);
+
+	if (rc == -1) {
+		log_err("%s: read(): %m", unix_server_path);
+		goto cleanup;
+	}
+
+	if (rc > 0) {
+		log_err("%s: read(): got data?", unix_server_path);
+		goto cleanup;
+	}
+
+	log_debug("%s: read(): got EOF", unix_server_path);
+
+success:
+	ack = true;
+
+cleanup:
+	if (fd != -1)
+		close(fd);
+	return ack;
+}
+
+/* ========================================================================= *
+ * COMPOSITOR
+ * ========================================================================= */
+
+/** Well known dbus name of compositor service */
+#define COMPOSITOR_SERVICE                     "org.nemomobile.compositor"
+#define COMPOSITOR_PATH                        "/"
+#define COMPOSITOR_IFACE                       "org.nemomobile.compositor"
 
 /** Enabling/disabling display updates via compositor service */
 #define COMPOSITOR_SET_UPDATES_ENABLED         "setUpdatesEnabled"
@@ -945,7 +2057,8 @@ compositor_name_lost_cb(GDBusConnection *connection,
 	}
 	else if (compositor_name_acquired) {
 		log_debug("service handover");
-		mainloop_stop();
+		log_timing("handover");
+		app_quit();
 	}
 	else {
 		log_debug("waiting for name...");
@@ -1059,11 +2172,30 @@ compositor_quit(void)
  * ========================================================================= */
 
 static unsigned long int        app_animate_ms            = 0;
+static unsigned long int        app_crossfade_ms          = 0;
+static unsigned long int        app_fade_ms               = 0;
+static gint64                   app_fade_start_ms         = 0;
+static bool                     app_fading_out            = false;
 static unsigned long long int   app_stop_ms               = 0;
 static unsigned long long int   app_progress_ms           = 0;
+static int                      app_progress_shown        = 0;
+static int                      app_progress_drawn        = 0;
+static gint64                   app_progress_tick_ms      = 0;
+static bool                     app_progress_easing       = false;
+static int                      app_progress_redraws      = 0;
+static const char              *app_busy_style            = NULL;
+static spinner_t               *app_spinner               = NULL;
+static int                      app_busy_redraws          = 0;
 static char                    *app_text                  = NULL;
 static gchar                   *app_images[IMAGES_MAX]    = {};
 static const char              *app_images_dir            = "/res/images";;
+static const char              *app_scene_path            = NULL;
+static scene_t                 *app_scene                 = NULL;
+static const char              *app_frames_path           = NULL;
+static frameseq_t              *app_frames                = NULL;
+static gint64                   app_frames_start_ms       = 0;
+static const char              *app_console_source        = NULL;
+static console_t               *app_console               = NULL;
 static int                      app_image_count           = 0;
 static bool                     app_already_enabled       = false;
 static bool                     app_systemd_notify        = false;
@@ -1175,7 +2307,9 @@ app_flush_images(void)
 static void
 app_draw_ui(void)
 {
-	if (app_draw_ui_cb)
+	if (display_external)
+		frame_server_draw();
+	else if (app_draw_ui_cb)
 		app_draw_ui_cb();
 }
 
@@ -1190,149 +2324,588 @@ app_draw_text(void)
 	}
 }
 
-/** Callback for drawing 'text_only' mode ui
+/** Callback for drawing 'text_only' mode ui
+ */
+static void
+app_draw_text_only_cb(void)
+{
+	/* Set draw on unblank hook */
+	app_draw_ui_cb = app_draw_text_only_cb;
+
+	if (display_can_be_drawn()) {
+		app_draw_text();
+		frameclock_flip();
+	}
+}
+
+/** Prepare for 'text_only' mode ui
+ */
+static void
+app_start_text_only(void)
+{
+	app_draw_text_only_cb();
+}
+
+/** Callback for drawing 'single_image' mode ui
+ */
+static void
+app_draw_single_image_cb(void)
+{
+	/* Set draw on unblank hook */
+	app_draw_ui_cb = app_draw_single_image_cb;
+
+	if (display_can_be_drawn()) {
+		showLogo();
+		app_draw_text();
+		frameclock_flip();
+	}
+}
+
+/** Prepare for 'single_image' mode ui
+ */
+static void
+app_start_single_image(void)
+{
+	if (loadLogo(app_images[0], NULL) == -1)
+		mainloop_stop();
+	else
+		app_draw_single_image_cb();
+}
+
+/** Callback for drawing 'progress_bar' mode ui
+ */
+static void
+app_draw_progress_bar_cb(void)
+{
+	/* Set draw on unblank hook */
+	app_draw_ui_cb = app_draw_progress_bar_cb;
+
+	if (display_can_be_drawn()) {
+		osUpdateScreenShowProgressFine(app_progress_shown);
+		app_draw_text();
+		frameclock_flip();
+
+		/* The other buffer lacks the background */
+		app_progress_drawn = app_progress_shown;
+		app_progress_redraws = 1;
+		app_ease_progress_bar();
+	}
+}
+
+/** Progress bar easing time constant */
+#define PROGRESS_EASE_MS 100
+
+/** Frame clock callback for moving 'progress_bar' mode ui
+ *
+ * The bar eases towards app_step, and only the columns that changed
+ * are drawn. Progress only grows, so painting from the position drawn
+ * in the frame before the last one updates either buffer.
+ */
+static bool
+app_tick_progress_bar_cb(gint64 now_ms)
+{
+	int    target  = app_step * (PROGRESS_FINE_MAX / 100);
+	int    shown   = app_progress_shown;
+	gint64 elapsed = now_ms - app_progress_tick_ms;
+
+	app_progress_tick_ms = now_ms;
+
+	/* Drawn as it is when display comes back */
+	if (!display_can_be_drawn())
+		goto idle;
+
+	if (elapsed > PROGRESS_EASE_MS)
+		elapsed = PROGRESS_EASE_MS;
+	shown += (target - shown) * elapsed / PROGRESS_EASE_MS;
+
+	/* Less than a step per frame left */
+	if (shown == app_progress_shown)
+		shown = target;
+
+	if (app_progress_redraws) {
+		app_progress_redraws--;
+		osUpdateScreenShowProgressFine(shown);
+		app_draw_text();
+	}
+	else {
+		osUpdateScreenMoveProgress(app_progress_drawn, shown);
+	}
+
+	app_progress_drawn = app_progress_shown;
+	app_progress_shown = shown;
+
+	if (shown != target || app_progress_redraws)
+		return true;
+
+idle:
+	app_progress_easing = false;
+	return false;
+}
+
+/** Keep 'progress_bar' mode ui moving until it shows app_step
+ */
+static void
+app_ease_progress_bar(void)
+{
+	if (!app_progress_easing) {
+		app_progress_easing = true;
+		app_progress_tick_ms = frameclock_now();
+		frameclock_add(app_tick_progress_bar_cb);
+	}
+}
+
+/** Timer callback for updating 'progress_bar' mode ui
+ */
+static gboolean
+app_update_progress_bar_cb(gpointer aptr)
+{
+	(void)aptr;
+
+	app_step += 1;
+
+	if (app_step > 100) {
+		app_quit();
+		return G_SOURCE_REMOVE;
+	}
+
+	if (app_scene) {
+		scene_set_progress(app_scene, app_step);
+		frameclock_add(app_tick_scene_cb);
+	}
+	else {
+		app_ease_progress_bar();
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+/** Prepare for 'progress_bar' mode ui
+ */
+static void
+app_start_progress_bar(void)
+{
+	if (app_image_count > 0 && loadLogo(app_images[0], NULL) == -1) {
+		mainloop_stop();
+	}
+	else {
+		int period = (app_progress_ms + 101 - 1) / 101;
+		log_debug("%s - period %d", __func__, period);
+		g_timeout_add(period, app_update_progress_bar_cb, NULL);
+		app_update_progress_bar_cb(NULL);
+		app_draw_progress_bar_cb();
+	}
+}
+
+/** Draw everything of 'busy' mode ui except the indicator
+ */
+static void
+app_draw_busy_background(void)
+{
+	gr_color(0, 0, 0, 255);
+	gr_clear();
+	showProgressLogo();
+	app_draw_text();
+}
+
+/** Callback for drawing 'busy' mode ui
+ */
+static void
+app_draw_busy_cb(void)
+{
+	/* Set draw on unblank hook */
+	app_draw_ui_cb = app_draw_busy_cb;
+
+	if (!display_can_be_drawn())
+		return;
+
+	/* Indicator steps are rendered once, when display is usable */
+	if (!app_spinner) {
+		int fbw = gr_fb_width();
+		int fbh = gr_fb_height();
+
+		if (!strcmp(app_busy_style, "bar"))
+			app_spinner = spinner_new(SPINNER_BAR, 10, fbh / 2 + 10,
+						  fbw - 20, 10);
+		else
+			app_spinner = spinner_new(SPINNER_WHEEL, 0,
+						  fbh / 2 + 10, fbw, fbw / 8);
+		if (!app_spinner) {
+			log_err("could not create busy indicator");
+			return;
+		}
+		spinner_tick(app_spinner, frameclock_now());
+	}
+
+	app_draw_busy_background();
+	spinner_draw(app_spinner);
+	frameclock_flip();
+
+	/* The other buffer lacks the background */
+	app_busy_redraws = 1;
+	frameclock_add(app_tick_busy_cb);
+}
+
+/** Frame clock callback for animating 'busy' mode ui
+ *
+ * Normally only the area of the indicator is drawn. Goes idle while
+ * the display can't be drawn, app_draw_busy_cb() starts it again.
+ */
+static bool
+app_tick_busy_cb(gint64 now_ms)
+{
+	if (!app_spinner || !display_can_be_drawn())
+		return false;
+
+	if (!spinner_tick(app_spinner, now_ms) && !app_busy_redraws)
+		return true;
+
+	if (app_busy_redraws) {
+		app_busy_redraws--;
+		app_draw_busy_background();
+	}
+
+	spinner_draw(app_spinner);
+	return true;
+}
+
+/** Prepare for 'busy' mode ui
+ */
+static void
+app_start_busy(void)
+{
+	if (strcmp(app_busy_style, "wheel") && strcmp(app_busy_style, "bar")) {
+		log_err("%s: unknown busy indicator style", app_busy_style);
+		mainloop_stop();
+	}
+	else if (app_image_count > 0 && loadLogo(app_images[0], NULL) == -1) {
+		mainloop_stop();
+	}
+	else {
+		app_draw_busy_cb();
+	}
+}
+
+/** Callback for drawing 'animation' mode ui
+ */
+static void
+app_draw_animate_images_cb(void)
+{
+	/* Set draw on unblank hook */
+	app_draw_ui_cb = app_draw_animate_images_cb;
+
+	if (display_can_be_drawn()) {
+		gr_color(0, 0, 0, 255);
+		gr_clear();
+		showLogo();
+		app_draw_text();
+		frameclock_flip();
+	}
+}
+
+/** Timer callback for updating 'animation' mode ui
+ */
+static gboolean
+app_update_animate_images_cb(gpointer aptr)
+{
+	(void)aptr;
+
+	app_step += 1;
+	app_step %= app_image_count;
+
+	if (app_crossfade_ms) {
+		if (crossfadeLogo(app_images[app_step], NULL, app_crossfade_ms,
+				  frameclock_period_ms) == -1) {
+			mainloop_stop();
+			return G_SOURCE_REMOVE;
+		}
+		frameclock_add(app_tick_crossfade_cb);
+	}
+	else if (loadLogo(app_images[app_step], NULL) == -1) {
+		mainloop_stop();
+		return G_SOURCE_REMOVE;
+	}
+
+	app_draw_animate_images_cb();
+	return G_SOURCE_CONTINUE;
+}
+
+/** Frame clock callback for crossfading between 'animation' mode images
+ */
+static bool
+app_tick_crossfade_cb(gint64 now_ms)
+{
+	/* Only the area where the images differ is redrawn */
+	if (!display_can_be_drawn())
+		return false;
+
+	return showLogoCrossfade(now_ms);
+}
+
+/** Prepare for 'animation' mode ui
+ */
+static void
+app_start_animate_images(void)
+{
+	int period = (app_animate_ms + app_image_count - 1)
+		/ app_image_count;
+	log_debug("%s - period %d", __func__, period);
+	g_timeout_add(period, app_update_animate_images_cb, NULL);
+	app_update_animate_images_cb(NULL);
+}
+
+/** Callback for drawing 'scene' mode ui
  */
 static void
-app_draw_text_only_cb(void)
+app_draw_scene_cb(void)
 {
 	/* Set draw on unblank hook */
-	app_draw_ui_cb = app_draw_text_only_cb;
+	app_draw_ui_cb = app_draw_scene_cb;
 
 	if (display_can_be_drawn()) {
-		app_draw_text();
-		gr_flip();
+		scene_draw(app_scene, true);
+		frameclock_flip();
 	}
 }
 
-/** Prepare for 'text_only' mode ui
+/** Frame clock callback for updating 'scene' mode ui
+ */
+static bool
+app_tick_scene_cb(gint64 now_ms)
+{
+	/* Only layers that changed are redrawn */
+	if (scene_tick(app_scene, now_ms) && display_can_be_drawn())
+		scene_draw(app_scene, false);
+
+	return scene_is_animated(app_scene);
+}
+
+/** Prepare for 'scene' mode ui
  */
 static void
-app_start_text_only(void)
+app_start_scene(void)
 {
-	app_draw_text_only_cb();
+	if (!(app_scene = scene_load(app_scene_path, app_images_dir))) {
+		log_err("%s: failed to load scene", app_scene_path);
+		mainloop_stop();
+		return;
+	}
+
+	scene_set_text(app_scene, app_text);
+	scene_tick(app_scene, frameclock_now());
+	app_draw_scene_cb();
+
+	if (scene_is_animated(app_scene))
+		frameclock_add(app_tick_scene_cb);
+
+	if (app_progress_ms) {
+		int period = (app_progress_ms + 101 - 1) / 101;
+		log_debug("%s - period %d", __func__, period);
+		g_timeout_add(period, app_update_progress_bar_cb, NULL);
+	}
 }
 
-/** Callback for drawing 'single_image' mode ui
+/** Callback for drawing 'frames' mode ui
  */
 static void
-app_draw_single_image_cb(void)
+app_draw_frames_cb(void)
 {
 	/* Set draw on unblank hook */
-	app_draw_ui_cb = app_draw_single_image_cb;
+	app_draw_ui_cb = app_draw_frames_cb;
 
 	if (display_can_be_drawn()) {
-		showLogo();
+		gint64 elapsed = frameclock_now() - app_frames_start_ms;
+		gr_color(0, 0, 0, 255);
+		gr_clear();
+		frameseq_draw(app_frames,
+			      frameseq_frame_at(app_frames, elapsed), true);
 		app_draw_text();
-		gr_flip();
+		frameclock_flip();
+		frameclock_add(app_tick_frames_cb);
 	}
 }
 
-/** Prepare for 'single_image' mode ui
+/** Frame clock callback for playing 'frames' mode frames
+ *
+ * Goes idle while the display can't be drawn. The frame shown comes
+ * from elapsed time, so app_draw_frames_cb() just starts it again.
+ */
+static bool
+app_tick_frames_cb(gint64 now_ms)
+{
+	gint64 elapsed = now_ms - app_frames_start_ms;
+
+	if (!display_can_be_drawn())
+		return false;
+
+	/* Only the area that changed between frames is copied */
+	frameseq_draw(app_frames, frameseq_frame_at(app_frames, elapsed),
+		      false);
+	return true;
+}
+
+/** Prepare for 'frames' mode ui
  */
 static void
-app_start_single_image(void)
+app_start_frames(void)
 {
-	if (loadLogo(app_images[0], NULL) == -1)
+	if (!(app_frames = frameseq_open(app_frames_path))) {
+		log_err("%s: failed to open frames", app_frames_path);
 		mainloop_stop();
-	else
-		app_draw_single_image_cb();
+		return;
+	}
+
+	app_frames_start_ms = frameclock_now();
+	app_draw_frames_cb();
 }
 
-/** Callback for drawing 'progress_bar' mode ui
+/** Add text to console and schedule drawing it
+ *
+ * Bursts of output are drawn at most once per frame clock tick.
  */
 static void
-app_draw_progress_bar_cb(void)
+app_write_console(const char *data, size_t size)
 {
-	/* Set draw on unblank hook */
-	app_draw_ui_cb = app_draw_progress_bar_cb;
-
-	if (display_can_be_drawn()) {
-		osUpdateScreenShowProgress(app_step);
-		app_draw_text();
-		gr_flip();
+	if (app_console) {
+		console_write(app_console, data, size);
+		frameclock_add(app_tick_console_cb);
 	}
 }
 
-/** Timer callback for updating 'progress_bar' mode ui
+/** Copy console on top of other ui content
+ *
+ * Called before every flip. The console is created, and starts
+ * following its source, when the display is first drawn to.
  */
-static gboolean
-app_update_progress_bar_cb(gpointer aptr)
+static void
+app_draw_console(void)
 {
-	(void)aptr;
+	int fbw, fbh;
 
-	app_step += 1;
+	if (!app_console_source)
+		return;
 
-	if (app_step > 100) {
-		mainloop_stop();
-		return G_SOURCE_REMOVE;
+	if (!app_console) {
+		fbw = gr_fb_width();
+		fbh = gr_fb_height();
+
+		/* Whole screen alone, lower part of it with other content */
+		if (app_draw_ui_cb == app_draw_console_only_cb)
+			app_console = console_new(10, 10, fbw - 20, fbh - 20);
+		else
+			app_console = console_new(10, fbh * 2 / 3, fbw - 20,
+						  fbh / 3 - 10);
+
+		if (!app_console) {
+			log_err("could not create console");
+			app_console_source = NULL;
+			return;
+		}
+		if (!logfeed_init(app_console_source))
+			log_err("%s: console input not available",
+				app_console_source);
+		console_update(app_console);
 	}
 
-	app_draw_progress_bar_cb();
-	return G_SOURCE_CONTINUE;
+	console_draw(app_console);
 }
 
-/** Prepare for 'progress_bar' mode ui
+/** Frame clock callback for rendering new console lines
  */
-static void
-app_start_progress_bar(void)
+static bool
+app_tick_console_cb(gint64 now_ms)
 {
-	if (app_image_count > 0 && loadLogo(app_images[0], NULL) == -1) {
-		mainloop_stop();
-	}
-	else {
-		int period = (app_progress_ms + 101 - 1) / 101;
-		log_debug("%s - period %d", __func__, period);
-		g_timeout_add(period, app_update_progress_bar_cb, NULL);
-		app_update_progress_bar_cb(NULL);
-	}
+	(void)now_ms;
+
+	/* Shown by the flip at the end of the tick */
+	console_update(app_console);
+	return false;
 }
 
-/** Callback for drawing 'animation' mode ui
+/** Callback for drawing 'console_only' mode ui
  */
 static void
-app_draw_animate_images_cb(void)
+app_draw_console_only_cb(void)
 {
 	/* Set draw on unblank hook */
-	app_draw_ui_cb = app_draw_animate_images_cb;
+	app_draw_ui_cb = app_draw_console_only_cb;
 
 	if (display_can_be_drawn()) {
 		gr_color(0, 0, 0, 255);
 		gr_clear();
-		showLogo();
 		app_draw_text();
-		gr_flip();
+		frameclock_flip();
 	}
 }
 
-/** Timer callback for updating 'animation' mode ui
+/** Prepare for 'console_only' mode ui
  */
-static gboolean
-app_update_animate_images_cb(gpointer aptr)
+static void
+app_start_console_only(void)
 {
-	(void)aptr;
+	app_draw_console_only_cb();
+}
 
-	app_step += 1;
-	app_step %= app_image_count;
+/** Frame clock callback for fading display in / out
+ */
+static bool
+app_fade_cb(gint64 now_ms)
+{
+	gint64 elapsed = now_ms - app_fade_start_ms;
+	bool   done    = elapsed >= (gint64)app_fade_ms;
+	int    level   = done ? 255 : elapsed * 255 / app_fade_ms;
+
+	if (app_fading_out)
+		level = 255 - level;
+
+	/* In software, the flip at the end of the tick shows the level */
+	display_set_fade(level);
 
-	if (loadLogo(app_images[app_step], NULL) == -1) {
+	if (done && app_fading_out) {
+		/* Leave black content and unmodified color lookup
+		 * table behind for whoever takes over the display */
+		if (display_can_be_drawn()) {
+			gr_color(0, 0, 0, 255);
+			gr_clear();
+			gr_flip();
+			gr_clear();
+		}
+		display_set_fade(255);
 		mainloop_stop();
-		return G_SOURCE_REMOVE;
 	}
 
-	app_draw_animate_images_cb();
-	return G_SOURCE_CONTINUE;
+	return !done;
 }
 
-/** Prepare for 'animation' mode ui
+/** Start fading display in or out over '--fade' period
  */
 static void
-app_start_animate_images(void)
+app_start_fade(bool out)
 {
-	int period = (app_animate_ms + app_image_count - 1)
-		/ app_image_count;
-	log_debug("%s - period %d", __func__, period);
-	g_timeout_add(period, app_update_animate_images_cb, NULL);
-	app_update_animate_images_cb(NULL);
+	gint64 now     = frameclock_now();
+	gint64 elapsed = now - app_fade_start_ms;
+	int    level   = 255;
+
+	if (out && app_fading_out)
+		return;
+
+	/* Fade out from where a running fade in got to */
+	if (out && elapsed < (gint64)app_fade_ms)
+		level = elapsed * 255 / app_fade_ms;
+
+	log_debug("fade %s", out ? "out" : "in");
+	app_fading_out = out;
+	app_fade_start_ms = now - (gint64)(255 - level) * app_fade_ms / 255;
+	frameclock_add(app_fade_cb);
+}
+
+/** Stop the app, after fading out if requested
+ */
+static void
+app_quit(void)
+{
+	if (app_fade_ms && display_can_be_drawn())
+		app_start_fade(true);
+	else
+		mainloop_stop();
 }
 
 /** Idle callback for continuing app startup from within mainloop
@@ -1344,6 +2917,8 @@ app_start_cb(gpointer aptr)
 
 	bool success = false;
 
+	log_timing("start");
+
 	/* Handle started-in-early-boot situation */
 
 	if (!systembus_is_available()) {
@@ -1354,15 +2929,39 @@ app_start_cb(gpointer aptr)
 		display_set_updates_enabled(true);
 	}
 
+	/* Start from black if fade-in is requested */
+
+	if (app_fade_ms && display_can_be_drawn()) {
+		display_set_fade(0);
+		app_start_fade(false);
+	}
+
+	/* Show stored first frame while the real one is prepared */
+
+	snapshot_show();
+
 	/* Select what kind of ui mode to use */
 
-	if (app_progress_ms) {
+	if (app_scene_path) {
+		app_start_scene();
+	}
+	else if (app_frames_path) {
+		app_start_frames();
+	}
+	else if (app_progress_ms) {
 		if (app_image_count > 1) {
 			log_err("Can only show one image with progressbar");
 			goto cleanup;
 		}
 		app_start_progress_bar();
 	}
+	else if (app_busy_style) {
+		if (app_image_count > 1) {
+			log_err("Can only show one image with busy indicator");
+			goto cleanup;
+		}
+		app_start_busy();
+	}
 	else if (app_animate_ms) {
 		if (app_image_count < 2) {
 			log_err("Animating requires at least 2 images");
@@ -1373,6 +2972,9 @@ app_start_cb(gpointer aptr)
 	else if (app_image_count > 0) {
 		app_start_single_image();
 	}
+	else if (app_console_source) {
+		app_start_console_only();
+	}
 	else if (app_text) {
 		app_start_text_only();
 	}
@@ -1400,7 +3002,7 @@ app_stop_cb(gpointer aptr)
 {
 	(void)aptr;
 
-	mainloop_stop();
+	app_quit();
 	return G_SOURCE_REMOVE;
 }
 
@@ -1426,10 +3028,38 @@ app_print_long_help(void)
 	printf("\n  OPTIONS:\n");
 	printf("  --animate=PERIOD, -a PERIOD\n");
 	printf("         Show IMAGEs (at least 2) in rotation over PERIOD ms\n");
+	printf("  --busy=STYLE, -b STYLE\n");
+	printf("         Show that work of unknown length is going on, with\n");
+	printf("         a wheel or a bar STYLE indicator\n");
+	printf("  --console=SOURCE, -l SOURCE\n");
+	printf("         Show tail of text read from SOURCE: - for stdin,\n");
+	printf("         journal for systemd journal, a fifo, or a file\n");
+	printf("         to follow as it grows\n");
+	printf("  --crossfade=TIME, -C TIME\n");
+	printf("         Crossfade between animated IMAGEs over TIME ms\n");
+	printf("  --fade=TIME, -f TIME\n");
+	printf("         Fade in at start and out before exit over TIME ms\n");
+	printf("  --frames=FILE, -F FILE\n");
+	printf("         Play raw frame file in a loop, see frameseq.h for format\n");
 	printf("  --imagesdir=DIR, -i DIR\n");
 	printf("         Load IMAGE(s) from DIR, /res/images by default\n");
+	printf("  --max-fps=FPS, -m FPS\n");
+	printf("         Draw at most FPS frames per second, and let the display\n");
+	printf("         run at a lower refresh rate if it can\n");
+	printf("  --mirror, -M\n");
+	printf("         Show the same on other connected displays, e.g. HDMI\n");
 	printf("  --progressbar=TIME, -p TIME\n");
 	printf("         Show a progess bar over TIME milliseconds\n");
+	printf("  --rotate=DEGREES, -r DEGREES\n");
+	printf("         Rotate display clockwise by 0, 90, 180 or 270 degrees\n");
+	printf("  --render-scale=PERCENT, -R PERCENT\n");
+	printf("         Render at PERCENT of display resolution and let the\n");
+	printf("         display hardware scale it up, if possible\n");
+	printf("  --scene=FILE, -S FILE\n");
+	printf("         Draw layout described in FILE, see scene.h for syntax\n");
+	printf("  --snapshot=FILE, -k FILE\n");
+	printf("         Store first frame in FILE and show it immediately\n");
+	printf("         on the next start with the same options and files\n");
 	printf("  --stopafter=TIME, -s TIME\n");
 	printf("         Stop showing the IMAGE(s) after TIME milliseconds\n");
 	printf("  --text=STRING, -t STRING\n");
@@ -1445,8 +3075,19 @@ app_print_long_help(void)
 /** Long form command line options */
 static struct option opt_long[] = {
 	{"animate",      required_argument, 0, 'a'},
+	{"busy",         required_argument, 0, 'b'},
+	{"console",      required_argument, 0, 'l'},
+	{"crossfade",    required_argument, 0, 'C'},
+	{"fade",         required_argument, 0, 'f'},
+	{"frames",       required_argument, 0, 'F'},
 	{"imagesdir",    required_argument, 0, 'i'},
+	{"max-fps",      required_argument, 0, 'm'},
+	{"mirror",       no_argument,       0, 'M'},
 	{"progressbar",  required_argument, 0, 'p'},
+	{"rotate",       required_argument, 0, 'r'},
+	{"render-scale", required_argument, 0, 'R'},
+	{"scene",        required_argument, 0, 'S'},
+	{"snapshot",     required_argument, 0, 'k'},
 	{"stopafter",    required_argument, 0, 's'},
 	{"text",         required_argument, 0, 't'},
 	{"help",         no_argument,       0, 'h'},
@@ -1457,7 +3098,301 @@ static struct option opt_long[] = {
 };
 
 /** Short form command line options */
-static const char opt_short[] = "a:i:p:s:t:hxnc";
+static const char opt_short[] = "a:b:C:f:F:i:k:l:m:p:r:R:S:s:t:hxncM";
+
+/* ========================================================================= *
+ * SNAPSHOT
+ * ========================================================================= */
+
+/** Snapshot file identification */
+#define SNAPSHOT_MAGIC   "YAMUISNP"
+#define SNAPSHOT_VERSION 2
+
+/** FNV-1a parameters */
+#define SNAPSHOT_HASH_BASIS 14695981039346656037ULL
+#define SNAPSHOT_HASH_PRIME 1099511628211ULL
+
+/** Upper limit for the list of files read for the frame */
+#define SNAPSHOT_FILES_MAX (64 * 1024)
+
+/** Header of snapshot file, followed by the nul terminated paths of the
+ *  files read for the frame and the pixels of draw buffer */
+typedef struct {
+	char    magic[8];
+	guint32 version;
+	guint32 width;
+	guint32 height;
+	guint32 row_bytes;
+	guint32 pixel_bytes;
+	guint32 files_size;
+	guint64 hash;
+} snapshot_header_t;
+
+static const char *snapshot_path    = NULL;
+static int         snapshot_argc    = 0;
+static char      **snapshot_argv    = NULL;
+static bool        snapshot_pending = false;
+static GString    *snapshot_files   = NULL;
+
+/** Add bytes to FNV-1a hash
+ */
+static guint64
+snapshot_hash_bytes(guint64 hash, const void *data, size_t size)
+{
+	const unsigned char *byte = data;
+
+	while (size--) {
+		hash ^= *byte++;
+		hash *= SNAPSHOT_HASH_PRIME;
+	}
+	return hash;
+}
+
+/** Add identity of file to hash
+ *
+ * Size and modification time are used instead of content, so that
+ * checking the snapshot does not cost reading the files.
+ */
+static guint64
+snapshot_hash_file(guint64 hash, const char *path)
+{
+	struct stat st = {};
+	gint64 id[5] = {};
+
+	if (path && stat(path, &st) == 0) {
+		id[0] = st.st_dev;
+		id[1] = st.st_ino;
+		id[2] = st.st_size;
+		id[3] = st.st_mtim.tv_sec;
+		id[4] = st.st_mtim.tv_nsec;
+	}
+	return snapshot_hash_bytes(hash, id, sizeof id);
+}
+
+/** Hash of everything that affects the first frame
+ *
+ * Covers command line, display size, the images and files it names,
+ * the yamui binary itself, and the paths and identities of the files
+ * read for the frame.
+ *
+ * @param files nul terminated paths of files read for the frame
+ * @param size  size of files in bytes
+ */
+static guint64
+snapshot_hash(const char *files, size_t size)
+{
+	guint64     hash = SNAPSHOT_HASH_BASIS;
+	int         fb_size[2] = { gr_fb_width(), gr_fb_height() };
+	const char *pos;
+
+	for (int i = 0; i < snapshot_argc; i++)
+		hash = snapshot_hash_bytes(hash, snapshot_argv[i],
+					   strlen(snapshot_argv[i]) + 1);
+	hash = snapshot_hash_bytes(hash, fb_size, sizeof fb_size);
+
+	for (pos = files; pos < files + size; pos += strlen(pos) + 1) {
+		hash = snapshot_hash_bytes(hash, pos, strlen(pos) + 1);
+		hash = snapshot_hash_file(hash, pos);
+	}
+
+	for (int i = 0; i < app_image_count; i++)
+		hash = snapshot_hash_file(hash, app_images[i]);
+	hash = snapshot_hash_file(hash, app_images_dir);
+	hash = snapshot_hash_file(hash, app_scene_path);
+	hash = snapshot_hash_file(hash, app_frames_path);
+	hash = snapshot_hash_file(hash, "/proc/self/exe");
+
+	return hash;
+}
+
+/** Remember file read for the first frame
+ *
+ * Called for the images, the font and atlas tables, including the
+ * ones named only in the scene file.
+ */
+static void
+snapshot_note_file(const char *path)
+{
+	const char *end = snapshot_files->str + snapshot_files->len;
+	const char *pos;
+
+	for (pos = snapshot_files->str; pos < end; pos += strlen(pos) + 1)
+		if (!strcmp(pos, path))
+			return;
+	g_string_append_len(snapshot_files, path, strlen(path) + 1);
+}
+
+/** Enable snapshot of the first frame
+ *
+ * @param path cache file
+ * @param argc number of command line arguments
+ * @param argv command line arguments
+ */
+static void
+snapshot_init(const char *path, int argc, char **argv)
+{
+	snapshot_path = path;
+	snapshot_argc = argc;
+	snapshot_argv = argv;
+
+	if (!snapshot_files)
+		snapshot_files = g_string_new(NULL);
+	res_set_file_hook(snapshot_note_file);
+}
+
+/** Show first frame stored on an earlier run
+ *
+ * The pixels are read straight into the draw buffer and flipped before
+ * any images are decoded. If there is no valid snapshot, the first
+ * frame drawn is stored instead.
+ *
+ * @return true if snapshot was shown
+ */
+static bool
+snapshot_show(void)
+{
+	bool               shown  = false;
+	int                fd     = -1;
+	snapshot_header_t  header = {};
+	gchar             *files  = NULL;
+	gr_surface         draw;
+	size_t             size;
+
+	if (!snapshot_path || !display_can_be_drawn())
+		goto cleanup;
+
+	if ((fd = open(snapshot_path, O_RDONLY | O_CLOEXEC)) == -1) {
+		if (errno != ENOENT)
+			log_err("%s: open(): %m", snapshot_path);
+		goto cleanup;
+	}
+
+	draw = gr_draw_surface();
+	size = (size_t)draw->row_bytes * draw->height;
+
+	if (read(fd, &header, sizeof header) != sizeof header ||
+	    memcmp(header.magic, SNAPSHOT_MAGIC, sizeof header.magic) ||
+	    header.version != SNAPSHOT_VERSION ||
+	    header.width != (guint32)draw->width ||
+	    header.height != (guint32)draw->height ||
+	    header.row_bytes != (guint32)draw->row_bytes ||
+	    header.pixel_bytes != (guint32)draw->pixel_bytes ||
+	    header.files_size > SNAPSHOT_FILES_MAX) {
+		log_debug("%s: snapshot is out of date", snapshot_path);
+		goto cleanup;
+	}
+
+	/* Files read for the frame, to check that none has changed */
+	files = g_malloc(header.files_size + 1);
+	if (read(fd, files, header.files_size) != (ssize_t)header.files_size ||
+	    (header.files_size && files[header.files_size - 1])) {
+		log_err("%s: snapshot is truncated", snapshot_path);
+		goto cleanup;
+	}
+
+	if (header.hash != snapshot_hash(files, header.files_size)) {
+		log_debug("%s: snapshot is out of date", snapshot_path);
+		goto cleanup;
+	}
+
+	if (read(fd, draw->data, size) != (ssize_t)size) {
+		log_err("%s: snapshot is truncated", snapshot_path);
+		goto cleanup;
+	}
+
+	display_flip();
+	shown = true;
+	log_debug("%s: snapshot shown", snapshot_path);
+
+cleanup:
+	if (snapshot_path && !shown)
+		snapshot_pending = true;
+	else
+		res_set_file_hook(NULL);
+	if (fd != -1)
+		close(fd);
+	g_free(files);
+	return shown;
+}
+
+/** Store the first frame drawn, if there was no valid snapshot
+ *
+ * Called just after the frame is flipped, so that writing it does not
+ * delay it.
+ */
+static void
+snapshot_store(void)
+{
+	int               fd     = -1;
+	gchar            *temp   = NULL;
+	snapshot_header_t header = {
+		.magic   = SNAPSHOT_MAGIC,
+		.version = SNAPSHOT_VERSION,
+	};
+	gr_surface        draw;
+	size_t            size;
+
+	if (!snapshot_pending)
+		goto cleanup;
+
+	snapshot_pending = false;
+	res_set_file_hook(NULL);
+
+	/* Overlay plane content would be missing */
+	if (gr_has_overlay()) {
+		log_debug("%s: overlay in use, not stored", snapshot_path);
+		goto cleanup;
+	}
+
+	if (!(draw = gr_front_surface())) {
+		log_debug("%s: frame not available, not stored",
+			  snapshot_path);
+		goto cleanup;
+	}
+	size = (size_t)draw->row_bytes * draw->height;
+	header.width = draw->width;
+	header.height = draw->height;
+	header.row_bytes = draw->row_bytes;
+	header.pixel_bytes = draw->pixel_bytes;
+	header.files_size = snapshot_files->len;
+	header.hash = snapshot_hash(snapshot_files->str, snapshot_files->len);
+
+	if (header.files_size > SNAPSHOT_FILES_MAX) {
+		log_debug("%s: too many files read, not stored", snapshot_path);
+		goto cleanup;
+	}
+
+	/* Write and rename, so that a partial file is never used */
+	temp = g_strdup_printf("%s.tmp", snapshot_path);
+	if ((fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+		       0644)) == -1) {
+		log_err("%s: open(): %m", temp);
+		goto cleanup;
+	}
+	if (write(fd, &header, sizeof header) != sizeof header ||
+	    write(fd, snapshot_files->str, snapshot_files->len) !=
+	    (ssize_t)snapshot_files->len ||
+	    write(fd, draw->data, size) != (ssize_t)size) {
+		log_err("%s: write(): %m", temp);
+		goto cleanup;
+	}
+	if (close(fd) == -1) {
+		fd = -1;
+		log_err("%s: close(): %m", temp);
+		goto cleanup;
+	}
+	fd = -1;
+	if (rename(temp, snapshot_path) == -1) {
+		log_err("%s: rename(): %m", snapshot_path);
+		goto cleanup;
+	}
+	log_debug("%s: snapshot stored", snapshot_path);
+
+cleanup:
+	if (fd != -1)
+		close(fd), unlink(temp);
+	g_free(temp);
+}
 
 /* ========================================================================= *
  * MAIN
@@ -1471,6 +3406,8 @@ main(int argc, char *argv[])
 	setlinebuf(stdout);
 	setlinebuf(stderr);
 
+	log_timing_enabled = getenv("YAMUI_TIMING") != NULL;
+	log_timing("main");
 	log_debug("startup");
 
 	for (;;) {
@@ -1483,14 +3420,58 @@ main(int argc, char *argv[])
 			log_debug("got animate %s ms", optarg);
 			app_animate_ms = strtoul(optarg, NULL, 10);
 			break;
+		case 'b':
+			log_debug("got busy %s", optarg);
+			app_busy_style = optarg;
+			break;
+		case 'C':
+			log_debug("got crossfade %s ms", optarg);
+			app_crossfade_ms = strtoul(optarg, NULL, 10);
+			break;
+		case 'f':
+			log_debug("got fade %s ms", optarg);
+			app_fade_ms = strtoul(optarg, NULL, 10);
+			break;
+		case 'F':
+			log_debug("got frames \"%s\"", optarg);
+			app_frames_path = optarg;
+			break;
 		case 'i':
 			log_debug("got imagesdir \"%s\"", optarg);
 			app_images_dir = optarg;
 			break;
+		case 'k':
+			log_debug("got snapshot \"%s\"", optarg);
+			snapshot_init(optarg, argc, argv);
+			break;
+		case 'l':
+			log_debug("got console \"%s\"", optarg);
+			app_console_source = optarg;
+			break;
+		case 'm':
+			log_debug("got max-fps %s", optarg);
+			frameclock_set_max_fps(strtol(optarg, NULL, 10));
+			break;
+		case 'M':
+			log_debug("got mirror");
+			gr_set_mirror(true);
+			break;
 		case 'p':
 			log_debug("got progressbar %s ms", optarg);
 			app_progress_ms = strtoull(optarg, NULL, 10);
 			break;
+		case 'r':
+			log_debug("got rotation %s", optarg);
+			gr_set_rotation(strtol(optarg, NULL, 10));
+			break;
+		case 'R':
+			log_debug("got render scale %s %%", optarg);
+			gr_set_render_scale(strtol(optarg, NULL, 10));
+			break;
+		case 'S':
+			log_debug("got scene \"%s\"", optarg);
+			app_scene_path = optarg;
+			break;
 		case 's':
 			log_debug("got stop at %s ms", optarg);
 			app_stop_ms = strtoull(optarg, NULL, 10);
@@ -1527,7 +3508,8 @@ main(int argc, char *argv[])
 	while (optind < argc)
 		app_add_image(argv[optind++]);
 
-	if (app_image_count < 1 && !app_text) {
+	if (app_image_count < 1 && !app_text && !app_scene_path &&
+	    !app_frames_path && !app_console_source) {
 		log_err("No text or images specified");
 		app_print_short_help();
 		exit(EXIT_FAILURE);
@@ -1549,6 +3531,9 @@ main(int argc, char *argv[])
 	if (!unix_server_init())
 		goto cleanup;
 
+	/* Failing to serve external frames is not fatal */
+	frame_server_init();
+
 	if (!compositor_init())
 		goto cleanup;
 
@@ -1582,6 +3567,7 @@ cleanup:
 	 * be immediately available for the next yamui instance.
 	 */
 	unix_server_quit();
+	frame_server_quit();
 
 	/* Apart from the above: assume that the rest of the
 	 * cleanup is not necessary, and that skipping it might
@@ -1593,10 +3579,30 @@ cleanup:
 	if (do_cleanup) {
 		display_release();
 		app_flush_images();
+		frameclock_remove(app_tick_scene_cb);
+		frameclock_remove(app_fade_cb);
+		frameclock_remove(app_tick_crossfade_cb);
+		frameclock_remove(app_tick_frames_cb);
+		frameclock_remove(app_tick_console_cb);
+		frameclock_remove(app_tick_busy_cb);
+		frameclock_remove(app_tick_progress_bar_cb);
+		logfeed_quit();
+		console_free(app_console), app_console = NULL;
+		spinner_free(app_spinner), app_spinner = NULL;
+		frameseq_close(app_frames), app_frames = NULL;
+		scene_free(app_scene), app_scene = NULL;
 		systembus_quit_socket_monitor();
 		compositor_quit();
 	}
+	else if (display_is_acquired()) {
+		/* Next user of the display gets it in the mode it would
+		 * set up itself */
+		if (gr_handover() == -1)
+			log_err("gr_handover() failed");
+		log_timing("release");
+	}
 
 	log_debug("exit");
+	log_timing("exit");
 	return EXIT_SUCCESS;
 }